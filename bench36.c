@@ -0,0 +1,1536 @@
+/* Benchmarks for the 36-bit data conversions and the magtape I/O layer.
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ *
+ */
+
+/* Results are written to stdout as CSV, one line per measurement:
+ *
+ *   group,name,impl,size,iterations,seconds,mb_per_s,ns_per_word,ns_per_op
+ *
+ * group is kernel, ascii or io.  impl is the implementation measured
+ * (scalar, a vector level, packed for the pwd36_T functions, or reference
+ * for the hand-written packing functions that the generated ones replace).  size
+ * is the record size in frames (kernel), the word count (ascii) or the
+ * mean record size (io).  An op is one call (kernel, ascii) or one
+ * record (io).  MB/s is of tape frames (kernel, io) or characters
+ * (ascii); io words are counted as core-dump words, 5 frames each.
+ * Lines starting with # are comments.
+ *
+ * -v instead checks the kernels generated from layout36.h, at every
+ * vector level, against the hand-written ones, and magtape_seek against
+ * a forward read of a synthetic tape in the -d directory, with no index
+ * sidecar and with a current, truncated and stale one.  The tape is also
+ * read backwards from magtape_eom, with and without an index.  It exits
+ * non-zero if anything differs.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buf36.h"
+#include "magtape.h"
+#include "data36.h"
+#include "layout36.h"
+#include "simd36.h"
+#include "version.h"
+
+#define MAXRECSIZE 0x00FFFFFF
+
+#define G_KERNEL 1
+#define G_ASCII  2
+#define G_IO     4
+
+#define MAXSIZES 32
+
+typedef void (*benchfn_T)( void *ctx );
+
+static double now( void );
+static uint64_t run( benchfn_T fn, void *ctx, double *secs );
+static void report( const char *group, const char *name, const char *impl,
+                    size_t size, uint64_t iters, double secs,
+                    double bytes, double words, double ops );
+static void fill_random( uint8_t *buf, size_t len );
+static void bench_kernels( void );
+static int verify_kernels( void );
+static int verify_index( void );
+static int verify_reverse( void );
+static void bench_ascii( void );
+static int bench_io( void );
+static int parse_sizes( const char *arg );
+static int parse_dist( const char *arg );
+static void usage( void );
+
+static struct benchmode {
+    const char *const name;
+    packformat_T format;
+    unpackfn_T unpack;          /* Hand-written (reference) */
+    packfn_T pack;
+    unpackfn_T gunpack;         /* Generated from the layout */
+    packfn_T gpack;
+    punpackfn_T punpack;
+    ppackfn_T ppack;
+} modes[] = {
+    { "core_dump",    PK_CORE_DUMP,    unpack_core_dump,    pack_core_dump,
+      unpack_gen_core_dump,    pack_gen_core_dump,
+      unpackp_core_dump,    packp_core_dump },
+    { "sixbit",       PK_SIXBIT,       unpack_sixbit_7,     pack_sixbit_7,
+      unpack_gen_sixbit,       pack_gen_sixbit,
+      unpackp_sixbit_7,     packp_sixbit_7 },
+    { "high_density", PK_HIGH_DENSITY, unpack_high_density, pack_high_density,
+      unpack_gen_high_density, pack_gen_high_density,
+      unpackp_high_density, packp_high_density },
+    { "industry",     PK_INDUSTRY,     unpack_industry,     pack_industry,
+      unpack_gen_industry,     pack_gen_industry,
+      unpackp_industry,     packp_industry },
+    { "ansi_ascii",   PK_ANSI_ASCII,   unpack_ansi_ascii,   pack_ansi_ascii,
+      unpack_gen_ansi_ascii,   pack_gen_ansi_ascii,
+      unpackp_ansi_ascii,   packp_ansi_ascii },
+    { NULL, PK_NFORMATS, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+static double mintime = 0.1;
+static unsigned int groups = G_KERNEL | G_ASCII | G_IO;
+static size_t sizes[MAXSIZES] = { 14, 80, 512, 2720, 32768, 1048576, MAXRECSIZE };
+static unsigned int nsizes = 7;
+
+/* Synthetic tape for the io group */
+
+static const char *tapedir = NULL;
+static double tapemb = 64.0;
+static uint32_t distmin = 2720, distmax = 2720;
+static uint32_t markevery = 0;
+
+static int verify = 0;
+
+int main( int argc, char **argv ) {
+    int rc = 0;
+
+    --argc;
+    ++argv;
+
+    while( argc && *argv[0] == '-' ) {
+        char *sws = argv[0] +1;
+
+        if( !strcmp( sws, "-help" ) ) {
+            usage();
+            exit(0);
+        }
+        if( !strcmp( sws, "-version" ) ) {
+            PRINT_VERSION( stderr, bench36 );
+            exit(0);
+        }
+
+        while( *sws ) {
+            char *arg = NULL, *endp;
+
+            if( strchr( "dglmrst", sws[0] ) ) { /* Switches with arguments */
+                if( sws[1] ) {
+                    arg = strdup( sws + 1 );
+                    sws[1] = '\0';
+                } else {
+                    if( !argv[1] ) {
+                        fprintf( stderr, "Missing argument for %c\n", sws[0] );
+                        exit(1);
+                    }
+                    arg = argv++[1];
+                    --argc;
+                }
+                switch( sws[0] ) {
+                case 'd':
+                    tapedir = arg;
+                    break;
+                case 'g':
+                    groups = 0;
+                    if( strstr( arg, "kernel" ) )
+                        groups |= G_KERNEL;
+                    if( strstr( arg, "ascii" ) )
+                        groups |= G_ASCII;
+                    if( strstr( arg, "io" ) )
+                        groups |= G_IO;
+                    if( !groups ) {
+                        fprintf( stderr, "Invalid group list %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                case 'l':
+                    tapemb = strtod( arg, &endp );
+                    if( *endp || tapemb <= 0.0 ) {
+                        fprintf( stderr, "Invalid tape length %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                case 'm':
+                    markevery = (uint32_t) strtoul( arg, &endp, 10 );
+                    if( *endp ) {
+                        fprintf( stderr, "Invalid tape mark interval %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                case 'r':
+                    if( parse_dist( arg ) ) {
+                        fprintf( stderr, "Invalid record size distribution %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                case 's':
+                    if( parse_sizes( arg ) ) {
+                        fprintf( stderr, "Invalid size list %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                case 't':
+                    mintime = strtod( arg, &endp );
+                    if( *endp || mintime <= 0.0 ) {
+                        fprintf( stderr, "Invalid time %s\n", arg );
+                        exit(1);
+                    }
+                    break;
+                default:
+                    abort();
+                }
+                break;
+            }
+
+            switch( sws[0] ) {
+            case 'h':
+                usage();
+                exit(0);
+
+            case 'v':
+                verify = 1;
+                break;
+
+            default:
+                fprintf( stderr, "Unknown switch %c\n", sws[0] );
+                exit(1);
+            }
+            sws++;
+        }
+        argc--;
+        argv++;
+    }
+    if( argc ) {
+        usage();
+        exit(1);
+    }
+
+    if( !tapedir ) {
+        tapedir = getenv( "TMPDIR" );
+        if( !tapedir || !*tapedir )
+            tapedir = "/tmp";
+    }
+
+    {
+        wd36_T version = { VERSION_36( VERSION_MAJOR,VERSION_MINOR,VERSION_EDIT,VERSION_CUST ) };
+        char vbuf[VERSION_BUFFER_SIZE];
+
+        printf( "# bench36 %s, vector support %s, minimum time %.3fs\n",
+                decodeversion( &version, vbuf ), simd36_levelname( simd36_level() ), mintime );
+    }
+    if( verify ) {
+        rc = verify_kernels();
+        rc |= verify_index();
+        rc |= verify_reverse();
+        exit( rc );
+    }
+
+    printf( "group,name,impl,size,iterations,seconds,mb_per_s,ns_per_word,ns_per_op\n" );
+
+    if( groups & G_KERNEL )
+        bench_kernels();
+    if( groups & G_ASCII )
+        bench_ascii();
+    if( groups & G_IO )
+        rc = bench_io();
+
+    exit( rc );
+}
+
+static double now( void ) {
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Call fn repeatedly for at least mintime.  The iteration count grows
+ * until a batch takes that long; returns it, and the batch's time.
+ */
+
+static uint64_t run( benchfn_T fn, void *ctx, double *secs ) {
+    uint64_t n = 1, i;
+
+    while( 1 ) {
+        double start, elapsed, scale;
+
+        start = now();
+        for( i = 0; i < n; i++ )
+            fn( ctx );
+        elapsed = now() - start;
+
+        if( elapsed >= mintime ) {
+            *secs = elapsed;
+            return n;
+        }
+        scale = (elapsed > 0.0)? 1.2 * mintime / elapsed: 100.0;
+        if( scale > 100.0 )
+            scale = 100.0;
+        if( scale < 2.0 )
+            scale = 2.0;
+        n = (uint64_t)((double)n * scale);
+    }
+}
+
+static void report( const char *group, const char *name, const char *impl,
+                    size_t size, uint64_t iters, double secs,
+                    double bytes, double words, double ops ) {
+    double per = secs / (double)iters;
+
+    printf( "%s,%s,%s,%zu,%" PRIu64 ",%.6f,%.2f,%.3f,%.1f\n",
+            group, name, impl, size, iters, secs,
+            (bytes / per) / 1e6,
+            (words > 0.0)? (per * 1e9) / words: 0.0,
+            (per * 1e9) / ops );
+    fflush( stdout );
+
+    return;
+}
+
+static void fill_random( uint8_t *buf, size_t len ) {
+    static uint64_t state = UINT64_C(0x9E3779B97F4A7C15);
+
+    while( len-- ) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        *buf++ = (uint8_t)state;
+    }
+    return;
+}
+
+/* Packing kernels */
+
+typedef struct {
+    unpackfn_T unpack;
+    packfn_T pack;
+    punpackfn_T punpack;
+    ppackfn_T ppack;
+    transcodefn_T xcode;
+    const uint8_t *in;
+    size_t insize;
+    wd36_T *words;
+    pwd36_T *pwords;
+    size_t wc, maxwc;
+    uint8_t *out;
+    size_t outsize;
+} kctx_T;
+
+static void run_unpack( void *ctx ) {
+    kctx_T *k = ctx;
+
+    (void) k->unpack( k->in, k->insize, k->words, k->maxwc );
+}
+
+static void run_pack( void *ctx ) {
+    kctx_T *k = ctx;
+
+    (void) k->pack( k->words, k->wc, k->out, k->outsize );
+}
+
+static void run_punpack( void *ctx ) {
+    kctx_T *k = ctx;
+
+    (void) k->punpack( k->in, k->insize, k->pwords, k->maxwc );
+}
+
+static void run_ppack( void *ctx ) {
+    kctx_T *k = ctx;
+
+    (void) k->ppack( k->pwords, k->wc, k->out, k->outsize );
+}
+
+static void run_xcode( void *ctx ) {
+    kctx_T *k = ctx;
+
+    (void) k->xcode( k->in, k->insize, k->out, k->outsize );
+}
+
+static void bench_pair( kctx_T *k, const char *mode, const char *impl ) {
+    char name[64];
+    uint64_t n;
+    double secs;
+
+    snprintf( name, sizeof( name ), "unpack_%s", mode );
+    n = run( run_unpack, k, &secs );
+    report( "kernel", name, impl, k->insize, n, secs,
+            (double)k->insize, (double)k->wc, 1.0 );
+    snprintf( name, sizeof( name ), "pack_%s", mode );
+    n = run( run_pack, k, &secs );
+    report( "kernel", name, impl, k->insize, n, secs,
+            (double)k->insize, (double)k->wc, 1.0 );
+
+    return;
+}
+
+static void bench_kernels( void ) {
+    size_t maxsize = 0, unit;
+    uint8_t *in, *out;
+    wd36_T *words;
+    pwd36_T *pwords;
+    struct benchmode *mp, *tp;
+    unsigned int s;
+    kctx_T k;
+
+    for( s = 0; s < nsizes; s++ ) {
+        if( sizes[s] > maxsize )
+            maxsize = sizes[s];
+    }
+    k.maxwc = (maxsize / 4) + 2;
+    k.outsize = 2 * maxsize + 64;
+
+    in = malloc( maxsize + 64 );
+    out = malloc( k.outsize );
+    words = malloc( k.maxwc * sizeof( *words ) );
+    pwords = malloc( k.maxwc * sizeof( *pwords ) );
+    if( !(in && out && words && pwords) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    k.words = words;
+    k.pwords = pwords;
+    k.out = out;
+
+    for( mp = modes; mp->name; mp++ ) {
+        unit = pack_unit( mp->format );
+
+        for( s = 0; s < nsizes; s++ ) {
+            simd36_level_T level;
+            unpackfn_T lastunpack = NULL;
+            packfn_T lastpack = NULL;
+            char name[64];
+            uint64_t n;
+            double secs;
+
+            /* A valid record of about the requested size, with the unused
+             * bits of each frame as packing would leave them.
+             */
+
+            k.insize = sizes[s] - (sizes[s] % unit);
+            if( k.insize == 0 )
+                k.insize = unit;
+            fill_random( in, k.insize );
+            k.wc = mp->unpack( in, k.insize, words, k.maxwc );
+            (void) mp->pack( words, k.wc, in, maxsize + 64 );
+            k.in = in;
+
+            k.unpack = mp->unpack;
+            k.pack = mp->pack;
+            bench_pair( &k, mp->name, "reference" );
+
+            for( level = SIMD36_NONE; level <= simd36_level(); level++ ) {
+                const char *impl = (level == SIMD36_NONE)? "scalar": simd36_levelname( level );
+
+                k.unpack = simd36_unpack_level( mp->gunpack, level );
+                k.pack = simd36_pack_level( mp->gpack, level );
+                if( k.unpack != lastunpack || k.pack != lastpack )
+                    bench_pair( &k, mp->name, impl );
+                lastunpack = k.unpack;
+                lastpack = k.pack;
+            }
+
+            k.punpack = mp->punpack;
+            k.ppack = mp->ppack;
+            (void) k.punpack( k.in, k.insize, pwords, k.maxwc );
+            snprintf( name, sizeof( name ), "unpack_%s", mp->name );
+            n = run( run_punpack, &k, &secs );
+            report( "kernel", name, "packed", k.insize, n, secs,
+                    (double)k.insize, (double)k.wc, 1.0 );
+            snprintf( name, sizeof( name ), "pack_%s", mp->name );
+            n = run( run_ppack, &k, &secs );
+            report( "kernel", name, "packed", k.insize, n, secs,
+                    (double)k.insize, (double)k.wc, 1.0 );
+
+            for( tp = modes; tp->name; tp++ ) {
+                transcodefn_T lastx = NULL;
+
+                if( tp == mp )
+                    continue;
+                snprintf( name, sizeof( name ), "transcode_%s_to_%s", mp->name, tp->name );
+                for( level = SIMD36_NONE; level <= simd36_level(); level++ ) {
+                    k.xcode = simd36_transcode_level( mp->format, tp->format, level );
+                    if( k.xcode == lastx )
+                        continue;
+                    n = run( run_xcode, &k, &secs );
+                    report( "kernel", name,
+                            (level == SIMD36_NONE)? "scalar": simd36_levelname( level ),
+                            k.insize, n, secs, (double)k.insize, (double)k.wc, 1.0 );
+                    lastx = k.xcode;
+                }
+            }
+        }
+    }
+
+    free( pwords );
+    free( words );
+    free( out );
+    free( in );
+
+    return;
+}
+
+/* Generated kernels against the hand-written ones.
+ *
+ * Records of every size up to VERIFY_UNITS units, and a few larger, are
+ * unpacked from random frames and packed from random words by both.
+ * The generated unpack must also honor maxwc and reject partial units.
+ */
+
+#define VERIFY_UNITS 70
+
+static const size_t verify_big[] = { 1000, 4099 };
+
+static int verify_kernels( void ) {
+    size_t maxunits = verify_big[(sizeof( verify_big ) / sizeof( verify_big[0] )) - 1];
+    size_t maxwc = 2 * maxunits + 2, outsize = 9 * maxunits + 64;
+    uint8_t *in, *rout, *gout;
+    wd36_T *rwords, *gwords, *words;
+    struct benchmode *mp;
+    unsigned int checked = 0, failed = 0;
+
+    in = malloc( outsize );
+    rout = malloc( outsize );
+    gout = malloc( outsize );
+    rwords = malloc( maxwc * sizeof( *rwords ) );
+    gwords = malloc( maxwc * sizeof( *gwords ) );
+    words = malloc( maxwc * sizeof( *words ) );
+    if( !(in && rout && gout && rwords && gwords && words) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+
+    for( mp = modes; mp->name; mp++ ) {
+        size_t unit = pack_unit( mp->format ), wpu, i, units;
+
+        fill_random( in, unit );
+        wpu = mp->unpack( in, unit, rwords, maxwc );
+
+        for( i = 0; i <= VERIFY_UNITS + sizeof( verify_big ) / sizeof( verify_big[0] ); i++ ) {
+            simd36_level_T level;
+            unpackfn_T lastunpack = NULL;
+            packfn_T lastpack = NULL;
+            size_t insize, rwc, gwc, wc, rbc, gbc, w;
+
+            units = (i <= VERIFY_UNITS)? i: verify_big[i - VERIFY_UNITS - 1];
+            insize = units * unit;
+            fill_random( in, insize );
+            rwc = mp->unpack( in, insize, rwords, maxwc );
+
+            /* An odd word count leaves half a high-density unit */
+
+            wc = units * wpu - (wpu > 1 && (units & 1));
+            for( w = 0; w < wc; w++ ) {
+                fill_random( (uint8_t *)&words[w], sizeof( words[w] ) );
+                words[w].lh &= BITS18;
+                words[w].rh &= BITS18;
+            }
+            rbc = mp->pack( words, wc, rout, outsize );
+
+            for( level = SIMD36_NONE; level <= simd36_level(); level++ ) {
+                const char *impl = (level == SIMD36_NONE)? "scalar": simd36_levelname( level );
+                unpackfn_T unpack = simd36_unpack_level( mp->gunpack, level );
+                packfn_T pack = simd36_pack_level( mp->gpack, level );
+
+                if( unpack != lastunpack ) {
+                    checked++;
+                    gwc = unpack( in, insize, gwords, maxwc );
+                    if( gwc != rwc || memcmp( gwords, rwords, rwc * sizeof( *gwords ) ) ) {
+                        fprintf( stderr, "unpack_%s %s: %lu frames differ\n",
+                                 mp->name, impl, (unsigned long)insize );
+                        failed++;
+                    }
+                    if( rwc != 0 &&
+                        ((gwc = unpack( in, insize, gwords, rwc - 1 )) != rwc - 1 ||
+                         memcmp( gwords, rwords, gwc * sizeof( *gwords ) )) ) {
+                        fprintf( stderr, "unpack_%s %s: %lu frames to %lu words differ\n",
+                                 mp->name, impl, (unsigned long)insize, (unsigned long)(rwc - 1) );
+                        failed++;
+                    }
+                    if( unit > 1 && unpack( in, insize + 1, gwords, maxwc ) != (size_t)-1 ) {
+                        fprintf( stderr, "unpack_%s %s: %lu frames accepted\n",
+                                 mp->name, impl, (unsigned long)(insize + 1) );
+                        failed++;
+                    }
+                    lastunpack = unpack;
+                }
+                if( pack != lastpack ) {
+                    checked++;
+                    memset( gout, 0xAA, rbc + 64 );
+                    gbc = pack( words, wc, gout, rbc );
+                    if( gbc != rbc || memcmp( gout, rout, rbc ) || gout[rbc] != 0xAA ) {
+                        fprintf( stderr, "pack_%s %s: %lu words differ\n",
+                                 mp->name, impl, (unsigned long)wc );
+                        failed++;
+                    }
+                    lastpack = pack;
+                }
+            }
+        }
+    }
+
+    printf( "# verify: %u kernel checks, %u failed\n", checked, failed );
+
+    free( words );
+    free( gwords );
+    free( rwords );
+    free( gout );
+    free( rout );
+    free( in );
+
+    return failed != 0;
+}
+
+/* Tape positioning.
+ *
+ * A synthetic tape is read forward once for a reference: each record's
+ * or tape mark's status, length and identity, with the position before
+ * and after it.  Each check then positions another open of the tape and
+ * compares what it reads there, and the positions, with the reference.
+ * A record's first 8 frames hold its number on the tape and the tape's
+ * salt (never 0), which identify it.
+ */
+
+typedef struct {
+    unsigned int status;
+    uint32_t length;
+    uint64_t id;                /* Salt and record number, or 0 */
+    uint32_t file, record;      /* Position before (see vtape_reference) */
+    uint32_t afile, arecord;    /* and after */
+    double apos;                /* Reel position after */
+} vitem_T;
+
+typedef struct {
+    char *path;
+    uint32_t salt;
+    vitem_T *items;
+    size_t nitems;
+    double bot;                 /* Reel position at the start */
+    unsigned int checked, failed;
+} vtape_T;
+
+#define VTAPE_REEL    "2400ft"
+#define VTAPE_DENSITY "1600"
+#define VTAPE_MAXREC  4096
+
+static uint32_t get_le32( const uint8_t *p ) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+        ((uint32_t)p[3] << 24);
+}
+
+static void put_le32( uint8_t *p, uint32_t v ) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+
+    return;
+}
+
+/* Write files[0..nfiles) records per file, each file followed by a tape
+ * mark.  Every fifth record has the data error flag.
+ */
+
+static int vtape_write( vtape_T *vt, const uint32_t *files, size_t nfiles ) {
+    uint8_t data[VTAPE_MAXREC];
+    MAGTAPE *mta;
+    uint32_t id = 0, r;
+    size_t f;
+    int rc = 0;
+
+    fill_random( data, sizeof( data ) );
+    mta = magtape_open( vt->path, "w" );
+    if( mta == NULL )
+        return 1;
+    for( f = 0; f < nfiles && !rc; f++ ) {
+        for( r = 0; r < files[f] && !rc; r++, id++ ) {
+            size_t len = 14 + (id * 397 + vt->salt) % (sizeof( data ) - 14);
+
+            put_le32( data, id );
+            put_le32( data + 4, vt->salt );
+            rc = magtape_write( mta, data, (id % 5 == 4)? MTA_DATA_ERROR( len ): len ) == MTA_IOE;
+        }
+        rc |= magtape_mark( mta, MTA_EOF_MARK ) == MTA_IOE;
+    }
+    magtape_close( &mta );
+
+    return rc;
+}
+
+/* Read an item and describe it.  Returns its status. */
+
+static unsigned int vtape_item( MAGTAPE *mta, vitem_T *it ) {
+    const uint8_t *data;
+
+    it->file = mta->filenum;
+    it->record = mta->blocknum;
+    it->status = magtape_read_view( mta, &data, &it->length );
+    it->id = 0;
+    if( (it->status == MTA_OK || it->status == MTA_ERR) && it->length >= 8 )
+        it->id = ((uint64_t)get_le32( data + 4 ) << 32) | get_le32( data );
+    it->afile = mta->filenum;
+    it->arecord = mta->blocknum;
+    it->apos = mta->reelpos;
+
+    return it->status;
+}
+
+/* The position before an item is where magtape_seek should put it;
+ * reading forward, blocknum is only reset by the record after a mark.
+ */
+
+static int vtape_reference( vtape_T *vt ) {
+    size_t size = 0;
+    uint32_t file = 0, record = 0;
+    MAGTAPE *mta;
+    vitem_T it;
+
+    vt->nitems = 0;
+    mta = magtape_open( vt->path, "r" );
+    if( mta == NULL )
+        return 1;
+    (void) magtape_setsize( mta, VTAPE_REEL, VTAPE_DENSITY );
+    vt->bot = mta->reelpos;
+    while( vtape_item( mta, &it ) != MTA_EOM ) {
+        if( it.status == MTA_IOE || it.status == MTA_FMT ) {
+            magtape_close( &mta );
+            return 1;
+        }
+        if( (vt->nitems + 1) * sizeof( it ) > size ) {
+            vitem_T *n;
+
+            size = 2 * size + 64 * sizeof( it );
+            n = realloc( vt->items, size );
+            if( n == NULL ) {
+                magtape_close( &mta );
+                return 1;
+            }
+            vt->items = n;
+        }
+        it.file = file;
+        it.record = record++;
+        if( it.status == MTA_TM || it.status == MTA_EOF ) {
+            file++;
+            record = 0;
+        }
+        vt->items[vt->nitems++] = it;
+    }
+    magtape_close( &mta );
+
+    return 0;
+}
+
+/* The position before got is only compared if it was sought */
+
+static void vtape_compare( vtape_T *vt, const char *what, const vitem_T *ref,
+                           const vitem_T *got, int sought ) {
+    vt->checked++;
+    if( got->status != ref->status || got->length != ref->length || got->id != ref->id ||
+        (sought && (got->file != ref->file || got->record != ref->record)) ||
+        got->afile != ref->afile || got->arecord != ref->arecord ) {
+        fprintf( stderr, "%s: at file %" PRIu32 ", record %" PRIu32 " read status %u, "
+                 "length %" PRIu32 ", id %" PRIx64 ", file %" PRIu32 ", record %" PRIu32
+                 " to %" PRIu32 ", %" PRIu32 "; expected %u, %" PRIu32 ", %" PRIx64 ", %"
+                 PRIu32 ", %" PRIu32 " to %" PRIu32 ", %" PRIu32 "\n", what,
+                 ref->file, ref->record, got->status, got->length, got->id, got->file,
+                 got->record, got->afile, got->arecord, ref->status, ref->length, ref->id,
+                 ref->file, ref->record, ref->afile, ref->arecord );
+        vt->failed++;
+    }
+    return;
+}
+
+/* Seek to every item, in a scattered order, and read it and the next.
+ * Then seek beyond the last record of the first file, and of the tape.
+ */
+
+static void vtape_seeks( vtape_T *vt, const char *what, int scan ) {
+    MAGTAPE *mta;
+    size_t i, n = vt->nitems;
+    vitem_T it;
+
+    mta = magtape_open( vt->path, "r" );
+    if( mta == NULL ) {
+        fprintf( stderr, "%s: %s: %s\n", what, vt->path, strerror( errno ) );
+        vt->failed++;
+        return;
+    }
+    if( scan && magtape_index( mta, 1 ) != 0 ) {
+        fprintf( stderr, "%s: magtape_index failed\n", what );
+        vt->failed++;
+    }
+    for( i = 0; i < n; i++ ) {
+        const vitem_T *ref = vt->items + (i * 7919) % n;
+        unsigned int status;
+
+        status = magtape_seek( mta, ref->file, ref->record );
+        if( status != MTA_OK ) {
+            fprintf( stderr, "%s: magtape_seek( %" PRIu32 ", %" PRIu32 " ) returned %u\n",
+                     what, ref->file, ref->record, status );
+            vt->checked++;
+            vt->failed++;
+            continue;
+        }
+        vtape_item( mta, &it );
+        vtape_compare( vt, what, ref, &it, 1 );
+        if( ref + 1 < vt->items + n ) {
+            vtape_item( mta, &it );
+            vtape_compare( vt, what, ref + 1, &it, 0 );
+        }
+    }
+
+    vt->checked += 2;
+    for( i = 0; i < n && vt->items[i].file == 0; i++ )
+        ;
+    if( magtape_seek( mta, 0, (uint32_t)i + 1 ) != MTA_EOM ) {
+        fprintf( stderr, "%s: magtape_seek past the end of file 0 didn't fail\n", what );
+        vt->failed++;
+    }
+    if( magtape_seek( mta, vt->items[n - 1].afile + 1, 0 ) != MTA_EOM ) {
+        fprintf( stderr, "%s: magtape_seek past the end of the tape didn't fail\n", what );
+        vt->failed++;
+    }
+    magtape_close( &mta );
+
+    return;
+}
+
+static int verify_index( void ) {
+    static const uint32_t first[] = { 3, 0, 7, 1, 12, 40 };
+    static const uint32_t second[] = { 70, 2, 30 };
+    vtape_T vt;
+    char *idxname;
+    size_t pathlen;
+    struct stat st;
+    int rc = 0;
+
+    memset( &vt, 0, sizeof( vt ) );
+    pathlen = strlen( tapedir ) + sizeof( "/bench36-v.tap.idx" ) + 20;
+    vt.path = malloc( pathlen );
+    idxname = malloc( pathlen );
+    if( vt.path == NULL || idxname == NULL ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    snprintf( vt.path, pathlen, "%s/bench36-v%ld.tap", tapedir, (long)getpid() );
+    snprintf( idxname, pathlen, "%s.idx", vt.path );
+    (void) unlink( idxname );
+
+    vt.salt = 1;
+    if( vtape_write( &vt, first, sizeof( first ) / sizeof( first[0] ) ) ||
+        vtape_reference( &vt ) ) {
+        fprintf( stderr, "%s: %s\n", vt.path, strerror( errno ) );
+        rc = 1;
+        goto done;
+    }
+
+    /* Built while seeking, then loaded from the sidecar written at close */
+
+    vtape_seeks( &vt, "no index", 0 );
+    vt.checked++;
+    if( stat( idxname, &st ) != 0 ) {
+        fprintf( stderr, "%s: not written: %s\n", idxname, strerror( errno ) );
+        vt.failed++;
+    }
+    vtape_seeks( &vt, "index", 0 );
+    vtape_seeks( &vt, "scanned index", 1 );
+
+    /* A truncated sidecar must be rebuilt */
+
+    if( truncate( idxname, st.st_size / 2 ) != 0 ) {
+        fprintf( stderr, "%s: %s\n", idxname, strerror( errno ) );
+        vt.failed++;
+    }
+    vtape_seeks( &vt, "truncated index", 0 );
+
+    /* A stale sidecar - the image has been rewritten since - too.  The
+     * new image is larger, so only its size and time give the old
+     * entries away.
+     */
+
+    vt.salt = 2;
+    if( vtape_write( &vt, second, sizeof( second ) / sizeof( second[0] ) ) ||
+        vtape_reference( &vt ) ) {
+        fprintf( stderr, "%s: %s\n", vt.path, strerror( errno ) );
+        rc = 1;
+        goto done;
+    }
+    vtape_seeks( &vt, "stale index", 0 );
+
+    printf( "# verify: %u index checks, %u failed\n", vt.checked, vt.failed );
+    rc = vt.failed != 0;
+
+ done:
+    (void) unlink( vt.path );
+    (void) unlink( idxname );
+    free( vt.items );
+    free( idxname );
+    free( vt.path );
+
+    return rc;
+}
+
+/* Reverse motion.  A reverse read is checked against the reference, and
+ * the position it leaves against the one before the item read forward.
+ */
+
+static void vtape_reverse( vtape_T *vt, const char *what, MAGTAPE *mta, size_t i,
+                           unsigned int status, uint32_t length, const uint8_t *data ) {
+    const vitem_T *ref = vt->items + i;
+    unsigned int expect = (ref->status == MTA_EOF)? MTA_TM: ref->status;
+    double pos = i? vt->items[i-1].apos: vt->bot;
+    uint64_t id = 0;
+    int nopos = (mta->status & MTS_NOPOS) != 0;
+
+    if( data && (status == MTA_OK || status == MTA_ERR) && length >= 8 )
+        id = ((uint64_t)get_le32( data + 4 ) << 32) | get_le32( data );
+    vt->checked++;
+    if( status != expect || length != ref->length || (data && id != ref->id) ||
+        (!nopos && (mta->filenum != ref->file || mta->blocknum != ref->record)) ||
+        mta->reelpos < pos - 0.001 || mta->reelpos > pos + 0.001 ) {
+        fprintf( stderr, "%s: before file %" PRIu32 ", record %" PRIu32 " (%.3fin) read "
+                 "status %u, length %" PRIu32 ", id %" PRIx64 " to file %" PRIu32
+                 ", record %" PRIu32 "%s (%.3fin); expected %u, %" PRIu32 ", %" PRIx64 "\n",
+                 what, ref->file, ref->record, pos, status, length, id,
+                 mta->filenum, mta->blocknum, (nopos? " (unknown)": ""), mta->reelpos,
+                 expect, ref->length, ref->id );
+        vt->failed++;
+    }
+    return;
+}
+
+/* Read the tape backwards from magtape_eom.  With an index, positions
+ * are known, and each item is also read forward again and backspaced
+ * over, which must agree.  Without one, they must be marked unknown.
+ */
+
+static void vtape_backwards( vtape_T *vt, const char *what, int indexed ) {
+    static uint8_t data[VTAPE_MAXREC];
+    const vitem_T *last = vt->items + vt->nitems - 1;
+    MAGTAPE *mta;
+    unsigned int status;
+    uint32_t length, endfile, endrecord;
+    size_t i;
+    vitem_T it;
+
+    /* The end, as magtape_seek would put it */
+
+    endfile = last->file + (last->id == 0);
+    endrecord = (last->id == 0)? 0: last->record + 1;
+
+    mta = magtape_open( vt->path, "r" );
+    if( mta == NULL ) {
+        fprintf( stderr, "%s: %s: %s\n", what, vt->path, strerror( errno ) );
+        vt->failed++;
+        return;
+    }
+    (void) magtape_setsize( mta, VTAPE_REEL, VTAPE_DENSITY );
+    if( indexed && magtape_index( mta, 1 ) != 0 ) {
+        fprintf( stderr, "%s: magtape_index failed\n", what );
+        vt->failed++;
+    }
+
+    vt->checked++;
+    status = magtape_eom( mta );
+    if( status != MTA_OK ||
+        (indexed && ((mta->status & MTS_NOPOS) ||
+                     mta->filenum != endfile || mta->blocknum != endrecord)) ||
+        (!indexed && !(mta->status & MTS_NOPOS)) ) {
+        fprintf( stderr, "%s: magtape_eom returned %u at file %" PRIu32 ", record %" PRIu32
+                 "%s\n", what, status, mta->filenum, mta->blocknum,
+                 (mta->status & MTS_NOPOS)? " (unknown)": "" );
+        vt->failed++;
+        magtape_close( &mta );
+        return;
+    }
+    mta->reelpos = last->apos;  /* Without reading, it can't be known */
+
+    for( i = vt->nitems; i-- > 0; ) {
+        status = magtape_read_reverse( mta, data, sizeof( data ), &length );
+        vtape_reverse( vt, what, mta, i, status, length, data );
+        if( !indexed )
+            continue;
+
+        vtape_item( mta, &it );
+        vtape_compare( vt, what, vt->items + i, &it, 1 );
+        status = magtape_backspace_record( mta, &length );
+        vtape_reverse( vt, what, mta, i, status, length, NULL );
+    }
+
+    vt->checked++;
+    status = magtape_read_reverse( mta, data, sizeof( data ), &length );
+    if( status != MTA_BOT ) {
+        fprintf( stderr, "%s: reading backwards at the start returned %u\n", what, status );
+        vt->failed++;
+    }
+    magtape_close( &mta );
+
+    return;
+}
+
+/* Backspace file by file from the end, as when looking for the last
+ * saveset.  Each must pass the reference's records, and stop before its
+ * tape mark, or at BOT.
+ */
+
+static void vtape_backfiles( vtape_T *vt, const char *what ) {
+    MAGTAPE *mta;
+    unsigned int status, expect;
+    uint32_t records, count;
+    size_t i = vt->nitems;
+
+    mta = magtape_open( vt->path, "r" );
+    if( mta == NULL ) {
+        fprintf( stderr, "%s: %s: %s\n", what, vt->path, strerror( errno ) );
+        vt->failed++;
+        return;
+    }
+    if( magtape_index( mta, 1 ) != 0 || magtape_eom( mta ) != MTA_OK ) {
+        fprintf( stderr, "%s: can't position at the end\n", what );
+        vt->failed++;
+        magtape_close( &mta );
+        return;
+    }
+    do {
+        for( count = 0; i > 0 && vt->items[i-1].id != 0; i-- )
+            count++;
+        expect = i? MTA_TM: MTA_BOT;
+        status = magtape_backspace_file( mta, &records );
+        vt->checked++;
+        if( status != expect || records != count ||
+            (i && (mta->filenum != vt->items[i-1].file ||
+                   mta->blocknum != vt->items[i-1].record)) ) {
+            fprintf( stderr, "%s: backspacing a file returned %u after %" PRIu32 " records, "
+                     "at file %" PRIu32 ", record %" PRIu32 "; expected %u after %" PRIu32 "\n",
+                     what, status, records, mta->filenum, mta->blocknum, expect, count );
+            vt->failed++;
+            break;
+        }
+    } while( i-- > 0 );
+    magtape_close( &mta );
+
+    return;
+}
+
+static int verify_reverse( void ) {
+    static const uint32_t files[] = { 4, 0, 0, 9, 1, 25 };
+    vtape_T vt;
+    char *idxname;
+    size_t pathlen;
+    int rc = 0;
+
+    memset( &vt, 0, sizeof( vt ) );
+    pathlen = strlen( tapedir ) + sizeof( "/bench36-r.tap.idx" ) + 20;
+    vt.path = malloc( pathlen );
+    idxname = malloc( pathlen );
+    if( vt.path == NULL || idxname == NULL ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    snprintf( vt.path, pathlen, "%s/bench36-r%ld.tap", tapedir, (long)getpid() );
+    snprintf( idxname, pathlen, "%s.idx", vt.path );
+    (void) unlink( idxname );
+
+    vt.salt = 3;
+    if( vtape_write( &vt, files, sizeof( files ) / sizeof( files[0] ) ) ||
+        vtape_reference( &vt ) ) {
+        fprintf( stderr, "%s: %s\n", vt.path, strerror( errno ) );
+        rc = 1;
+        goto done;
+    }
+
+    vtape_backwards( &vt, "reverse", 0 );
+    vtape_backwards( &vt, "indexed reverse", 1 );
+    vtape_backfiles( &vt, "backspace file" );
+
+    printf( "# verify: %u reverse checks, %u failed\n", vt.checked, vt.failed );
+    rc = vt.failed != 0;
+
+ done:
+    (void) unlink( vt.path );
+    (void) unlink( idxname );
+    free( vt.items );
+    free( idxname );
+    free( vt.path );
+
+    return rc;
+}
+
+/* ASCII conversions */
+
+#define ASCII_WORDS 4096
+
+typedef struct {
+    wd36_T *words;
+    pwd36_T *pwords;
+    size_t wc;
+    char *text;
+    uint8_t *buf;
+    textfn_T decode;            /* Bulk text extraction */
+    encodefn_T encode;          /* Bulk text encoding */
+    size_t textlen;
+    int flags;
+} actx_T;
+
+static void run_decode7( void *ctx ) {
+    actx_T *a = ctx;
+    uint8_t *bp = a->buf;
+    size_t i;
+
+    for( i = 0; i < a->wc; i++ )
+        bp = decode7ascii( a->words + i, bp );
+}
+
+static void run_decode8( void *ctx ) {
+    actx_T *a = ctx;
+    uint8_t *bp = a->buf;
+    size_t i;
+
+    for( i = 0; i < a->wc; i++ )
+        bp = decode8ascii( a->words + i, bp );
+}
+
+static void run_decode_n( void *ctx ) {
+    actx_T *a = ctx;
+
+    (void) a->decode( a->words, a->wc, a->buf, a->flags );
+}
+
+static void run_decode7p( void *ctx ) {
+    actx_T *a = ctx;
+    uint8_t *bp = a->buf;
+    size_t i;
+
+    for( i = 0; i < a->wc; i++ )
+        bp = decode7asciip( a->pwords + i, bp );
+}
+
+static void run_encode7( void *ctx ) {
+    actx_T *a = ctx;
+
+    (void) encode7ascii( a->text, a->words, a->wc );
+}
+
+static void run_encode8( void *ctx ) {
+    actx_T *a = ctx;
+
+    a->text[a->wc * 4] = '\0';
+    (void) encode8ascii( a->text, a->words, a->wc );
+    a->text[a->wc * 4] = 'x';
+}
+
+static void run_encode_n( void *ctx ) {
+    actx_T *a = ctx;
+
+    (void) a->encode( (const uint8_t *)a->text, a->textlen, a->words, a->wc );
+}
+
+static void run_encode7p( void *ctx ) {
+    actx_T *a = ctx;
+
+    (void) encode7asciip( a->text, a->pwords, a->wc );
+}
+
+static void run_decodeasciz( void *ctx ) {
+    actx_T *a = ctx;
+
+    free( decodeasciz( a->words ) );
+}
+
+static void bench_ascii( void ) {
+    actx_T a;
+    simd36_level_T level;
+    uint64_t n;
+    double secs;
+    size_t i, len;
+
+    a.wc = ASCII_WORDS;
+    len = a.wc * 5;
+
+    a.words = malloc( (a.wc + 1) * sizeof( *a.words ) );
+    a.pwords = malloc( (a.wc + 1) * sizeof( *a.pwords ) );
+    a.text = malloc( len + 1 );
+    a.buf = malloc( len + 8 );
+    if( !(a.words && a.pwords && a.text && a.buf) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    fill_random( (uint8_t *)a.text, len );
+    for( i = 0; i < len; i++ )
+        a.text[i] = ' ' + ((uint8_t)a.text[i] % 95);
+    for( i = 72; i + 1 < len; i += 74 ) {
+        a.text[i] = '\r';
+        a.text[i + 1] = '\n';
+    }
+    a.text[len] = '\0';
+
+    n = run( run_encode7, &a, &secs );
+    report( "ascii", "encode7ascii", "scalar", a.wc, n, secs, (double)len, (double)a.wc, 1.0 );
+    n = run( run_encode7p, &a, &secs );
+    report( "ascii", "encode7ascii", "packed", a.wc, n, secs, (double)len, (double)a.wc, 1.0 );
+    n = run( run_encode8, &a, &secs );
+    report( "ascii", "encode8ascii", "scalar", a.wc, n, secs, (double)a.wc * 4, (double)a.wc, 1.0 );
+
+    for( i = 0; i < 2; i++ ) {
+        encodefn_T fn = i? encode8ascii_n: encode7ascii_n, last = NULL;
+
+        a.textlen = a.wc * (i? 4: 5);
+        for( level = SIMD36_NONE; level <= simd36_level(); level++ ) {
+            a.encode = simd36_encode_level( fn, level );
+            if( a.encode == last )
+                continue;
+            n = run( run_encode_n, &a, &secs );
+            report( "ascii", i? "encode8ascii_n": "encode7ascii_n",
+                    (level == SIMD36_NONE)? "scalar": simd36_levelname( level ),
+                    a.wc, n, secs, (double)a.textlen, (double)a.wc, 1.0 );
+            last = a.encode;
+        }
+    }
+
+    (void) encode7ascii( a.text, a.words, a.wc );
+    (void) encode7asciip( a.text, a.pwords, a.wc );
+    n = run( run_decode7, &a, &secs );
+    report( "ascii", "decode7ascii", "scalar", a.wc, n, secs, (double)len, (double)a.wc, 1.0 );
+    n = run( run_decode7p, &a, &secs );
+    report( "ascii", "decode7ascii", "packed", a.wc, n, secs, (double)len, (double)a.wc, 1.0 );
+    n = run( run_decode8, &a, &secs );
+    report( "ascii", "decode8ascii", "scalar", a.wc, n, secs, (double)a.wc * 4, (double)a.wc, 1.0 );
+
+    /* Bulk extraction, as is and as Unix text */
+
+    for( i = 0; i < 4; i++ ) {
+        textfn_T fn = (i & 1)? decode8ascii_n: decode7ascii_n, last = NULL;
+        char name[sizeof( "decode7ascii_n/lf" )];
+
+        a.flags = (i & 2)? TEXT_STRIPNUL | TEXT_CRLF: 0;
+        snprintf( name, sizeof( name ), "decode%cascii_n%s", (i & 1)? '8': '7',
+                  a.flags? "/lf": "" );
+        for( level = SIMD36_NONE; level <= simd36_level(); level++ ) {
+            a.decode = simd36_text_level( fn, level );
+            if( a.decode == last )
+                continue;
+            n = run( run_decode_n, &a, &secs );
+            report( "ascii", name, (level == SIMD36_NONE)? "scalar": simd36_levelname( level ),
+                    a.wc, n, secs, (double)a.wc * ((i & 1)? 4: 5), (double)a.wc, 1.0 );
+            last = a.decode;
+        }
+    }
+
+    /* decodeasciz: a count word followed by the text */
+
+    memmove( a.words + 1, a.words, a.wc * sizeof( *a.words ) );
+    XWD36( a.words, 0, a.wc );
+    n = run( run_decodeasciz, &a, &secs );
+    report( "ascii", "decodeasciz", "scalar", a.wc, n, secs, (double)len, (double)a.wc, 1.0 );
+
+    free( a.buf );
+    free( a.text );
+    free( a.pwords );
+    free( a.words );
+
+    return;
+}
+
+/* Tape I/O */
+
+typedef struct {
+    char *path;
+    uint8_t *data;
+    uint32_t *recsizes;
+    uint32_t nrecs;
+    uint64_t bytes;
+    unsigned int status;
+} ioctx_T;
+
+static void run_write( void *ctx ) {
+    ioctx_T *t = ctx;
+    MAGTAPE *mta;
+    uint32_t i;
+
+    mta = magtape_open( t->path, "w" );
+    if( mta == NULL ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    for( i = 0; i < t->nrecs; i++ ) {
+        if( magtape_write( mta, t->data, t->recsizes[i] ) == MTA_IOE ) {
+            t->status = MTA_IOE;
+            break;
+        }
+        if( markevery && (i + 1) % markevery == 0 )
+            (void) magtape_mark( mta, MTA_EOF_MARK );
+    }
+    (void) magtape_mark( mta, MTA_EOF_MARK );
+    magtape_close( &mta );
+}
+
+/* The buffer starts small and grows when a record doesn't fit, as
+ * tape36's do.
+ */
+
+static void run_read( void *ctx ) {
+    static buf36_T buffer = BUF36_INIT;
+    ioctx_T *t = ctx;
+    MAGTAPE *mta;
+    uint32_t recsize;
+    unsigned int status;
+
+    if( buf36_reserve( &buffer, 1 ) != 0 ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    mta = magtape_open( t->path, "r" );
+    if( mta == NULL ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    while( (status = magtape_read( mta, buffer.data, buffer.size, &recsize )) != MTA_EOM ) {
+        if( status == MTA_BTL && buf36_reserve( &buffer, recsize ) != 0 )
+            status = MTA_IOE;
+        if( status == MTA_IOE || status == MTA_FMT ) {
+            t->status = status;
+            break;
+        }
+    }
+    magtape_close( &mta );
+}
+
+static void run_read_batch( void *ctx ) {
+    static buf36_T arena = BUF36_INIT;
+    static mta_recdesc desc[256];
+    ioctx_T *t = ctx;
+    MAGTAPE *mta;
+    size_t n;
+
+    if( buf36_reserve( &arena, 1024 * 1024 ) != 0 ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    mta = magtape_open( t->path, "r" );
+    if( mta == NULL ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    while( (n = magtape_read_batch( mta, arena.data, arena.size, desc,
+                                    sizeof( desc ) / sizeof( desc[0] ) )) != 0 ) {
+        unsigned int status = desc[n-1].status;
+
+        if( status == MTA_BTL && buf36_reserve( &arena, desc[n-1].length ) != 0 )
+            status = MTA_IOE;
+        if( status == MTA_IOE || status == MTA_FMT ) {
+            t->status = status;
+            break;
+        }
+        if( status == MTA_EOM )
+            break;
+    }
+    magtape_close( &mta );
+}
+
+static void run_read_view( void *ctx ) {
+    ioctx_T *t = ctx;
+    MAGTAPE *mta;
+    const uint8_t *data;
+    uint32_t recsize;
+    unsigned int status;
+
+    mta = magtape_open( t->path, "r" );
+    if( mta == NULL ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    while( (status = magtape_read_view( mta, &data, &recsize )) != MTA_EOM ) {
+        if( status == MTA_IOE || status == MTA_FMT ) {
+            t->status = status;
+            break;
+        }
+    }
+    magtape_close( &mta );
+}
+
+static void run_skip( void *ctx ) {
+    ioctx_T *t = ctx;
+    MAGTAPE *mta;
+    uint32_t recsize;
+    unsigned int status;
+
+    mta = magtape_open( t->path, "r" );
+    if( mta == NULL ) {
+        t->status = MTA_IOE;
+        return;
+    }
+    while( (status = magtape_skip_record( mta, &recsize )) != MTA_EOM ) {
+        if( status == MTA_IOE || status == MTA_FMT ) {
+            t->status = status;
+            break;
+        }
+    }
+    magtape_close( &mta );
+}
+
+static int bench_io( void ) {
+    static const struct {
+        const char *name;
+        benchfn_T fn;
+    } ops[] = {
+        { "magtape_write",       run_write },
+        { "magtape_read",        run_read },
+        { "magtape_read_view",   run_read_view },
+        { "magtape_read_batch",  run_read_batch },
+        { "magtape_skip_record", run_skip },
+        { NULL, NULL }
+    };
+    ioctx_T t;
+    uint64_t target, state = 12345;
+    size_t pathlen;
+    uint32_t maxrecs;
+    int i;
+
+    memset( &t, 0, sizeof( t ) );
+
+    pathlen = strlen( tapedir ) + sizeof( "/bench36-.tap" ) + 20;
+    t.path = malloc( pathlen );
+    t.data = malloc( distmax );
+    target = (uint64_t)(tapemb * 1024.0 * 1024.0);
+    maxrecs = (uint32_t)(target / distmin) + 1;
+    t.recsizes = malloc( maxrecs * sizeof( *t.recsizes ) );
+    if( !(t.path && t.data && t.recsizes) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        return 1;
+    }
+    snprintf( t.path, pathlen, "%s/bench36-%ld.tap", tapedir, (long)getpid() );
+    fill_random( t.data, distmax );
+
+    /* The same sizes are written on every run */
+
+    while( t.bytes < target && t.nrecs < maxrecs ) {
+        uint32_t size = distmin;
+
+        if( distmax > distmin ) {
+            state = state * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+            size += (uint32_t)((state >> 33) % (distmax - distmin + 1));
+        }
+        t.recsizes[t.nrecs++] = size;
+        t.bytes += size;
+    }
+    printf( "# io: %" PRIu32 " records, %" PRIu64 " bytes, sizes %" PRIu32 "-%" PRIu32
+            ", tape mark every %" PRIu32 " records, in %s\n",
+            t.nrecs, t.bytes, distmin, distmax, markevery, tapedir );
+
+    for( i = 0; ops[i].name; i++ ) {
+        uint64_t n;
+        double secs;
+
+        n = run( ops[i].fn, &t, &secs );
+        if( t.status != MTA_OK ) {
+            fprintf( stderr, "%s: %s failed: %s\n", t.path, ops[i].name, strerror( errno ) );
+            break;
+        }
+        report( "io", ops[i].name, "magtape", (size_t)(t.bytes / t.nrecs), n, secs,
+                (double)t.bytes, (double)t.bytes / 5.0, (double)t.nrecs );
+    }
+    (void) unlink( t.path );
+
+    free( t.recsizes );
+    free( t.data );
+    free( t.path );
+
+    return t.status != MTA_OK;
+}
+
+static int parse_sizes( const char *arg ) {
+    const char *p = arg;
+    char *endp;
+
+    nsizes = 0;
+    while( *p ) {
+        unsigned long v;
+
+        if( nsizes == MAXSIZES )
+            return 1;
+        v = strtoul( p, &endp, 10 );
+        if( endp == p || v == 0 || v > MAXRECSIZE )
+            return 1;
+        sizes[nsizes++] = v;
+        p = endp;
+        if( *p == ',' )
+            p++;
+        else if( *p )
+            return 1;
+    }
+    return nsizes == 0;
+}
+
+/* fixed:N or uniform:MIN:MAX */
+
+static int parse_dist( const char *arg ) {
+    unsigned long a, b;
+    char *endp;
+
+    if( !strncmp( arg, "fixed:", 6 ) ) {
+        a = strtoul( arg + 6, &endp, 10 );
+        b = a;
+    } else if( !strncmp( arg, "uniform:", 8 ) ) {
+        a = strtoul( arg + 8, &endp, 10 );
+        if( *endp != ':' )
+            return 1;
+        b = strtoul( endp + 1, &endp, 10 );
+    } else {
+        return 1;
+    }
+    if( *endp || a < 14 || b < a || b > MAXRECSIZE )
+        return 1;
+
+    distmin = (uint32_t)a;
+    distmax = (uint32_t)b;
+    return 0;
+}
+
+static void usage( void ) {
+
+    fprintf( stderr, "bench36 [-g groups] [-t secs] [-s sizes] [-r dist] [-m n] [-l MB] [-d dir] [-v] [-h]\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Measure the throughput of the data conversions and tape I/O\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "-g groups to run: any of kernel,ascii,io (default all)\n" );
+    fprintf( stderr, "-t minimum time per measurement in seconds (default 0.1)\n" );
+    fprintf( stderr, "-s record sizes for the kernels, e.g. 14,2720,32768\n" );
+    fprintf( stderr, "-r record size distribution for io: fixed:N or uniform:MIN:MAX\n" );
+    fprintf( stderr, "-m write a tape mark every n records (default 0, none)\n" );
+    fprintf( stderr, "-l length of the synthetic tape in MB (default 64)\n" );
+    fprintf( stderr, "-d directory for the synthetic tape (default $TMPDIR or /tmp)\n" );
+    fprintf( stderr, "-v verify the generated packing kernels and the tape index instead\n" );
+    fprintf( stderr, "-h this usage\n" );
+    fprintf( stderr, "\n" );
+    fprintf( stderr, "Results are written to stdout as CSV\n" );
+
+    return;
+}
+
+/* EOF */
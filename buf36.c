@@ -0,0 +1,141 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Record buffers.
+ *
+ * Sizes are powers of 2 from BUF36_MIN.  Below BUF36_MAPMIN, malloc is
+ * used.  Larger buffers are mapped, in multiples of the huge page size,
+ * so that they can be released to the system when freed and are
+ * eligible for huge pages.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "buf36.h"
+
+#ifndef BUF36_MIN
+#  define BUF36_MIN (64 * 1024)
+#endif
+
+#ifndef BUF36_MAPMIN
+#  define BUF36_MAPMIN (2 * 1024 * 1024)
+#endif
+
+#define HUGEPAGE ((size_t)2 * 1024 * 1024)
+
+static buf36_huge_T policy = BUF36_HUGE_THP;
+
+buf36_huge_T buf36_setpolicy( buf36_huge_T newpolicy ) {
+    buf36_huge_T old = policy;
+
+    policy = newpolicy;
+    return old;
+}
+
+int buf36_policy( const char *name ) {
+    if( !strcmp( name, "never" ) )
+        return BUF36_HUGE_NEVER;
+    if( !strcmp( name, "thp" ) )
+        return BUF36_HUGE_THP;
+    if( !strcmp( name, "always" ) )
+        return BUF36_HUGE_ALWAYS;
+    return -1;
+}
+
+int buf36_reserve( buf36_T *b, size_t need ) {
+    size_t size;
+    void *data;
+    int huge = 0;
+
+    if( need <= b->size )
+        return 0;
+
+    size = b->size? b->size: BUF36_MIN;
+    while( size < need ) {
+        if( size > ((size_t)-1) / 2 ) {
+            errno = ENOMEM;
+            return -1;
+        }
+        size *= 2;
+    }
+
+    if( size < BUF36_MAPMIN ) {
+        data = malloc( size );
+        if( data == NULL )
+            return -1;
+        buf36_free( b );
+        b->data = data;
+        b->size = size;
+        return 0;
+    }
+
+    size = (size + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+    data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if( policy == BUF36_HUGE_ALWAYS ) {
+        data = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+        huge = (data != MAP_FAILED);
+    }
+#endif
+    if( data == MAP_FAILED )
+        data = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( data == MAP_FAILED )
+        return -1;
+#ifdef MADV_HUGEPAGE
+    if( !huge && policy != BUF36_HUGE_NEVER )
+        (void) madvise( data, size, MADV_HUGEPAGE );
+#endif
+
+    buf36_free( b );
+    b->data = data;
+    b->size = size;
+    b->mapsize = size;
+    b->huge = huge;
+    return 0;
+}
+
+int buf36_extend( buf36_T *b, size_t need, size_t keep ) {
+    buf36_T nb = *b;
+
+    if( need <= b->size )
+        return 0;
+    nb.data = NULL;             /* So reserve doesn't free b's data */
+    nb.mapsize = 0;
+    if( buf36_reserve( &nb, need ) != 0 )
+        return -1;
+    memcpy( nb.data, b->data, keep );
+    buf36_free( b );
+    *b = nb;
+    return 0;
+}
+
+void buf36_free( buf36_T *b ) {
+    if( b->mapsize )
+        (void) munmap( b->data, b->mapsize );
+    else
+        free( b->data );
+    b->data = NULL;
+    b->size = 0;
+    b->mapsize = 0;
+    b->huge = 0;
+
+    return;
+}
+
+/* EOF */
@@ -0,0 +1,63 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef BUF36_H
+#define BUF36_H
+
+#include <stddef.h>
+
+/* Record buffers, sized on demand.
+ *
+ * A buffer starts empty and grows geometrically as larger records are
+ * seen, so short records cost little memory.  Large buffers are mapped
+ * directly, and can be backed by huge pages to reduce page faults and
+ * TLB misses.
+ */
+
+typedef enum {
+    BUF36_HUGE_NEVER,           /* Small pages only */
+    BUF36_HUGE_THP,             /* Ask for transparent huge pages (default) */
+    BUF36_HUGE_ALWAYS           /* Reserved huge pages (MAP_HUGETLB) if available */
+} buf36_huge_T;
+
+typedef struct {
+    void    *data;
+    size_t  size;               /* Bytes usable */
+    size_t  mapsize;            /* Bytes mapped, or 0 if allocated by malloc */
+    int     huge;               /* Backed by MAP_HUGETLB pages */
+} buf36_T;
+
+#define BUF36_INIT { NULL, 0, 0, 0 }
+
+/* Set the huge page policy for buffers allocated later.
+ * Returns the previous policy.
+ */
+buf36_huge_T buf36_setpolicy( buf36_huge_T policy );
+
+/* Parse a policy name: never, thp or always.  Returns -1 if invalid.
+ */
+int buf36_policy( const char *name );
+
+/* Make b at least need bytes.  Contents are not preserved when it grows.
+ * Returns 0, or -1 with errno set (b is unchanged).
+ */
+int buf36_reserve( buf36_T *b, size_t need );
+
+/* As buf36_reserve, but the first keep bytes are preserved.
+ */
+int buf36_extend( buf36_T *b, size_t need, size_t keep );
+
+void buf36_free( buf36_T *b );
+
+#endif
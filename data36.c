@@ -20,8 +20,10 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "data36.h"
+#include "layout36.h"
 
 #ifndef __BYTE_ORDER__
 #  define __BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__
@@ -84,33 +86,34 @@ uint8_t *encode36( const uint8_t *buf, wd36_T *data, size_t wds ) {
 
 char *decodeasciz( wd36_T *data ) {
     size_t len;
-    uint8_t *string, *ep;
+    uint8_t *string;
 
     len = data++->rh * sizeof( uint8_t );
     string = malloc( (len * 5) + 1 );
     if( !string )
         return NULL;
 
-    ep = string;
-
-    while( len-- ) {
-        ep = decode7ascii( data++, ep );
-    }
-    *ep = '\0';
+    string[decode7ascii_n( data, len, string, 0 )] = '\0';
     return (char *)string;
  }
 
 /* Encode an ASCII string into a 7-bit ASCIZ string in 36-bit words */
 
 size_t encodeasciz( const char *string, wd36_T *data, size_t wds ) {
+    return encodeasciz_n( (const uint8_t *)string, strlen( string ), data, wds );
+}
+
+/* Encode len characters of text into a 7-bit ASCIZ string in 36-bit words */
+
+size_t encodeasciz_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
     size_t used;
 
     if( wds == 0 )
         return 0;
 
-    used = encode7ascii( string, data, wds );
+    used = encode7ascii_n( text, len, data, wds );
 
-    /* encode7ascii has padded unused space with 0.
+    /* encode7ascii_n has padded unused space with 0.
      */
 
     if( used == wds ) { /* Output full, truncate if last word full */
@@ -140,36 +143,40 @@ uint8_t *decode7ascii( wd36_T *data, uint8_t *buf ) {
 /* Encode a string  into 36-bit word(s) of 5 7-bit ASCII characters */
 
 size_t encode7ascii( const char *string, wd36_T *data, size_t wds ) {
-    size_t used = 0;
+    return encode7ascii_n( (const uint8_t *)string,
+                           strnlen( string, (wds > SIZE_MAX / 5)? SIZE_MAX: wds * 5 ),
+                           data, wds );
+}
 
-    while( wds && *string ) {
-        used++;
+/* Encode len characters into 36-bit words of 5 7-bit ASCII characters.
+ * Whole words are assembled without tests; only a final partial word is
+ * copied to be padded with NULs.
+ */
+
+size_t encode7ascii_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    uint8_t last[5] = { 0 };
+    size_t used, n;
+
+    used = (len + 4) / 5;
+    if( used > wds )
+        used = wds;
+
+    for( n = 0; n < used; n++ ) {
+        const uint8_t *p = text + 5 * n;
+        uint64_t w;
 
-        data->lh =
-            data->rh = 0;
-        if( *string ) {
-            data->lh = (*string++ & 0177) << 11;
-            if( *string ) {
-                data->lh |= (*string++ & 0177) << 4;
-                if( *string ) {
-                    data->lh |= (*string >> 3) & 017;
-                    data->rh |= (*string++ & 07) << 15;
-                    if( *string ) {
-                        data->rh |= (*string++ & 0177) << 8;
-                        if( *string ) {
-                            data->rh |= (*string++ & 0177) << 1;
-                        }
-                    }
-                }
-            }
+        if( 5 * n + 5 > len ) {
+            memcpy( last, p, len - 5 * n );
+            p = last;
         }
-        data++;
-    }
-        
-    while( wds-- ) {
-        data->lh = 0;
-        data++->rh = 0;
+        w = ((uint64_t)(p[0] & 0177) << 29) | ((uint64_t)(p[1] & 0177) << 22) |
+            ((uint64_t)(p[2] & 0177) << 15) | ((uint64_t)(p[3] & 0177) << 8) |
+            ((uint64_t)(p[4] & 0177) << 1);
+        data[n].lh = (uint32_t)(w >> 18);
+        data[n].rh = (uint32_t)w & BITS18;
     }
+
+    memset( data + used, 0, (wds - used) * sizeof( *data ) );
     return used;
 }
 
@@ -187,34 +194,93 @@ uint8_t *decode8ascii( wd36_T *data, uint8_t *buf ) {
 /* Encode a string  into 36-bit word(s) of 4 8-bit ASCII characters */
 
 size_t encode8ascii( const char *string, wd36_T *data, size_t wds ) {
-    size_t used = 0;
+    return encode8ascii_n( (const uint8_t *)string,
+                           strnlen( string, (wds > SIZE_MAX / 4)? SIZE_MAX: wds * 4 ),
+                           data, wds );
+}
 
-    while( wds && *string ) {
-        used++;
+/* Encode len characters into 36-bit words of 4 8-bit ASCII characters */
+
+size_t encode8ascii_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    uint8_t last[4] = { 0 };
+    size_t used, n;
+
+    used = (len + 3) / 4;
+    if( used > wds )
+        used = wds;
+
+    for( n = 0; n < used; n++ ) {
+        const uint8_t *p = text + 4 * n;
+        uint64_t w;
 
-        data->lh =
-            data->rh = 0;
-        if( *string ) {
-            data->lh = (*string++ & 0377) << 10;
-            if( *string ) {
-                data->lh |= (*string++ & 0377) << 2;
-                if( *string ) {
-                    data->lh |= (*string >> 6) & 03;
-                    data->rh |= (*string++ & 077) << 12;
-                    if( *string ) {
-                        data->rh |= (*string++ & 0377) << 4;
-                    }
-                }
-            }
+        if( 4 * n + 4 > len ) {
+            memcpy( last, p, len - 4 * n );
+            p = last;
         }
+        w = ((uint64_t)p[0] << 28) | ((uint64_t)p[1] << 20) |
+            ((uint64_t)p[2] << 12) | ((uint64_t)p[3] << 4);
+        data[n].lh = (uint32_t)(w >> 18);
+        data[n].rh = (uint32_t)w & BITS18;
+    }
+
+    memset( data + used, 0, (wds - used) * sizeof( *data ) );
+    return used;
+}
+
+/* Bulk text extraction: decode wc words into buf, then apply flags */
+
+size_t decode7ascii_n( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    uint8_t *bp = buf;
+
+    while( wc-- ) {
+        bp[0] =  (data->lh >> 11) & 0177;
+        bp[1] =  (data->lh >>  4) & 0177;
+        bp[2] = ((data->lh <<  3) & 0170) | ((data->rh >> 15) & 0007);
+        bp[3] =  (data->rh >>  8) & 0177;
+        bp[4] =  (data->rh >>  1) & 0177;
+        bp += 5;
         data++;
     }
-        
-    while( wds-- ) {
-        data->lh = 0;
-        data++->rh = 0;
+    if( flags )
+        return filtertext( buf, 0, buf, (size_t)(bp - buf), flags );
+    return (size_t)(bp - buf);
+}
+
+size_t decode8ascii_n( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    uint8_t *bp = buf;
+
+    while( wc-- ) {
+        bp[0] =  (data->lh >> 10) & 0377;
+        bp[1] =  (data->lh >>  2) & 0377;
+        bp[2] = ((data->lh <<  6) & 0300) | ((data->rh >> 12) & 0077);
+        bp[3] =  (data->rh >>  4) & 0377;
+        bp += 4;
+        data++;
     }
-    return used;
+    if( flags )
+        return filtertext( buf, 0, buf, (size_t)(bp - buf), flags );
+    return (size_t)(bp - buf);
+}
+
+/* Append len characters of text to the done already in buf.
+ * text may be buf + done.
+ */
+
+size_t filtertext( uint8_t *buf, size_t done, const uint8_t *text, size_t len, int flags ) {
+    uint8_t *bp = buf + done;
+
+    while( len-- ) {
+        uint8_t c = *text++;
+
+        if( c == '\0' && (flags & TEXT_STRIPNUL) )
+            continue;
+        if( c == '\n' && (flags & TEXT_CRLF) && bp > buf && bp[-1] == '\r' ) {
+            bp[-1] = '\n';
+            continue;
+        }
+        *bp++ = c;
+    }
+    return (size_t)(bp - buf);
 }
 
 /* Decode a TOPS version from a 36-bit word into a string of size at least VERSION_BUFFER_SIZE */
@@ -259,7 +325,7 @@ char *decodeversion( wd36_T *data, char *buffer ) {
     return buffer;
 }
 
-size_t unpack_core_dump(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+size_t unpack_core_dump(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
     size_t wc = 0;
 
     if( insize % 5 )
@@ -304,7 +370,7 @@ size_t pack_core_dump(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bu
     return bc;
 }
 
-size_t unpack_sixbit_7(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+size_t unpack_sixbit_7(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
     size_t wc = 0;
 
     if( insize % 6 )
@@ -344,13 +410,13 @@ size_t pack_sixbit_7(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t buf
         *outbuf++ = 077 & (inbuf->lh);
         *outbuf++ = 077 & (inbuf->rh >> 12);
         *outbuf++ = 077 & (inbuf->rh >> 6);
-        *outbuf++ = 077 & (inbuf->rh);
+        *outbuf++ = 077 & (inbuf++->rh);
     }
 
     return bc;
 }
 
-size_t unpack_high_density(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+size_t unpack_high_density(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
     size_t wc = 0;
 
     if( insize % 9 )
@@ -407,6 +473,7 @@ size_t pack_high_density(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t
         *outbuf++ = ((inbuf[0].rh & 017) << 4) |
                     ((inbuf[1].lh & 0740000) >> 14);
         inbuf++;
+        wc--;
         *outbuf++ = (inbuf->lh >> 6);
         *outbuf++ = ((inbuf->lh & 077) << 2) | ((inbuf->rh >> 16) & 03);
         *outbuf++ = (inbuf->rh >> 8);
@@ -417,7 +484,7 @@ size_t pack_high_density(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t
     return bc;
 }
 
-size_t unpack_industry(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+size_t unpack_industry(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
     size_t wc = 0;
 
     if( insize % 4 )
@@ -449,15 +516,12 @@ size_t pack_industry(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t buf
     if( bc > bufsize )
         abort();
 
-    while( wc-- ) {
-        outbuf = decode8ascii( inbuf++, outbuf );
-
-    }
+    (void) decode8ascii_n( inbuf, wc, outbuf, 0 );
 
     return bc;
 }
 
-size_t unpack_ansi_ascii(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+size_t unpack_ansi_ascii(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
     size_t wc = 0;
 
     if( insize % 5 )
@@ -503,3 +567,433 @@ size_t pack_ansi_ascii(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t b
     return bc;
 
 }
+
+/* Direct conversions.
+ *
+ * Each mode's frames are read and written by the unit accessors that
+ * layout36.h generates from its layout.  ACCESSORS wraps them to get and
+ * put pairs of words (as 36-bit values), plus a single word for the odd
+ * word at the end of a record, and TRANSCODE generates a conversion for
+ * a pair of modes from these.  The words stay in registers, and the
+ * compiler inlines and schedules each pair of modes as a unit.
+ *
+ * A pair is one unit of a two-word mode, or two of a one-word mode.  A
+ * two-word mode pads a single word to a whole unit.
+ */
+
+#define PAIR_UNITS( mode )  (2 / mode##_WORDS)
+#define PAIR_FRAMES( mode ) (PAIR_UNITS( mode ) * mode##_FRAMES)
+
+#define ACCESSORS( mode )                                                      \
+static inline void mode##_get2( const uint8_t *p, uint64_t *w0, uint64_t *w1 ) { \
+    uint64_t w[2] = { 0, 0 };                                                  \
+                                                                               \
+    layout36_get_##mode( p, w );                                               \
+    if( PAIR_UNITS( mode ) == 2 )                                              \
+        layout36_get_##mode( p + mode##_FRAMES, w + PAIR_UNITS( mode ) - 1 );  \
+    *w0 = w[0];                                                                \
+    *w1 = w[1];                                                                \
+}                                                                              \
+                                                                               \
+static inline void mode##_get1( const uint8_t *p, uint64_t *w0 ) {             \
+    uint64_t w[2] = { 0, 0 };                                                  \
+                                                                               \
+    layout36_get_##mode( p, w );                                               \
+    *w0 = w[0];                                                                \
+}                                                                              \
+                                                                               \
+static inline void mode##_put2( uint8_t *p, uint64_t w0, uint64_t w1 ) {       \
+    const uint64_t w[2] = { w0, w1 };                                          \
+                                                                               \
+    layout36_put_##mode( p, w );                                               \
+    if( PAIR_UNITS( mode ) == 2 )                                              \
+        layout36_put_##mode( p + mode##_FRAMES, w + PAIR_UNITS( mode ) - 1 );  \
+}                                                                              \
+                                                                               \
+static inline void mode##_put1( uint8_t *p, uint64_t w0 ) {                    \
+    const uint64_t w[2] = { w0, 0 };                                           \
+                                                                               \
+    layout36_put_##mode( p, w );                                               \
+}
+
+ACCESSORS( core_dump )
+ACCESSORS( sixbit )
+ACCESSORS( high_density )
+ACCESSORS( industry )
+ACCESSORS( ansi_ascii )
+
+#define TRANSCODE( from, to )                                                  \
+static size_t transcode_##from##_to_##to( const uint8_t *inbuf, size_t insize, \
+                                          uint8_t *outbuf, const size_t bufsize ) { \
+    size_t wc, bc, n;                                                          \
+                                                                               \
+    if( insize % from##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = (insize / from##_FRAMES) * from##_WORDS;                              \
+    bc = (wc / 2) * PAIR_FRAMES( to ) + (wc & 1) * to##_FRAMES;                \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    for( n = wc / 2; n != 0; n-- ) {                                           \
+        uint64_t w0, w1;                                                       \
+                                                                               \
+        from##_get2( inbuf, &w0, &w1 );                                        \
+        inbuf += PAIR_FRAMES( from );                                          \
+        to##_put2( outbuf, w0, w1 );                                           \
+        outbuf += PAIR_FRAMES( to );                                           \
+    }                                                                          \
+    if( wc & 1 ) {                                                             \
+        uint64_t w0;                                                           \
+                                                                               \
+        from##_get1( inbuf, &w0 );                                             \
+        to##_put1( outbuf, w0 );                                               \
+    }                                                                          \
+                                                                               \
+    return bc;                                                                 \
+}
+
+/* In place: input and output share buf.  A word's output never
+ * starts after its input, so if pairs shrink (or keep their size) they
+ * are converted front to back; each is read before anything that
+ * overlaps it is written.  If they grow, they are converted back to
+ * front, starting with any odd word, for the same reason.
+ */
+
+#define TRANSCODE_INPLACE( from, to )                                          \
+static size_t transcode_##from##_to_##to##_inplace( uint8_t *buf, size_t insize, \
+                                                    const size_t bufsize ) {  \
+    size_t wc, bc, n;                                                          \
+    uint64_t w0, w1;                                                           \
+                                                                               \
+    if( insize % from##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = (insize / from##_FRAMES) * from##_WORDS;                              \
+    bc = (wc / 2) * PAIR_FRAMES( to ) + (wc & 1) * to##_FRAMES;                \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    if( PAIR_FRAMES( to ) <= PAIR_FRAMES( from ) ) {                           \
+        const uint8_t *inp = buf;                                              \
+        uint8_t *outp = buf;                                                   \
+                                                                               \
+        for( n = wc / 2; n != 0; n-- ) {                                       \
+            from##_get2( inp, &w0, &w1 );                                      \
+            inp += PAIR_FRAMES( from );                                        \
+            to##_put2( outp, w0, w1 );                                         \
+            outp += PAIR_FRAMES( to );                                         \
+        }                                                                      \
+        if( wc & 1 ) {                                                         \
+            from##_get1( inp, &w0 );                                           \
+            to##_put1( outp, w0 );                                             \
+        }                                                                      \
+    } else {                                                                   \
+        n = wc / 2;                                                            \
+        if( wc & 1 ) {                                                         \
+            from##_get1( buf + n * PAIR_FRAMES( from ), &w0 );                 \
+            to##_put1( buf + n * PAIR_FRAMES( to ), w0 );                      \
+        }                                                                      \
+        while( n-- != 0 ) {                                                    \
+            from##_get2( buf + n * PAIR_FRAMES( from ), &w0, &w1 );            \
+            to##_put2( buf + n * PAIR_FRAMES( to ), w0, w1 );                  \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    return bc;                                                                 \
+}
+
+#define TRANSCODE_FROM( from )                 \
+    TRANSCODE( from, core_dump )               \
+    TRANSCODE( from, sixbit )                  \
+    TRANSCODE( from, high_density )            \
+    TRANSCODE( from, industry )                \
+    TRANSCODE( from, ansi_ascii )              \
+    TRANSCODE_INPLACE( from, core_dump )       \
+    TRANSCODE_INPLACE( from, sixbit )          \
+    TRANSCODE_INPLACE( from, high_density )    \
+    TRANSCODE_INPLACE( from, industry )        \
+    TRANSCODE_INPLACE( from, ansi_ascii )
+
+TRANSCODE_FROM( core_dump )
+TRANSCODE_FROM( sixbit )
+TRANSCODE_FROM( high_density )
+TRANSCODE_FROM( industry )
+TRANSCODE_FROM( ansi_ascii )
+
+#define TRANSCODE_ROW( from ) {                \
+        transcode_##from##_to_core_dump,       \
+        transcode_##from##_to_sixbit,          \
+        transcode_##from##_to_high_density,    \
+        transcode_##from##_to_industry,        \
+        transcode_##from##_to_ansi_ascii }
+
+static const transcodefn_T transcoders[PK_NFORMATS][PK_NFORMATS] = {
+    TRANSCODE_ROW( core_dump ),
+    TRANSCODE_ROW( sixbit ),
+    TRANSCODE_ROW( high_density ),
+    TRANSCODE_ROW( industry ),
+    TRANSCODE_ROW( ansi_ascii )
+};
+
+transcodefn_T transcoder( packformat_T from, packformat_T to ) {
+    if( from >= PK_NFORMATS || to >= PK_NFORMATS )
+        return NULL;
+    return transcoders[from][to];
+}
+
+#define INPLACE_ROW( from ) {                          \
+        transcode_##from##_to_core_dump_inplace,       \
+        transcode_##from##_to_sixbit_inplace,          \
+        transcode_##from##_to_high_density_inplace,    \
+        transcode_##from##_to_industry_inplace,        \
+        transcode_##from##_to_ansi_ascii_inplace }
+
+static const inplacefn_T inplace_transcoders[PK_NFORMATS][PK_NFORMATS] = {
+    INPLACE_ROW( core_dump ),
+    INPLACE_ROW( sixbit ),
+    INPLACE_ROW( high_density ),
+    INPLACE_ROW( industry ),
+    INPLACE_ROW( ansi_ascii )
+};
+
+inplacefn_T transcoder_inplace( packformat_T from, packformat_T to ) {
+    if( from >= PK_NFORMATS || to >= PK_NFORMATS )
+        return NULL;
+    return inplace_transcoders[from][to];
+}
+
+size_t transcode_size( packformat_T from, packformat_T to, size_t insize ) {
+    static const size_t words[PK_NFORMATS] = {
+        core_dump_WORDS, sixbit_WORDS, high_density_WORDS, industry_WORDS,
+        ansi_ascii_WORDS
+    };
+    size_t wc;
+
+    if( from >= PK_NFORMATS || to >= PK_NFORMATS )
+        abort();
+    wc = (insize / pack_unit( from )) * words[from];
+    return ((wc / 2) * (2 / words[to]) + (wc & 1)) * pack_unit( to );
+}
+
+size_t pack_unit( packformat_T format ) {
+    static const size_t units[PK_NFORMATS] = {
+        core_dump_FRAMES,
+        sixbit_FRAMES,
+        high_density_FRAMES,
+        industry_FRAMES,
+        ansi_ascii_FRAMES
+    };
+
+    if( format >= PK_NFORMATS )
+        abort();
+    return units[format];
+}
+
+
+/* Packed 36-bit words */
+
+void pack_wd36( const wd36_T *data, pwd36_T *pdata, size_t wds ) {
+    while( wds-- ) {
+        *pdata++ = ((uint64_t)(data->lh & BITS18) << 18) | (data->rh & BITS18);
+        data++;
+    }
+}
+
+void unpack_wd36( const pwd36_T *pdata, wd36_T *data, size_t wds ) {
+    while( wds-- ) {
+        data->lh = LHP36( pdata );
+        data++->rh = RHP36( pdata );
+        pdata++;
+    }
+}
+
+/* Decode a packed word into a 64-bit buffer, as decode36 does */
+
+uint8_t *decodep36( const pwd36_T *data, uint8_t *buf ) {
+    wd36_T wd;
+
+    unpack_wd36( data, &wd, 1 );
+    return decode36( &wd, buf );
+}
+
+/* Encode 64-bit buffer(s) into packed words.  The buffer holds a word
+ * in host byte order, which is what decode36 produces on little and
+ * big-endian hosts.
+ */
+
+const uint8_t *encodep36( const uint8_t *buf, pwd36_T *data, size_t wds ) {
+    while( wds-- ) {
+        uint64_t w;
+
+        memcpy( &w, buf, sizeof( w ) );
+        *data++ = w & BITS36;
+        buf += sizeof( w );
+    }
+    return buf;
+}
+
+char *decodeascizp( const pwd36_T *data ) {
+    size_t len;
+    uint8_t *string, *ep;
+
+    len = RHP36( data );
+    data++;
+    string = malloc( (len * 5) + 1 );
+    if( !string )
+        return NULL;
+
+    ep = string;
+
+    while( len-- ) {
+        ep = decode7asciip( data++, ep );
+    }
+    *ep = '\0';
+    return (char *)string;
+}
+
+size_t encodeascizp( const char *string, pwd36_T *data, size_t wds ) {
+    size_t used;
+
+    if( wds == 0 )
+        return 0;
+
+    used = encode7asciip( string, data, wds );
+
+    if( used == wds ) { /* Output full, truncate if last word full */
+        data[used-1] &= ~(uint64_t)(0177 << 1);
+    } else { /* Not full.  If no output or last word full, add terminating NUL */
+        if( !used || (data[used-1] & (0177 << 1)) != 0 )
+            used++;
+    }
+
+    return used;
+}
+
+uint8_t *decode7asciip( const pwd36_T *data, uint8_t *buf ) {
+    uint64_t w = *data;
+
+    buf[0] = (w >> 29) & 0177;
+    buf[1] = (w >> 22) & 0177;
+    buf[2] = (w >> 15) & 0177;
+    buf[3] = (w >>  8) & 0177;
+    buf[4] = (w >>  1) & 0177;
+
+    return buf + 5;
+}
+
+size_t encode7asciip( const char *string, pwd36_T *data, size_t wds ) {
+    size_t used = 0;
+
+    while( wds && *string ) {
+        uint64_t w = 0;
+        int i;
+
+        for( i = 0; i < 5; i++ ) {
+            w <<= 7;
+            if( *string )
+                w |= *string++ & 0177;
+        }
+        *data++ = w << 1;
+        used++;
+        wds--;
+    }
+
+    while( wds-- )
+        *data++ = 0;
+
+    return used;
+}
+
+uint8_t *decode8asciip( const pwd36_T *data, uint8_t *buf ) {
+    uint64_t w = *data;
+
+    buf[0] = (w >> 28) & 0377;
+    buf[1] = (w >> 20) & 0377;
+    buf[2] = (w >> 12) & 0377;
+    buf[3] = (w >>  4) & 0377;
+
+    return buf + 4;
+}
+
+size_t encode8asciip( const char *string, pwd36_T *data, size_t wds ) {
+    size_t used = 0;
+
+    while( wds && *string ) {
+        uint64_t w = 0;
+        int i;
+
+        for( i = 0; i < 4; i++ ) {
+            w <<= 8;
+            if( *string )
+                w |= *string++ & 0377;
+        }
+        *data++ = w << 4;
+        used++;
+        wds--;
+    }
+
+    while( wds-- )
+        *data++ = 0;
+
+    return used;
+}
+
+char *decodeversionp( const pwd36_T *data, char *buffer ) {
+    wd36_T wd;
+
+    unpack_wd36( data, &wd, 1 );
+    return decodeversion( &wd, buffer );
+}
+
+/* Tape packing modes for packed words, built from the same frame
+ * accessors as the direct conversions.
+ */
+
+#define PACKED( mode, name )                                                   \
+size_t unpackp_##name( const uint8_t *inbuf, size_t insize,                    \
+                       pwd36_T *outbuf, size_t maxwc ) {                       \
+    size_t wc, n;                                                              \
+                                                                               \
+    if( insize % mode##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = (insize / mode##_FRAMES) * mode##_WORDS;                              \
+    if( wc > maxwc )                                                           \
+        wc = maxwc;                                                            \
+                                                                               \
+    for( n = wc / 2; n != 0; n-- ) {                                           \
+        mode##_get2( inbuf, &outbuf[0], &outbuf[1] );                          \
+        inbuf += PAIR_FRAMES( mode );                                          \
+        outbuf += 2;                                                           \
+    }                                                                          \
+    if( wc & 1 )                                                               \
+        mode##_get1( inbuf, outbuf );                                          \
+                                                                               \
+    return wc;                                                                 \
+}                                                                              \
+                                                                               \
+size_t packp_##name( const pwd36_T *inbuf, size_t wc,                          \
+                     uint8_t *outbuf, const size_t bufsize ) {                 \
+    size_t bc, n;                                                              \
+                                                                               \
+    bc = (wc / 2) * PAIR_FRAMES( mode ) + (wc & 1) * mode##_FRAMES;            \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    for( n = wc / 2; n != 0; n-- ) {                                           \
+        mode##_put2( outbuf, inbuf[0] & BITS36, inbuf[1] & BITS36 );           \
+        inbuf += 2;                                                            \
+        outbuf += PAIR_FRAMES( mode );                                         \
+    }                                                                          \
+    if( wc & 1 )                                                               \
+        mode##_put1( outbuf, *inbuf & BITS36 );                                \
+                                                                               \
+    return bc;                                                                 \
+}
+
+PACKED( core_dump,    core_dump )
+PACKED( sixbit,       sixbit_7 )
+PACKED( high_density, high_density )
+PACKED( industry,     industry )
+PACKED( ansi_ascii,   ansi_ascii )
@@ -74,6 +74,27 @@ uint8_t *decode8ascii( wd36_T *data, uint8_t *buf );
 #define VERSION_BUFFER_SIZE sizeof("511BK(777777)-7")
 char *decodeversion( wd36_T *data, char *buffer );
 
+/* Bulk text extraction.  wc words of 7-bit (5 characters per word) or
+ * 8-bit (4 per word) ASCII are decoded into buf, which must have room for
+ * 5 * wc or 4 * wc bytes.  flags may include TEXT_STRIPNUL, to drop NUL
+ * (fill) characters, and TEXT_CRLF, to end lines with LF rather than
+ * CR LF.  A CR ending one call isn't joined to an LF starting the next.
+ * Returns the number of characters stored.
+ *
+ * filtertext applies flags to len characters of text, appending them to
+ * the done characters already in buf; text may be buf + done.  Returns
+ * the new length of buf.
+ */
+
+#define TEXT_STRIPNUL 1
+#define TEXT_CRLF     2
+
+typedef size_t (*textfn_T)(const wd36_T *data, size_t wc, uint8_t *buf, int flags);
+
+size_t decode7ascii_n( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t decode8ascii_n( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t filtertext( uint8_t *buf, size_t done, const uint8_t *text, size_t len, int flags );
+
 /* Conversions from byte data to 36-bit words */
 
 uint8_t *encode36( const uint8_t *buf, wd36_T *data, size_t wds );
@@ -81,30 +102,143 @@ size_t encodeasciz( const char *string, wd36_T *data, size_t wds );
 size_t encode7ascii( const char *string, wd36_T *data, size_t wds );
 size_t encode8ascii( const char *string, wd36_T *data, size_t wds );
 
+/* The same, for len characters of text rather than a string.  Words not
+ * filled are zeroed; the number filled is returned.  Characters beyond
+ * wds words are dropped.
+ */
+
+typedef size_t (*encodefn_T)(const uint8_t *text, size_t len, wd36_T *data, size_t wds);
+
+size_t encodeasciz_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+size_t encode7ascii_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+size_t encode8ascii_n( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+
 /* Conversions to and from tape packing modes */
 
 typedef size_t (*packfn_T)(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
-typedef size_t (*unpackfn_T)(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+typedef size_t (*unpackfn_T)(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
 
-size_t unpack_core_dump(uint8_t *inbuf, size_t insize, wd36_T *outbuf, const size_t maxwc);
+size_t unpack_core_dump(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, const size_t maxwc);
 size_t pack_core_dump(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
 
 /* For TAP files, 7-track is stored the right-justified in 8 bits.
  * Thus sixbit-7 and sixbit-9 happen to have the same encodings.
  */
 
-size_t unpack_sixbit_7(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_sixbit_7(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
 size_t pack_sixbit_7(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
 #define unpack_sixbit_9 unpack_sixbit_7
 #define pack_sixbit_9 pack_sixbit_7
 
-size_t unpack_high_density(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_high_density(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
 size_t pack_high_density(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
 
-size_t unpack_industry(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_industry(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
 size_t pack_industry(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
 
-size_t unpack_ansi_ascii(uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_ansi_ascii(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
 size_t pack_ansi_ascii(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
 
+/* Direct conversions between tape packing modes.
+ * These produce the same frames as unpacking and re-packing a record,
+ * but go from frames to frames without the wd36_T intermediate.
+ * Returns the output size, or (size_t)-1 if insize is invalid for the
+ * input mode.
+ */
+
+typedef enum {
+    PK_CORE_DUMP,
+    PK_SIXBIT,
+    PK_HIGH_DENSITY,
+    PK_INDUSTRY,
+    PK_ANSI_ASCII,
+    PK_NFORMATS
+} packformat_T;
+
+typedef size_t (*transcodefn_T)(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+
+transcodefn_T transcoder( packformat_T from, packformat_T to );
+
+/* The same conversions within one buffer.  buf holds insize frames of
+ * input and has room for bufsize; the output replaces them.
+ */
+
+typedef size_t (*inplacefn_T)(uint8_t *buf, size_t insize, const size_t bufsize);
+
+inplacefn_T transcoder_inplace( packformat_T from, packformat_T to );
+
+/* The output size of a conversion of a valid record of insize frames */
+
+size_t transcode_size( packformat_T from, packformat_T to, size_t insize );
+
+/* The frame count that a record in format must be a multiple of */
+
+size_t pack_unit( packformat_T format );
+
+/* Packed 36-bit atoms.
+ *
+ * A pwd36_T holds a word right-justified in a uint64_t; the upper 28
+ * bits are always zero.  This takes half the space of a wd36_T, and a
+ * word is a single load.  The macros and functions below mirror the
+ * wd36_T ones above.
+ *
+ * A denser form (9 bytes per pair of words) is the high-density frame
+ * layout; use transcoder() to get there from other frames.
+ */
+
+typedef uint64_t pwd36_T;
+#define BITS36 UINT64_C(0777777777777)
+
+#define LHP36( pwd36p ) ( (uint32_t)(*(pwd36p) >> 18) & BITS18 )
+#define RHP36( pwd36p ) ( (uint32_t)*(pwd36p) & BITS18 )
+
+#define SETP36( pwd36p, val ) do { \
+        *(pwd36p) = (uint64_t)(val) & BITS36; \
+    } while( 0 )
+
+#define XWDP36( pwd36p, lhv, rhv ) do { \
+        *(pwd36p) = ((uint64_t)((lhv) & BITS18) << 18) | ((rhv) & BITS18); \
+    } while( 0 )
+
+#define INITP36( lh, rh ) ( ((uint64_t)(lh) << 18) | (rh) )
+
+#define ISEP36( pwd36p )  ( *(pwd36p) == 0 )
+#define ISNP36( pwd36p )  ( *(pwd36p) != 0 )
+#define ISGP36( pwd36p )  ( (*(pwd36p) & (UINT64_C(1) << 35)) == 0 )
+#define ISLP36( pwd36p )  ( (*(pwd36p) & (UINT64_C(1) << 35)) != 0 )
+#define ISGEP36( pwd36p ) ( ISGP36(pwd36p) || ISEP36(pwd36p) )
+#define ISLEP36( pwd36p ) ( ISLP36(pwd36p) || ISEP36(pwd36p) )
+
+/* Conversions between the two representations */
+
+void pack_wd36( const wd36_T *data, pwd36_T *pdata, size_t wds );
+void unpack_wd36( const pwd36_T *pdata, wd36_T *data, size_t wds );
+
+uint8_t *decodep36( const pwd36_T *data, uint8_t *buf );
+char *decodeascizp( const pwd36_T *data );
+uint8_t *decode7asciip( const pwd36_T *data, uint8_t *buf );
+uint8_t *decode8asciip( const pwd36_T *data, uint8_t *buf );
+char *decodeversionp( const pwd36_T *data, char *buffer );
+
+const uint8_t *encodep36( const uint8_t *buf, pwd36_T *data, size_t wds );
+size_t encodeascizp( const char *string, pwd36_T *data, size_t wds );
+size_t encode7asciip( const char *string, pwd36_T *data, size_t wds );
+size_t encode8asciip( const char *string, pwd36_T *data, size_t wds );
+
+typedef size_t (*ppackfn_T)(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+typedef size_t (*punpackfn_T)(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+
+size_t unpackp_core_dump(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+size_t packp_core_dump(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t unpackp_sixbit_7(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+size_t packp_sixbit_7(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+#define unpackp_sixbit_9 unpackp_sixbit_7
+#define packp_sixbit_9 packp_sixbit_7
+size_t unpackp_high_density(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+size_t packp_high_density(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t unpackp_industry(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+size_t packp_industry(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t unpackp_ansi_ascii(const uint8_t *inbuf, size_t insize, pwd36_T *outbuf, size_t maxwc);
+size_t packp_ansi_ascii(const pwd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+
 #endif
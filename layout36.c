@@ -0,0 +1,325 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Kernels generated from the bit layouts in layout36.h.
+ *
+ * Every piece becomes a shift, a mask and an OR with constant operands,
+ * and the dir tests are constant, so the compiler unrolls a unit into
+ * straight-line code.  Words are handled as 36-bit values, and split
+ * into (or joined from) the wd36_T halves once per word.
+ *
+ * The vector kernels hold a word per 64-bit lane.  Unpacking shuffles
+ * each word's frames into a lane, frame 0 in the low byte, so that
+ * frame k's bit b is lane bit 8k+b; each piece is then a shift and mask
+ * of the lane.  Packing builds the lane from the word's pieces and
+ * shuffles the frames together.  The loops run while whole 16-byte loads
+ * and stores fit in the caller's buffers; the scalar kernel does the
+ * rest.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout36.h"
+
+/* Scalar */
+
+/* Packing builds frames 8 to a uint64_t, frame 0 lowest, then stores
+ * them a byte at a time, which compilers turn into wide stores.  From
+ * wd36_T halves this is faster than layout36_put_<mode>'s byte frames.
+ */
+
+#define PUT_WIDE( dir, frame, fbit, word, wbit, width )                        \
+    if( L36_##dir & L36_PUT )                                                  \
+        f[(frame) / 8] |= ((w[word] >> (wbit)) & L36_MASK( width )) <<        \
+            (8 * ((frame) % 8) + (fbit));
+
+#define PUT_FRAME( i ) p[i] = (uint8_t)(f[(i) / 8] >> (8 * ((i) % 8)));
+
+#define EACH_FRAME( n, X ) EACH_FRAME_( n, X )
+#define EACH_FRAME_( n, X ) FRAMES_##n( X )
+#define FRAMES_4( X ) X( 0 ) X( 1 ) X( 2 ) X( 3 )
+#define FRAMES_5( X ) FRAMES_4( X ) X( 4 )
+#define FRAMES_6( X ) FRAMES_5( X ) X( 5 )
+#define FRAMES_7( X ) FRAMES_6( X ) X( 6 )
+#define FRAMES_8( X ) FRAMES_7( X ) X( 7 )
+#define FRAMES_9( X ) FRAMES_8( X ) X( 8 )
+
+#define LAYOUT_SCALAR( mode )                                                  \
+size_t unpack_gen_##mode(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) { \
+    size_t wc, n, k;                                                           \
+                                                                               \
+    if( insize % mode##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = (insize / mode##_FRAMES) * mode##_WORDS;                              \
+    if( wc > maxwc )                                                           \
+        wc = maxwc;                                                            \
+                                                                               \
+    for( n = 0; n < wc; n += mode##_WORDS ) {                                  \
+        const uint8_t *p = inbuf + (n / mode##_WORDS) * mode##_FRAMES;         \
+        uint64_t w[mode##_WORDS] = { 0 };                                      \
+                                                                               \
+        layout36_get_##mode( p, w );                                           \
+        for( k = 0; k < mode##_WORDS && n + k < wc; k++ ) {                    \
+            outbuf[n + k].lh = (uint32_t)(w[k] >> 18);                         \
+            outbuf[n + k].rh = (uint32_t)w[k] & BITS18;                        \
+        }                                                                      \
+    }                                                                          \
+                                                                               \
+    return wc;                                                                 \
+}                                                                              \
+                                                                               \
+size_t pack_gen_##mode(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) { \
+    size_t bc, n, k;                                                           \
+                                                                               \
+    bc = ((wc + mode##_WORDS - 1) / mode##_WORDS) * mode##_FRAMES;             \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    for( n = 0; n < wc; n += mode##_WORDS ) {                                  \
+        uint8_t *p = outbuf + (n / mode##_WORDS) * mode##_FRAMES;              \
+        uint64_t w[mode##_WORDS] = { 0 }, f[(mode##_FRAMES + 7) / 8] = { 0 };  \
+                                                                               \
+        for( k = 0; k < mode##_WORDS && n + k < wc; k++ )                      \
+            w[k] = ((uint64_t)(inbuf[n + k].lh & BITS18) << 18) |              \
+                (inbuf[n + k].rh & BITS18);                                    \
+        LAYOUT_##mode( PUT_WIDE )                                              \
+        EACH_FRAME( mode##_FRAMES, PUT_FRAME )                                 \
+    }                                                                          \
+                                                                               \
+    return bc;                                                                 \
+}
+
+LAYOUT_SCALAR( core_dump )
+LAYOUT_SCALAR( sixbit )
+LAYOUT_SCALAR( high_density )
+LAYOUT_SCALAR( industry )
+LAYOUT_SCALAR( ansi_ascii )
+
+#define MASK_PIECE( dir, frame, fbit, word, wbit, width )                      \
+    if( L36_##dir & L36_PUT )                                                  \
+        mask[frame] |= (uint8_t)(L36_MASK( width ) << (fbit));
+
+#define PUTMASK( mode )                                                        \
+    memset( mask, 0, mode##_FRAMES );                                          \
+    LAYOUT_##mode( MASK_PIECE )                                                \
+    return mode##_FRAMES;
+
+size_t layout36_putmask( packformat_T format, uint8_t *mask ) {
+    switch( format ) {
+    case PK_CORE_DUMP:
+        PUTMASK( core_dump )
+    case PK_SIXBIT:
+        PUTMASK( sixbit )
+    case PK_HIGH_DENSITY:
+        PUTMASK( high_density )
+    case PK_INDUSTRY:
+        PUTMASK( industry )
+    case PK_ANSI_ASCII:
+        PUTMASK( ansi_ascii )
+    default:
+        abort();
+    }
+}
+
+#ifdef SIMD36_X86
+#include <immintrin.h>
+
+#define M18 INT64_C(0777777)
+
+/* Shuffles for F frames per word, 2 words per 128-bit lane.  -1 selects zero. */
+
+#define UNPACK_IDX( F, i ) ( ((i) % 8 < (F))? ((i) / 8) * (F) + (i) % 8: -1 )
+#define PACK_IDX( F, i )   ( ((i) < 2 * (F))? ((i) / (F)) * 8 + (i) % (F): -1 )
+
+#define SHUF16( idx, F )                                                       \
+    idx( F, 0 ),  idx( F, 1 ),  idx( F, 2 ),  idx( F, 3 ),                     \
+    idx( F, 4 ),  idx( F, 5 ),  idx( F, 6 ),  idx( F, 7 ),                     \
+    idx( F, 8 ),  idx( F, 9 ),  idx( F, 10 ), idx( F, 11 ),                    \
+    idx( F, 12 ), idx( F, 13 ), idx( F, 14 ), idx( F, 15 )
+
+/* Operations, by vector width */
+
+#define SSE_OR( a, b )   _mm_or_si128( a, b )
+#define SSE_AND( a, b )  _mm_and_si128( a, b )
+#define SSE_SRL( a, n )  _mm_srli_epi64( a, n )
+#define SSE_SLL( a, n )  _mm_slli_epi64( a, n )
+#define SSE_SET1( c )    _mm_set1_epi64x( c )
+#define SSE_ZERO()       _mm_setzero_si128()
+
+#define AVX_OR( a, b )   _mm256_or_si256( a, b )
+#define AVX_AND( a, b )  _mm256_and_si256( a, b )
+#define AVX_SRL( a, n )  _mm256_srli_epi64( a, n )
+#define AVX_SLL( a, n )  _mm256_slli_epi64( a, n )
+#define AVX_SET1( c )    _mm256_set1_epi64x( c )
+#define AVX_ZERO()       _mm256_setzero_si256()
+
+/* A piece moves from lane bit 8 * frame + fbit to word bit wbit, or back */
+
+#define V_MOVE( V, a, from, to )                                               \
+    (((from) > (to))? V##_SRL( a, ((from) > (to))? (from) - (to): 0 ):         \
+                      V##_SLL( a, ((to) > (from))? (to) - (from): 0 ))
+
+#define VGET_PIECE( V, dir, frame, fbit, word, wbit, width )                   \
+    if( L36_##dir & L36_GET )                                                  \
+        v = V##_OR( v, V##_AND( V_MOVE( V, x, 8 * (frame) + (fbit), wbit ),    \
+                                V##_SET1( L36_MASK( width ) << (wbit) ) ) );
+
+#define VPUT_PIECE( V, dir, frame, fbit, word, wbit, width )                   \
+    if( L36_##dir & L36_PUT )                                                  \
+        x = V##_OR( x, V##_AND( V_MOVE( V, v, wbit, 8 * (frame) + (fbit) ),    \
+                                V##_SET1( L36_MASK( width ) << (8 * (frame) + (fbit)) ) ) );
+
+#define VGET_SSE( ... ) VGET_PIECE( SSE, __VA_ARGS__ )
+#define VPUT_SSE( ... ) VPUT_PIECE( SSE, __VA_ARGS__ )
+#define VGET_AVX( ... ) VGET_PIECE( AVX, __VA_ARGS__ )
+#define VPUT_AVX( ... ) VPUT_PIECE( AVX, __VA_ARGS__ )
+
+/* A 36-bit value per lane to and from a wd36_T per lane (lh low) */
+
+#define V_SPLIT( V, v )                                                        \
+    V##_OR( V##_SRL( v, 18 ), V##_SLL( V##_AND( v, V##_SET1( M18 ) ), 32 ) )
+#define V_JOIN( V, x )                                                         \
+    V##_OR( V##_SLL( V##_AND( x, V##_SET1( M18 ) ), 18 ),                      \
+            V##_AND( V##_SRL( x, 32 ), V##_SET1( M18 ) ) )
+
+/* SSSE3: 2 words per iteration */
+
+#define LAYOUT_SSSE3( mode )                                                   \
+__attribute__((target("ssse3")))                                               \
+size_t unpack_gen_##mode##_ssse3(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) { \
+    const __m128i shuf = _mm_setr_epi8( SHUF16( UNPACK_IDX, mode##_FRAMES ) ); \
+    size_t wc, n;                                                              \
+                                                                               \
+    if( insize % mode##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = insize / mode##_FRAMES;                                               \
+    if( wc > maxwc )                                                           \
+        wc = maxwc;                                                            \
+                                                                               \
+    for( n = 0; n + 2 <= wc && insize - mode##_FRAMES * n >= 16; n += 2 ) {    \
+        __m128i x, v = SSE_ZERO();                                             \
+                                                                               \
+        x = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(inbuf + mode##_FRAMES * n) ), \
+                              shuf );                                          \
+        LAYOUT_##mode( VGET_SSE )                                              \
+        _mm_storeu_si128( (__m128i *)(outbuf + n), V_SPLIT( SSE, v ) );        \
+    }                                                                          \
+    if( n < wc )                                                               \
+        (void) unpack_gen_##mode( inbuf + mode##_FRAMES * n, mode##_FRAMES * (wc - n), \
+                                  outbuf + n, wc - n );                        \
+                                                                               \
+    return wc;                                                                 \
+}                                                                              \
+                                                                               \
+__attribute__((target("ssse3")))                                               \
+size_t pack_gen_##mode##_ssse3(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) { \
+    const __m128i shuf = _mm_setr_epi8( SHUF16( PACK_IDX, mode##_FRAMES ) );   \
+    size_t bc, n;                                                              \
+                                                                               \
+    bc = wc * mode##_FRAMES;                                                   \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    for( n = 0; n + 2 <= wc && bufsize - mode##_FRAMES * n >= 16; n += 2 ) {   \
+        __m128i x = SSE_ZERO(), v;                                             \
+                                                                               \
+        v = _mm_loadu_si128( (const __m128i *)(inbuf + n) );                   \
+        v = V_JOIN( SSE, v );                                                  \
+        LAYOUT_##mode( VPUT_SSE )                                              \
+        _mm_storeu_si128( (__m128i *)(outbuf + mode##_FRAMES * n),             \
+                          _mm_shuffle_epi8( x, shuf ) );                       \
+    }                                                                          \
+    if( n < wc )                                                               \
+        (void) pack_gen_##mode( inbuf + n, wc - n, outbuf + mode##_FRAMES * n, \
+                                bufsize - mode##_FRAMES * n );                 \
+                                                                               \
+    return bc;                                                                 \
+}
+
+/* AVX2: 4 words per iteration, a 128-bit lane of frames at a time */
+
+#define LAYOUT_AVX2( mode )                                                    \
+__attribute__((target("avx2")))                                                \
+size_t unpack_gen_##mode##_avx2(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) { \
+    const __m256i shuf = _mm256_setr_epi8( SHUF16( UNPACK_IDX, mode##_FRAMES ), \
+                                           SHUF16( UNPACK_IDX, mode##_FRAMES ) ); \
+    size_t wc, n;                                                              \
+                                                                               \
+    if( insize % mode##_FRAMES )                                               \
+        return (size_t)-1;                                                     \
+                                                                               \
+    wc = insize / mode##_FRAMES;                                               \
+    if( wc > maxwc )                                                           \
+        wc = maxwc;                                                            \
+                                                                               \
+    for( n = 0; n + 4 <= wc && insize - mode##_FRAMES * n >= 2 * mode##_FRAMES + 16; n += 4 ) { \
+        const uint8_t *p = inbuf + mode##_FRAMES * n;                          \
+        __m256i x, v = AVX_ZERO();                                             \
+                                                                               \
+        x = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)p ) ), \
+                                     _mm_loadu_si128( (const __m128i *)(p + 2 * mode##_FRAMES) ), 1 ); \
+        x = _mm256_shuffle_epi8( x, shuf );                                    \
+        LAYOUT_##mode( VGET_AVX )                                              \
+        _mm256_storeu_si256( (__m256i *)(outbuf + n), V_SPLIT( AVX, v ) );     \
+    }                                                                          \
+    if( n < wc )                                                               \
+        (void) unpack_gen_##mode##_ssse3( inbuf + mode##_FRAMES * n, mode##_FRAMES * (wc - n), \
+                                          outbuf + n, wc - n );                \
+                                                                               \
+    return wc;                                                                 \
+}                                                                              \
+                                                                               \
+__attribute__((target("avx2")))                                                \
+size_t pack_gen_##mode##_avx2(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) { \
+    const __m256i shuf = _mm256_setr_epi8( SHUF16( PACK_IDX, mode##_FRAMES ),  \
+                                           SHUF16( PACK_IDX, mode##_FRAMES ) ); \
+    size_t bc, n;                                                              \
+                                                                               \
+    bc = wc * mode##_FRAMES;                                                   \
+    if( bc > bufsize )                                                         \
+        abort();                                                               \
+                                                                               \
+    for( n = 0; n + 4 <= wc && bufsize - mode##_FRAMES * n >= 2 * mode##_FRAMES + 16; n += 4 ) { \
+        uint8_t *p = outbuf + mode##_FRAMES * n;                               \
+        __m256i x = AVX_ZERO(), v;                                             \
+                                                                               \
+        v = _mm256_loadu_si256( (const __m256i *)(inbuf + n) );                \
+        v = V_JOIN( AVX, v );                                                  \
+        LAYOUT_##mode( VPUT_AVX )                                              \
+        x = _mm256_shuffle_epi8( x, shuf );                                    \
+        _mm_storeu_si128( (__m128i *)p, _mm256_castsi256_si128( x ) );         \
+        _mm_storeu_si128( (__m128i *)(p + 2 * mode##_FRAMES), _mm256_extracti128_si256( x, 1 ) ); \
+    }                                                                          \
+    if( n < wc )                                                               \
+        (void) pack_gen_##mode##_ssse3( inbuf + n, wc - n, outbuf + mode##_FRAMES * n, \
+                                        bufsize - mode##_FRAMES * n );         \
+                                                                               \
+    return bc;                                                                 \
+}
+
+#define LAYOUT_VECTOR( mode ) \
+    LAYOUT_SSSE3( mode )      \
+    LAYOUT_AVX2( mode )
+
+LAYOUT_VECTOR( core_dump )
+LAYOUT_VECTOR( sixbit )
+LAYOUT_VECTOR( industry )
+LAYOUT_VECTOR( ansi_ascii )
+
+#endif /* SIMD36_X86 */
+
+/* EOF */
@@ -0,0 +1,180 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef LAYOUT36_H
+#define LAYOUT36_H
+
+#include <string.h>
+
+#include "data36.h"
+#include "simd36.h"
+
+/* Tape packing modes as bit layouts.
+ *
+ * A mode packs <mode>_WORDS words into a unit of <mode>_FRAMES frames.
+ * LAYOUT_<mode>( P ) lists the pieces of a unit, as
+ *
+ *   P( dir, frame, fbit, word, wbit, width )
+ *
+ * meaning that width bits of frame, from bit fbit, hold width bits of
+ * word (of the unit), from bit wbit.  Bits are counted from the right,
+ * so a word's bit 0 is the PDP-10's bit 35.  dir is BOTH, or GET or PUT
+ * for a piece that only unpacking or packing uses.  Frame bits that no
+ * piece puts are written as zero.
+ *
+ * layout36.c expands the lists into unrolled scalar kernels for every
+ * mode, and vector kernels for the modes that pack one word into at
+ * most 8 frames; data36.c expands them into its direct conversions.
+ * The hand-written pack and unpack functions in data36.c are the
+ * reference that bench36 -v checks these against.
+ */
+
+#define L36_GET  1
+#define L36_PUT  2
+#define L36_BOTH (L36_GET | L36_PUT)
+
+#define core_dump_WORDS  1
+#define core_dump_FRAMES 5
+#define LAYOUT_core_dump( P )      \
+    P( BOTH, 0, 0, 0, 28, 8 )      \
+    P( BOTH, 1, 0, 0, 20, 8 )      \
+    P( BOTH, 2, 0, 0, 12, 8 )      \
+    P( BOTH, 3, 0, 0,  4, 8 )      \
+    P( BOTH, 4, 0, 0,  0, 4 )
+
+#define sixbit_WORDS  1
+#define sixbit_FRAMES 6
+#define LAYOUT_sixbit( P )         \
+    P( BOTH, 0, 0, 0, 30, 6 )      \
+    P( BOTH, 1, 0, 0, 24, 6 )      \
+    P( BOTH, 2, 0, 0, 18, 6 )      \
+    P( BOTH, 3, 0, 0, 12, 6 )      \
+    P( BOTH, 4, 0, 0,  6, 6 )      \
+    P( BOTH, 5, 0, 0,  0, 6 )
+
+#define high_density_WORDS  2
+#define high_density_FRAMES 9
+#define LAYOUT_high_density( P )   \
+    P( BOTH, 0, 0, 0, 28, 8 )      \
+    P( BOTH, 1, 0, 0, 20, 8 )      \
+    P( BOTH, 2, 0, 0, 12, 8 )      \
+    P( BOTH, 3, 0, 0,  4, 8 )      \
+    P( BOTH, 4, 4, 0,  0, 4 )      \
+    P( BOTH, 4, 0, 1, 32, 4 )      \
+    P( BOTH, 5, 0, 1, 24, 8 )      \
+    P( BOTH, 6, 0, 1, 16, 8 )      \
+    P( BOTH, 7, 0, 1,  8, 8 )      \
+    P( BOTH, 8, 0, 1,  0, 8 )
+
+#define industry_WORDS  1
+#define industry_FRAMES 4
+#define LAYOUT_industry( P )       \
+    P( BOTH, 0, 0, 0, 28, 8 )      \
+    P( BOTH, 1, 0, 0, 20, 8 )      \
+    P( BOTH, 2, 0, 0, 12, 8 )      \
+    P( BOTH, 3, 0, 0,  4, 8 )
+
+/* Bit 35 is read from the parity bits of the first four frames, but
+ * written to the parity bit of the fifth.
+ */
+
+#define ansi_ascii_WORDS  1
+#define ansi_ascii_FRAMES 5
+#define LAYOUT_ansi_ascii( P )     \
+    P( BOTH, 0, 0, 0, 29, 7 )      \
+    P( BOTH, 1, 0, 0, 22, 7 )      \
+    P( BOTH, 2, 0, 0, 15, 7 )      \
+    P( BOTH, 3, 0, 0,  8, 7 )      \
+    P( BOTH, 4, 0, 0,  1, 7 )      \
+    P( GET,  0, 7, 0,  0, 1 )      \
+    P( GET,  1, 7, 0,  0, 1 )      \
+    P( GET,  2, 7, 0,  0, 1 )      \
+    P( GET,  3, 7, 0,  0, 1 )      \
+    P( PUT,  4, 7, 0,  0, 1 )
+
+/* A unit's frames to and from its words, as 36-bit values.
+ * layout36_get_<mode> ORs the words into w, which must start at zero.
+ * Every piece is a shift and mask with constant operands, so a unit
+ * expands to straight-line code.  Frames are put as bytes, so that the
+ * compiler can merge a get and a put that move whole frames into plain
+ * byte moves.  data36.c's direct conversions are built from these.
+ */
+
+#define L36_MASK( width ) ((UINT64_C(1) << (width)) - 1)
+
+#define GET_PIECE( dir, frame, fbit, word, wbit, width )                       \
+    if( L36_##dir & L36_GET )                                                  \
+        w[word] |= ((uint64_t)(p[frame] >> (fbit)) & L36_MASK( width )) << (wbit);
+
+#define PUT_PIECE( dir, frame, fbit, word, wbit, width )                       \
+    if( L36_##dir & L36_PUT )                                                  \
+        f[frame] |= (uint8_t)(((w[word] >> (wbit)) & L36_MASK( width )) << (fbit));
+
+#define LAYOUT_UNIT( mode )                                                    \
+static inline void layout36_get_##mode( const uint8_t *p, uint64_t *w ) {      \
+    LAYOUT_##mode( GET_PIECE )                                                 \
+}                                                                              \
+                                                                               \
+static inline void layout36_put_##mode( uint8_t *p, const uint64_t *w ) {      \
+    uint8_t f[mode##_FRAMES] = { 0 };                                          \
+                                                                               \
+    LAYOUT_##mode( PUT_PIECE )                                                 \
+    memcpy( p, f, mode##_FRAMES );                                             \
+}
+
+LAYOUT_UNIT( core_dump )
+LAYOUT_UNIT( sixbit )
+LAYOUT_UNIT( high_density )
+LAYOUT_UNIT( industry )
+LAYOUT_UNIT( ansi_ascii )
+
+/* The frame bits that packing writes in a unit of format, a byte per
+ * frame in mask; the others are always zero.  Returns the number of
+ * frames in a unit.
+ */
+
+#define LAYOUT36_MAXFRAMES 9
+
+size_t layout36_putmask( packformat_T format, uint8_t *mask );
+
+/* Generated kernels.  They behave as the data36.c functions of the
+ * same mode, except that unpacking stores no more than maxwc words.
+ */
+
+#define LAYOUT_DECLARE( mode )                                                                      \
+    size_t unpack_gen_##mode(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);   \
+    size_t pack_gen_##mode(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+
+LAYOUT_DECLARE( core_dump )
+LAYOUT_DECLARE( sixbit )
+LAYOUT_DECLARE( high_density )
+LAYOUT_DECLARE( industry )
+LAYOUT_DECLARE( ansi_ascii )
+
+#ifdef SIMD36_X86
+#define LAYOUT_DECLARE_VECTOR( mode, isa )                                                          \
+    size_t unpack_gen_##mode##_##isa(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc); \
+    size_t pack_gen_##mode##_##isa(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+
+LAYOUT_DECLARE_VECTOR( core_dump, ssse3 )
+LAYOUT_DECLARE_VECTOR( core_dump, avx2 )
+LAYOUT_DECLARE_VECTOR( sixbit, ssse3 )
+LAYOUT_DECLARE_VECTOR( sixbit, avx2 )
+LAYOUT_DECLARE_VECTOR( industry, ssse3 )
+LAYOUT_DECLARE_VECTOR( industry, avx2 )
+LAYOUT_DECLARE_VECTOR( ansi_ascii, ssse3 )
+LAYOUT_DECLARE_VECTOR( ansi_ascii, avx2 )
+#endif
+
+#endif
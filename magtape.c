@@ -21,21 +21,70 @@
  * simplifying assumptions:
  *  No support for update mode (reading and writing the same tape)
  *  No support for tapes written with 1/2 gaps.
+ *
+ * Input images that are regular files are mapped into memory, which
+ * allows records to be handed to the caller without copying them.
+ * stdin, pipes and anything else that can't be mapped use stdio.
+ *
+ * Optionally, input is read ahead by a thread into a ring buffer, from
+ * which records are taken.  Regular files are then read with pread at
+ * the ring's offset, so that seeking just restarts the ring.
+ *
+ * Regular files can instead be read and written asynchronously with
+ * io_uring (mtaio.c), optionally bypassing the page cache.
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE       /* copy_file_range, splice */
+#endif
+
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "magtape.h"
+#include "mtaio.h"
+#include "mtzip.h"
 
 #ifndef MTA_MIN_RECORD_SIZE
 #  define MTA_MIN_RECORD_SIZE 14
 #endif
 
+#ifndef MTA_WBUFSIZE
+#  define MTA_WBUFSIZE (1024 * 1024)
+#endif
+
+#ifndef MTA_RBUFSIZE        /* stdio buffer for unmapped input */
+#  define MTA_RBUFSIZE (256 * 1024)
+#endif
+
+#ifndef MTA_RAMIN           /* Smallest readahead ring */
+#  define MTA_RAMIN (64 * 1024)
+#endif
+
+#ifndef MTA_RACHUNK         /* Most read into the ring by one call */
+#  define MTA_RACHUNK (1024 * 1024)
+#endif
+
+#ifndef MTA_BATCH_ALIGN
+#  define MTA_BATCH_ALIGN 8
+#endif
+
+#ifndef MTA_COPYMAX         /* Largest range copied in one operation */
+#  define MTA_COPYMAX ((off_t)256 * 1024 * 1024)
+#endif
+
 /* Tape format */
 
     /* Metadata: stored little-endian */
@@ -67,15 +116,123 @@
 #define MIN_LENGTH (BOT_POS + EOT_POS + 1.0) /* Minimum tape length */
 #define TM_LENGTH 3.5     /* Length of a tape mark or erase gap (in) */
 
+/* Record index.
+ * File n's records are recs[files[n].first] up to the next file's first.
+ * Everything in the image before end has been indexed.
+ *
+ * The sidecar is little-endian:
+ *  header: magic[8], image size[8], image mtime[8], end[8],
+ *          nfiles[4], nrecs[4], complete[4], mtime ns[4]
+ *  files:  first record[4], offset[8], tape mark offset[8]
+ *  recs:   offset[8], length word[4]
+ */
+
+#define IDX_MAGIC "TAPIDX1\n"
+#define IDX_HDRSIZE 48
+#define IDX_FILESIZE 20
+#define IDX_RECSIZE 12
+#define IDX_NOMARK ((uint64_t)-1)
+
+struct mta_idxfile {
+    uint32_t first;         /* Index of first record */
+    uint64_t offset;        /* Offset of first frame after preceding tape mark */
+    uint64_t mark;          /* Offset of terminating tape mark or IDX_NOMARK */
+};
+
+struct mta_idxrec {
+    uint64_t offset;        /* Offset of leading length word */
+    uint32_t rectype;       /* Length word */
+};
+
+struct mta_index {
+    struct mta_idxfile *files;
+    struct mta_idxrec *recs;
+    uint32_t nfiles, maxfiles;
+    uint32_t nrecs, maxrecs;
+    off_t   end;
+    int     complete;
+    int     dirty;
+};
+
+/* Readahead ring.
+ * Offsets are image offsets; the frames from tail to head are in buf
+ * at offset % size.  The filler reads into the free space, outside the
+ * lock, and discards what it read if the ring was repositioned meanwhile
+ * (gen changed).  The consumer copies from the ring outside the lock too;
+ * the filler never writes to frames that haven't been consumed.
+ */
+
+struct mta_ring {
+    uint8_t *buf;
+    size_t  size;
+    off_t   head;           /* Image offset of the end of the frames read */
+    off_t   tail;           /* and of the next frame to be consumed */
+    off_t   base;           /* File offset of image offset 0 */
+    unsigned int gen;       /* Incremented by each reposition */
+    int     fd;
+    int     seekable;       /* Read with pread, else with read */
+    int     eof;
+    int     error;          /* errno of a failed read */
+    int     stop;
+    pthread_mutex_t lock;
+    pthread_cond_t data, space;
+    pthread_t filler;
+};
+
 static int update_pos( MAGTAPE *mta, const double distance );
+static void map_image( MAGTAPE *mta );
+static size_t get_frames( MAGTAPE *mta, void *buffer, size_t length );
+static size_t view_frames( MAGTAPE *mta, const uint8_t **data, size_t length );
+static size_t skip_frames( MAGTAPE *mta, size_t length );
+static int set_offset( MAGTAPE *mta, off_t offset );
+static int open_zip( MAGTAPE *mta );
+static ssize_t zip_source( void *arg, void *buffer, size_t length );
+static size_t source_read( MAGTAPE *mta, void *buffer, size_t length );
+static int source_failed( MAGTAPE *mta );
+static int read_failed( MAGTAPE *mta );
+static size_t readahead_depth( void );
+static int aio_flags( const char *flags );
+static int ring_start( MAGTAPE *mta, size_t depth );
+static void *ring_fill( void *arg );
+static size_t ring_read( struct mta_ring *r, uint8_t *buffer, size_t length );
+static size_t ring_peek( struct mta_ring *r, uint8_t *buffer, size_t length );
+static size_t ring_skip( struct mta_ring *r, size_t length );
+static void ring_seek( struct mta_ring *r, off_t offset );
+static void ring_stop( struct mta_ring *r );
+static unsigned int write_buffer( MAGTAPE *mta );
+static unsigned int put_frames( MAGTAPE *mta, struct iovec *iov, int iovcnt );
+static int write_all( MAGTAPE *mta, struct iovec *iov, int iovcnt );
+static unsigned int flush_policy( MAGTAPE *mta, int mark );
+static unsigned int copy_pending( MAGTAPE *mta );
+static int copy_range( MAGTAPE *out, MAGTAPE *in, off_t start, off_t end );
+static unsigned int get_word_at( MAGTAPE *mta, off_t offset, uint32_t *word );
+static unsigned int reverse_record( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen,
+                                    uint32_t *recsize );
+static int after_mark( MAGTAPE *mta, off_t offset );
+static uint32_t count_back( MAGTAPE *mta, off_t offset );
+static void unwind_pos( MAGTAPE *mta, const double distance );
+static double index_reelpos( MAGTAPE *mta, uint32_t file, uint32_t record );
+static void count_record( MAGTAPE *mta, uint32_t rectype );
+static uint64_t elapsed_ns( const struct timespec *start );
+static unsigned int read_record( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen,
+                                 const uint8_t **data, uint32_t *recsize );
+static struct mta_index *index_new( void );
+static void index_free( struct mta_index *idx );
+static void index_note( MAGTAPE *mta, off_t start, uint32_t rectype );
+static unsigned int index_scan( MAGTAPE *mta, uint32_t file, uint32_t record );
+static int index_load( MAGTAPE *mta );
+static int index_save( MAGTAPE *mta );
 
 MAGTAPE *magtape_open( const char *filename, const char *mode ) {
     MAGTAPE *mta;
+    int aio;
     
-    if( strcmp( mode, "r" ) && strcmp( mode, "w" ) ) {
+    if( (mode[0] != 'r' && mode[0] != 'w') ||
+        strspn( mode + 1, "ud" ) != strlen( mode + 1 ) ) {
         fprintf( stderr, "magtape_open: invalid mode %s\n", mode );
         exit( 1 );
     }
+    aio = aio_flags( mode + 1 );
 
     mta = calloc( 1, sizeof( *mta ) );
     if( mta == NULL )
@@ -87,7 +244,7 @@ MAGTAPE *magtape_open( const char *filename, const char *mode ) {
         return NULL;
     }
 
-    if( !strcmp( mode, "w" ) )
+    if( mode[0] == 'w' )
         mta->status |= MTS_WRITE;
 
     if( !strcmp( filename, "-" ) ) {
@@ -103,6 +260,47 @@ MAGTAPE *magtape_open( const char *filename, const char *mode ) {
             return NULL;
         }
     }
+    if( !(mta->status & MTS_WRITE) ) {
+        struct stat st;
+        size_t depth = readahead_depth();
+
+        /* Input that won't be mapped is read ahead or in large blocks */
+
+        if( aio < 0 && depth && ring_start( mta, depth ) == 0 ) {
+            ;
+        } else if( !strcmp( filename, "-" ) ||
+            fstat( fileno( mta->fd ), &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+            mta->rbuf = malloc( MTA_RBUFSIZE );
+            if( mta->rbuf != NULL &&
+                setvbuf( mta->fd, (char *)mta->rbuf, _IOFBF, MTA_RBUFSIZE ) != 0 ) {
+                free( mta->rbuf );
+                mta->rbuf = NULL;
+            }
+        }
+    }
+    if( open_zip( mta ) != 0 ) {
+        int err = errno;
+
+        if( mta->ring )
+            ring_stop( mta->ring );
+        if( strcmp( filename, "-" ) ) {
+            (void) fclose( mta->fd );
+            free( mta->rbuf );
+        }                       /* stdin keeps its buffer */
+        free(mta->filename);
+        free(mta);
+        errno = err;
+        return NULL;
+    }
+    if( aio >= 0 && mta->ring == NULL && mta->npeek == 0 &&
+        !((mta->status & MTS_WRITE) && mta->zip) ) { /* Else stdio */
+        mta->aio = (mta->status & MTS_WRITE)?
+            mtaio_open_write( fileno( mta->fd ), aio ):
+            mtaio_open_read( fileno( mta->fd ), aio );
+    }
+    if( !(mta->status & MTS_WRITE) && mta->zip == NULL && mta->npeek == 0 &&
+        mta->ring == NULL && mta->aio == NULL && strcmp( filename, "-" ) )
+        map_image( mta );
     mta->reellen = 0.0;
     mta->reelpos = 0.0;
 
@@ -166,26 +364,131 @@ int magtape_setsize( MAGTAPE *mta, const char *length, const char *density ) {
 }
 
 unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen, uint32_t *recsize ) {
+    return read_record( mta, buffer, maxlen, NULL, recsize );
+}
+
+unsigned int magtape_read_view( MAGTAPE *mta, const uint8_t **data, uint32_t *recsize ) {
+    *data = NULL;
+
+    return read_record( mta, NULL, 0, data, recsize );
+}
+
+size_t magtape_read_batch( MAGTAPE *mta, uint8_t *arena, size_t arenasize,
+                           mta_recdesc *desc, size_t maxdesc ) {
+    size_t n = 0, used = 0;
+
+    /* The stream is locked once for the batch, rather than by each fread */
+
+    if( !(mta->status & MTS_MAPPED) )
+        flockfile( mta->fd );
+
+    while( n < maxdesc ) {
+        mta_recdesc *d = desc + n;
+        unsigned int rc;
+        uint32_t recsize;
+
+        used = (used + MTA_BATCH_ALIGN - 1) & ~(size_t)(MTA_BATCH_ALIGN - 1);
+        if( used > arenasize )
+            used = arenasize;
+        d->offset = used;
+
+        /* A record that doesn't fit is held by read_record.  Unless the
+         * batch is empty, leave it for the next one.
+         */
+
+        rc = read_record( mta, arena + used, arenasize - used, NULL, &recsize );
+        if( rc == MTA_BTL && n != 0 )
+            break;
+
+        d->length = (rc == MTA_OK || rc == MTA_ERR || rc == MTA_BTL)? recsize: 0;
+        d->status = rc;
+        d->filenum = mta->filenum;
+        d->blocknum = mta->blocknum;
+        n++;
+        if( rc != MTA_OK && rc != MTA_ERR )
+            break;
+        used += recsize;
+    }
+
+    if( !(mta->status & MTS_MAPPED) )
+        funlockfile( mta->fd );
+
+    return n;
+}
+
+unsigned int magtape_skip_record( MAGTAPE *mta, uint32_t *recsize ) {
+    /* Only the length words will be touched, so don't read ahead */
+
+    if( (mta->status & (MTS_MAPPED | MTS_SKIPPING)) == MTS_MAPPED ) {
+        (void) madvise( mta->map, mta->mapsize, MADV_RANDOM );
+        mta->status |= MTS_SKIPPING;
+    }
+
+    return read_record( mta, NULL, 0, NULL, recsize );
+}
+
+unsigned int magtape_skip_file( MAGTAPE *mta, uint32_t *records ) {
+    unsigned int rc;
+    uint32_t recsize, n = 0;
+
+    while( (rc = magtape_skip_record( mta, &recsize )) == MTA_OK || rc == MTA_ERR )
+        n++;
+
+    if( records )
+        *records = n;
+    return rc;
+}
+
+/* Read one record.  If data is NULL, the frames are copied to buffer;
+ * otherwise *data is pointed at them.  If both are NULL, the frames are
+ * skipped.
+ */
+
+static unsigned int read_record( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen,
+                                 const uint8_t **data, uint32_t *recsize ) {
     *recsize = 0;
 
     if( mta->status & MTS_WRITE )
         abort();
 
+    if( mta->pending ) {    /* Return the record held by MTA_BTL again */
+        const uint8_t *frames = mta->pending;
+        uint32_t length = mta->lasttype & MT_CNT;
+
+        mta->pending = NULL;
+        *recsize = length;
+        if( data ) {
+            *data = frames;
+        } else if( buffer ) {
+            if( length > maxlen ) {
+                memcpy( buffer, frames, maxlen );
+                mta->pending = frames;
+                return MTA_BTL;
+            }
+            memcpy( buffer, frames, length );
+        }
+        return (mta->lasttype & MT_ERR)? MTA_ERR: MTA_OK;
+    }
+
     while( 1 ) {
         uint32_t rectype, endtype, length;
         uint8_t bytes[4];
-        int n;
+        const uint8_t *frames = NULL;
+        size_t n;
         unsigned int rc;
+        off_t start;
 
         if( mta->status & (MTS_ERROR | MTS_EOM) )
             return MTA_EOM;
 
-        n = fread(bytes, sizeof(uint8_t), 4, mta->fd);
+        start = mta->offset;
+        n = get_frames( mta, bytes, 4 );
         if (n != 4) {
             mta->status |= MTS_ERROR;
-            if( ferror( mta->fd ) )
+            if( read_failed( mta ) )
                 return MTA_IOE;
             if( n == 0 ) { /* This is EOF without an EOM marker */
+                index_note( mta, start, MT_EOM );
                 return MTA_EOM;
             }
             return MTA_FMT;
@@ -195,6 +498,10 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
             ((unsigned long) bytes[1] <<  8) | (bytes[0]);
 
         if (rectype == MT_TM) {
+            index_note( mta, start, rectype );
+            mta->laststart = start;
+            mta->lasttype = rectype;
+            mta->stats.marks++;
             mta->filenum++;
             mta->reelpos += 3.0;
             if( mta->status & MTS_TM ) {
@@ -206,6 +513,7 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
         }
 
         if( rectype == MT_GAP ) {
+            index_note( mta, start, rectype );
             (void) update_pos( mta, TM_LENGTH );
             continue;
         }
@@ -216,6 +524,7 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
         }
 
         if( rectype == MT_EOM ) {
+            index_note( mta, start, rectype );
             mta->status |= MTS_EOM;
             return MTA_EOM;
         }
@@ -239,37 +548,53 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
             rc = MTA_ERR;
         }
 
-        if (length > maxlen ) {
+        if( data ) {
+            *recsize = length;
+            n = view_frames( mta, data, length );
+            if( *data == NULL ) {
+                mta->status |= MTS_ERROR;
+                return MTA_IOE;
+            }
+        } else if( buffer && length > maxlen ) {
+            /* Read it all, so the record can be returned again */
             rc = MTA_BTL;
             *recsize = length;
-            length = maxlen;
+            n = view_frames( mta, &frames, length );
+            if( frames == NULL ) {
+                mta->status |= MTS_ERROR;
+                return MTA_IOE;
+            }
+            if( n == length )
+                memcpy( buffer, frames, maxlen );
+        } else if( buffer ) {
+            *recsize = length;
+            n = get_frames( mta, buffer, length );
         } else {
             *recsize = length;
+            n = skip_frames( mta, length );
         }
-
-        n = fread(buffer, sizeof(uint8_t), length, mta->fd);
-        if( (size_t)n != length ) {
+        if( n != length ) {
             *recsize = n;
             mta->status |= MTS_ERROR;
-            if( ferror( mta->fd ) )
+            if( read_failed( mta ) )
                 return MTA_IOE;
             return MTA_FMT;
         }
 
         if( length & 1 ) {
-            n = fread(bytes, sizeof(uint8_t), 1, mta->fd);
+            n = get_frames( mta, bytes, 1 );
             if (n != 1) {
                 mta->status |= MTS_ERROR;
-                if( ferror( mta->fd ) )
+                if( read_failed( mta ) )
                     return MTA_IOE;
                 return MTA_FMT;
             }
         }
 
-        n = fread(bytes, sizeof(uint8_t), 4, mta->fd);
+        n = get_frames( mta, bytes, 4 );
         if (n != 4) {
             mta->status |= MTS_ERROR;
-            if( ferror( mta->fd ) )
+            if( read_failed( mta ) )
                 return MTA_IOE;
             return MTA_FMT;
         }
@@ -280,58 +605,298 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
             mta->status |= MTS_ERROR;
             return MTA_FMT;
         }
+        index_note( mta, start, rectype );
 
         if( length < MTA_MIN_RECORD_SIZE ) {
-            fprintf( stderr, "Noise record (length = %" PRId32 ") at ", length );
-            magtape_pprintf( stderr, mta, 1 );
+            mta->stats.noise++;
+            if( buffer || data || (mta->status & MTS_NOISY) )
+                magtape_report( mta->tag, mta, "Noise record (length = %" PRIu32 ") at ", length );
             continue;
         }
 
+        mta->laststart = start;
+        mta->lasttype = rectype;
+        if( rc == MTA_BTL )
+            mta->pending = frames;
+        count_record( mta, rectype );
         return rc;
     }
 }
 
-unsigned int magtape_write( MAGTAPE *mta, unsigned char *buffer, const size_t recsize ) {
-    uint8_t bytes[4];
-    size_t n;
+unsigned int magtape_read_reverse( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen, uint32_t *recsize ) {
+    return reverse_record( mta, buffer, maxlen, recsize );
+}
 
-    if( !(mta->status & MTS_WRITE) )
+unsigned int magtape_backspace_record( MAGTAPE *mta, uint32_t *recsize ) {
+    return reverse_record( mta, NULL, 0, recsize );
+}
+
+unsigned int magtape_backspace_file( MAGTAPE *mta, uint32_t *records ) {
+    unsigned int rc;
+    uint32_t recsize, n = 0;
+
+    while( (rc = reverse_record( mta, NULL, 0, &recsize )) == MTA_OK || rc == MTA_ERR )
+        n++;
+
+    if( records )
+        *records = n;
+    return rc;
+}
+
+/* Read one record backwards.  The trailing length word is checked
+ * against the leading one.  If buffer is NULL, the frames are skipped.
+ */
+
+static unsigned int reverse_record( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen,
+                                    uint32_t *recsize ) {
+    off_t pos;
+    unsigned int rc;
+
+    *recsize = 0;
+
+    if( mta->status & MTS_WRITE )
         abort();
 
-    if( mta->status & MTS_EOM )
-        return MTA_EOM;
+    if( mta->pending ) {    /* Logically, the held record is still ahead */
+        uint32_t held;
 
-    if( recsize & MT_MBZ ) {
-        fprintf( stderr, "Record too long (%" PRId32 ") for TAP format\n", recsize );
-        exit( 1 );
+        mta->pending = NULL;
+        rc = reverse_record( mta, NULL, 0, &held );
+        if( rc != MTA_OK && rc != MTA_ERR )
+            return rc;
     }
 
-    bytes[0] = recsize & 0xFF;
-    bytes[1] = (recsize >>  8) & 0xFF;
-    bytes[2] = (recsize >> 16) & 0xFF;
-    bytes[3] = 0;
+    if( mta->status & MTS_ERROR )
+        return MTA_EOM;
 
-    n = fwrite( bytes, sizeof( uint8_t ), 4, mta->fd );
-    if( n != 4 ) {
-        mta->status |= MTS_ERROR;
-        return MTA_IOE;
+    pos = mta->offset;
+    while( 1 ) {
+        uint32_t rectype, hdrtype, length;
+        off_t start;
+
+        if( pos == 0 ) {
+            mta->status &= ~(MTS_TM | MTS_EOM);
+            rc = MTA_BOT;
+            break;
+        }
+        if( pos < 4 ) {
+            mta->status |= MTS_ERROR;
+            return MTA_FMT;
+        }
+        rc = get_word_at( mta, pos - 4, &rectype );
+        if( rc != MTA_OK )
+            return rc;
+
+        if( rectype == MT_EOM ) {
+            pos -= 4;
+            continue;
+        }
+        if( rectype == MT_GAP ) {
+            pos -= 4;
+            unwind_pos( mta, TM_LENGTH );
+            continue;
+        }
+        if( rectype == MT_TM ) {
+            pos -= 4;
+            mta->reelpos -= 3.0;
+            if( !(mta->status & MTS_NOPOS) ) {
+                if( mta->filenum )
+                    mta->filenum--;
+                mta->blocknum = count_back( mta, pos );
+            }
+            mta->status &= ~MTS_EOM;
+            rc = MTA_TM;
+            break;
+        }
+        if( rectype & MT_MBZ || MT_RSVD(rectype) ) {
+            mta->status |= MTS_ERROR;
+            return MTA_FMT;
+        }
+
+        length = rectype & MT_CNT;
+        start = pos - 8 - (off_t)((length + 1) & ~1u);
+        if( start < 0 ) {
+            mta->status |= MTS_ERROR;
+            return MTA_FMT;
+        }
+        rc = get_word_at( mta, start, &hdrtype );
+        if( rc != MTA_OK )
+            return rc;
+        if( hdrtype != rectype ) {
+            mta->status |= MTS_ERROR;
+            return MTA_FMT;
+        }
+
+        rc = (rectype & MT_ERR)? MTA_ERR: MTA_OK;
+        *recsize = length;
+        if( buffer ) {
+            size_t n, want = length;
+
+            if( want > maxlen ) {
+                rc = MTA_BTL;
+                want = maxlen;
+            }
+            if( set_offset( mta, start + 4 ) != 0 ) {
+                mta->status |= MTS_ERROR;
+                return MTA_IOE;
+            }
+            n = get_frames( mta, buffer, want );
+            if( n != want ) {
+                mta->status |= MTS_ERROR;
+                if( read_failed( mta ) )
+                    return MTA_IOE;
+                return MTA_FMT;
+            }
+        }
+
+        pos = start;
+        if( mta->blocknum )
+            mta->blocknum--;
+        if( mta->reellen )
+            unwind_pos( mta, mta->irg + ((double)(length+9) / mta->density) );
+        mta->status &= ~MTS_EOM;
+
+        if( length < MTA_MIN_RECORD_SIZE ) {
+            mta->stats.noise++;
+            if( buffer || (mta->status & MTS_NOISY) )
+                magtape_report( mta->tag, mta, "Noise record (length = %" PRIu32 ") at ", length );
+            continue;
+        }
+        break;
     }
 
-    n = fwrite( buffer, sizeof( uint8_t ), recsize, mta->fd );
-    if( n != recsize ) {
+    if( set_offset( mta, pos ) != 0 ) {
         mta->status |= MTS_ERROR;
         return MTA_IOE;
     }
+    mta->status &= ~MTS_TM;
+    if( after_mark( mta, pos ) )
+        mta->status |= MTS_TM;
+
+    return rc;
+}
+
+unsigned int magtape_eom( MAGTAPE *mta ) {
+    struct mta_index *idx;
+    off_t end;
+    uint32_t word;
+    unsigned int rc;
+
+    if( mta->status & MTS_WRITE )
+        abort();
+
+    mta->pending = NULL;
+    if( mta->status & MTS_MAPPED ) {
+        end = (off_t)mta->mapsize;
+    } else {
+        if( mta->zip || mta->npeek || (mta->ring && !mta->ring->seekable) ) {
+            mta->status |= MTS_ERROR;
+            errno = ESPIPE;
+            return MTA_IOE;
+        }
+        if( mta->ring || mta->aio ) { /* The file isn't moved from the image's start */
+            off_t base = lseek( fileno( mta->fd ), 0, SEEK_CUR );
+            struct stat st;
 
-    n = fwrite( bytes, sizeof( uint8_t ), 4, mta->fd );
-    if( n != 4 ) {
+            if( base < 0 || fstat( fileno( mta->fd ), &st ) != 0 ) {
+                mta->status |= MTS_ERROR;
+                return MTA_IOE;
+            }
+            end = st.st_size - base;
+        } else if( fseeko( mta->fd, 0, SEEK_END ) != 0 ||
+                   (end = ftello( mta->fd )) < 0 ) {
+            mta->status |= MTS_ERROR;
+            return MTA_IOE;
+        }
+    }
+    mta->status &= ~(MTS_ERROR | MTS_EOM | MTS_TM | MTS_EOT);
+
+    if( end >= 4 ) {
+        rc = get_word_at( mta, end - 4, &word );
+        if( rc != MTA_OK )
+            return rc;
+        if( word == MT_EOM )
+            end -= 4;
+    }
+    if( set_offset( mta, end ) != 0 ) {
         mta->status |= MTS_ERROR;
         return MTA_IOE;
     }
+    if( after_mark( mta, end ) )
+        mta->status |= MTS_TM;
+
+    idx = mta->index;
+    if( idx == NULL || !idx->complete ) {
+        mta->status |= MTS_NOPOS;
+        return MTA_OK;
+    }
+    mta->status &= ~MTS_NOPOS;
+    mta->filenum = idx->nfiles -1;
+    mta->blocknum = idx->nrecs - idx->files[idx->nfiles-1].first;
+    if( mta->reellen ) {
+        mta->reelpos = index_reelpos( mta, mta->filenum, mta->blocknum );
+        if( mta->reelpos >= mta->eotpos )
+            mta->status |= MTS_EOT;
+    }
+    return MTA_OK;
+}
+
+unsigned int magtape_write( MAGTAPE *mta, unsigned char *buffer, const size_t recsize ) {
+    static uint8_t zero;
+    uint8_t head[4], tail[5];
+    struct iovec iov[4];
+    uint32_t rectype, length;
+    unsigned int rc;
+    off_t start;
+
+    if( !(mta->status & MTS_WRITE) )
+        abort();
+
+    if( mta->status & MTS_EOM )
+        return MTA_EOM;
+
+    if( recsize & ~(size_t)(MT_ERR | MT_CNT) ) {
+        magtape_report( mta->tag, NULL, "Record too long (%zu) for TAP format\n",
+                        recsize & ~(size_t)MT_ERR );
+        exit( 1 );
+    }
+
+    rectype = (uint32_t)recsize;
+    length = rectype & MT_CNT;
+
+    start = mta->offset;
+    head[0] = rectype & 0xFF;
+    head[1] = (rectype >>  8) & 0xFF;
+    head[2] = (rectype >> 16) & 0xFF;
+    head[3] = (rectype >> 24) & 0xFF;
+    memcpy( tail, head, 4 );
+
+    /* Frames written is always even */
+
+    iov[0].iov_base = head;
+    iov[0].iov_len = 4;
+    iov[1].iov_base = buffer;
+    iov[1].iov_len = length;
+    iov[2].iov_base = &zero;
+    iov[2].iov_len = length & 1;
+    iov[3].iov_base = tail;
+    iov[3].iov_len = 4;
+
+    rc = put_frames( mta, iov, 4 );
+    if( rc != MTA_OK )
+        return rc;
+
+    mta->offset += 4 + length + (length & 1) + 4;
+    index_note( mta, start, rectype );
+    count_record( mta, rectype );
     mta->blocknum++;
     if( mta->reellen )
             (void) update_pos( mta, mta->irg +
-                               ((double)(recsize+9) / mta->density) );
+                               ((double)(length+9) / mta->density) );
+
+    rc = flush_policy( mta, 0 );
+    if( rc != MTA_OK )
+        return rc;
 
     if( mta->status & MTS_EOT ) {
         mta->status &= ~MTS_EOT;
@@ -342,8 +907,9 @@ unsigned int magtape_write( MAGTAPE *mta, unsigned char *buffer, const size_t re
 
 unsigned int magtape_mark( MAGTAPE *mta, mta_marktype type ) {
     uint8_t bytes[4];
+    struct iovec iov;
     uint32_t code;
-    int n;
+    unsigned int rc;
 
     if( !(mta->status & MTS_WRITE) )
         abort();
@@ -351,6 +917,7 @@ unsigned int magtape_mark( MAGTAPE *mta, mta_marktype type ) {
     switch( type ) {
     case MTA_EOF_MARK:
         code = MT_TM;
+        mta->stats.marks++;
         mta->blocknum = 0;
         mta->filenum++;
         (void) update_pos( mta, TM_LENGTH );
@@ -371,51 +938,1596 @@ unsigned int magtape_mark( MAGTAPE *mta, mta_marktype type ) {
     bytes[2] = (code >> 16) & 0xFF;
     bytes[3] = (code >> 24) & 0xFF;
 
-    n = fwrite( bytes, sizeof( uint8_t ), 4, mta->fd );
-    if( n != 4 ) {
+    iov.iov_base = bytes;
+    iov.iov_len = 4;
+    rc = put_frames( mta, &iov, 1 );
+    if( rc != MTA_OK )
+        return rc;
+    mta->offset += 4;
+    index_note( mta, mta->offset - 4, code );
+
+    return flush_policy( mta, 1 );
+}
+
+unsigned int magtape_setflush( MAGTAPE *mta, mta_flushpolicy policy, int sync ) {
+    if( !(mta->status & MTS_WRITE) )
+        abort();
+
+    mta->flush = policy;
+    mta->sync = sync;
+
+    return flush_policy( mta, 1 );
+}
+
+unsigned int magtape_flush( MAGTAPE *mta, int sync ) {
+    if( !(mta->status & MTS_WRITE) )
+        abort();
+
+    if( mta->copyin && copy_pending( mta ) != MTA_OK )
+        return MTA_IOE;
+
+    if( write_buffer( mta ) != MTA_OK )
+        return MTA_IOE;
+    if( mta->zip && mtzip_flush( mta->zip ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    if( mta->aio && mtaio_flush( mta->aio ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    if( sync && fdatasync( fileno( mta->fd ) ) != 0 &&
+        errno != EINVAL && errno != EROFS ) { /* Not a file: nothing to do */
         mta->status |= MTS_ERROR;
         return MTA_IOE;
     }
-
     return MTA_OK;
 }
 
-void magtape_pprintf( FILE *out, MAGTAPE *mta, int nl ) {
-    fprintf( out, "file %" PRIu32 ", record %" PRIu32, mta->filenum, mta->blocknum );
-    if( mta->reellen ) {
-        if( mta->status & MTS_METRIC )
-            fprintf( out, " (%.1fm)", mta->reelpos / 39.3701 );
-        else
-            fprintf( out, " (%.1fft)", mta->reelpos / 12 );
+unsigned int magtape_copy_last( MAGTAPE *out, MAGTAPE *in ) {
+    uint32_t length;
+    off_t size, start;
+    unsigned int rc;
+
+    if( !(out->status & MTS_WRITE) || (in->status & MTS_WRITE) )
+        abort();
+
+    if( out->status & MTS_EOM )
+        return MTA_EOM;
+
+    if( !(in->status & MTS_MAPPED) ) {
+        if( in->lasttype == MT_TM )
+            return magtape_mark( out, MTA_EOF_MARK );
+        return magtape_write( out, in->recbuf, in->lasttype );
     }
-    fprintf( out, " of %s%s",
-              mta->filename, nl? "\n": "" );
-}
+    if( out->status & MTS_ERROR )
+        return MTA_IOE;
 
-static int update_pos( MAGTAPE *mta, const double distance ) {
-    double oldpos;
+    length = in->lasttype & MT_CNT;
+    size = (in->lasttype == MT_TM)? 4: 8 + (off_t)((length + 1) & ~1u);
 
-    if( !mta->reellen )
-        return 0;
+    if( out->copyin &&
+        ( out->copyin != in || out->copyend != in->laststart ||
+          out->copyend - out->copystart >= MTA_COPYMAX ) &&
+        copy_pending( out ) != MTA_OK )
+        return MTA_IOE;
+    if( !out->copyin ) {
+        out->copyin = in;
+        out->copystart =
+            out->copyend = in->laststart;
+    }
+    out->copyend += size;
+
+    start = out->offset;
+    out->offset += size;
+    index_note( out, start, in->lasttype );
+
+    if( in->lasttype == MT_TM ) {
+        out->stats.marks++;
+        out->blocknum = 0;
+        out->filenum++;
+        (void) update_pos( out, TM_LENGTH );
+        return flush_policy( out, 1 );
+    }
 
-    oldpos = mta->reelpos;
-    mta->reelpos += distance;
-    if( oldpos < mta->eotpos && mta->reelpos >= mta->eotpos ) {
-        mta->status |= MTS_EOT;
-        return 1;
+    count_record( out, in->lasttype );
+    out->blocknum++;
+    if( out->reellen )
+        (void) update_pos( out, out->irg + ((double)(length+9) / out->density) );
+
+    rc = flush_policy( out, 0 );
+    if( rc != MTA_OK )
+        return rc;
+
+    if( out->status & MTS_EOT ) {
+        out->status &= ~MTS_EOT;
+        return MTA_EOT;
     }
-    return 0;
+    return MTA_OK;
 }
 
-void magtape_close( MAGTAPE **mta ) {
-    if( (mta[0]->status & MTS_WRITE) && !(mta[0]->status & MTS_EOM) ) {
-        if( magtape_mark( *mta, MTA_EOM_MARK ) != MTA_OK )
-            fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+unsigned int magtape_reserve( MAGTAPE *mta, off_t length, const mta_stats *counts,
+                              uint32_t blocknum, int *fd, off_t *offset ) {
+    struct stat st;
+    off_t pos;
+    int b;
+
+    if( !(mta->status & MTS_WRITE) )
+        abort();
+
+    if( mta->status & MTS_EOM )
+        return MTA_EOM;
+    if( mta->status & MTS_ERROR )
+        return MTA_IOE;
+
+    if( mta->zip || mta->aio || mta->index ||
+        fstat( fileno( mta->fd ), &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+        errno = ESPIPE;
+        return MTA_IOE;
     }
+    if( mta->copyin && copy_pending( mta ) != MTA_OK )
+        return MTA_IOE;
+    if( write_buffer( mta ) != MTA_OK )
+        return MTA_IOE;
 
-    if( fclose( mta[0]->fd ) )
-        fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+    pos = lseek( fileno( mta->fd ), 0, SEEK_CUR );
+    if( pos < 0 || lseek( fileno( mta->fd ), pos + length, SEEK_SET ) < 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    *fd = fileno( mta->fd );
+    *offset = pos;
+    mta->offset += length;
+
+    mta->stats.records += counts->records;
+    mta->stats.errors += counts->errors;
+    mta->stats.marks += counts->marks;
+    mta->stats.frames += counts->frames;
+    for( b = 0; b < MTA_SIZE_BUCKETS; b++ )
+        mta->stats.sizes[b] += counts->sizes[b];
+    if( counts->marks ) {
+        mta->filenum += (uint32_t)counts->marks;
+        mta->blocknum = blocknum;
+    } else {
+        mta->blocknum += blocknum;
+    }
+    return MTA_OK;
+}
+
+/* Write the output buffer.  Compressed output may remain in the
+ * compressor until magtape_flush.
+ */
+
+static unsigned int write_buffer( MAGTAPE *mta ) {
+    struct iovec iov;
+
+    if( mta->wbuflen ) {
+        iov.iov_base = mta->wbuf;
+        iov.iov_len = mta->wbuflen;
+        mta->wbuflen = 0;
+        if( write_all( mta, &iov, 1 ) != 0 ) {
+            mta->status |= MTS_ERROR;
+            return MTA_IOE;
+        }
+    }
+    return MTA_OK;
+}
+
+/* Write the output buffer, then the pending range.
+ */
+
+static unsigned int copy_pending( MAGTAPE *mta ) {
+    MAGTAPE *in = mta->copyin;
+
+    mta->copyin = NULL;
+
+    if( write_buffer( mta ) != MTA_OK )
+        return MTA_IOE;
+    if( copy_range( mta, in, mta->copystart, mta->copyend ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    return MTA_OK;
+}
+
+/* Copy part of a mapped input image to the output's current position.
+ * Use the kernel if it can do it, otherwise write from the mapping.
+ * Returns 0, or -1 with errno set.
+ */
+
+static int copy_range( MAGTAPE *out, MAGTAPE *in, off_t start, off_t end ) {
+    int infd = fileno( in->fd ), outfd = fileno( out->fd );
+    struct iovec iov;
+
+#ifdef __linux__
+    if( out->zip == NULL && out->aio == NULL ) {
+        loff_t off = start;
+        struct timespec t0;
+        ssize_t n;
+
+        clock_gettime( CLOCK_MONOTONIC, &t0 );
+        while( off < end ) {
+            n = copy_file_range( infd, &off, outfd, NULL, (size_t)(end - off), 0 );
+            out->stats.writes++;
+            if( n <= 0 )
+                break;
+        }
+        while( off < end ) {
+            n = splice( infd, &off, outfd, NULL, (size_t)(end - off), SPLICE_F_MORE );
+            out->stats.writes++;
+            if( n <= 0 )
+                break;
+        }
+        out->stats.writens += elapsed_ns( &t0 );
+        out->stats.written += (uint64_t)(off - start);
+        start = off;
+    }
+#else
+    (void) infd;
+    (void) outfd;
+#endif
+    if( start >= end )
+        return 0;
+
+    iov.iov_base = in->map + start;
+    iov.iov_len = (size_t)(end - start);
+    return write_all( out, &iov, 1 );
+}
+
+/* Apply the flush policy after a record or mark */
+
+static unsigned int flush_policy( MAGTAPE *mta, int mark ) {
+    if( mta->flush == MTA_FLUSH_RECORD || (mark && mta->flush == MTA_FLUSH_MARK) )
+        return magtape_flush( mta, mta->sync );
+
+    return MTA_OK;
+}
+
+/* Queue frames for output.
+ * Frames are copied to the output buffer if they fit, flushing it if
+ * necessary.  Anything larger than the buffer is written immediately,
+ * preceded by the buffer's contents, with a single writev.
+ * If the buffer can't be allocated, output is unbuffered.
+ */
+
+static unsigned int put_frames( MAGTAPE *mta, struct iovec *iov, int iovcnt ) {
+    struct iovec wiov[8];
+    size_t total = 0;
+    int i;
+
+    if( mta->status & MTS_ERROR )
+        return MTA_IOE;
+
+    if( mta->copyin && copy_pending( mta ) != MTA_OK )
+        return MTA_IOE;
+
+    if( mta->aio ) {            /* The stream buffers */
+        if( write_all( mta, iov, iovcnt ) != 0 ) {
+            mta->status |= MTS_ERROR;
+            return MTA_IOE;
+        }
+        return MTA_OK;
+    }
+
+    for( i = 0; i < iovcnt; i++ )
+        total += iov[i].iov_len;
+
+    if( mta->wbuf == NULL && mta->wbufsize == 0 ) {
+        void *buf;
+
+        mta->wbufsize = MTA_WBUFSIZE;
+        if( posix_memalign( &buf, (size_t)sysconf( _SC_PAGESIZE ), mta->wbufsize ) == 0 )
+            mta->wbuf = buf;
+    }
+
+    if( mta->wbuf && total <= mta->wbufsize ) {
+        if( total > mta->wbufsize - mta->wbuflen &&
+            write_buffer( mta ) != MTA_OK )
+            return MTA_IOE;
+
+        for( i = 0; i < iovcnt; i++ ) {
+            memcpy( mta->wbuf + mta->wbuflen, iov[i].iov_base, iov[i].iov_len );
+            mta->wbuflen += iov[i].iov_len;
+        }
+        if( mta->wbuflen > mta->stats.peakbuf )
+            mta->stats.peakbuf = mta->wbuflen;
+        return MTA_OK;
+    }
+
+    if( (size_t)iovcnt >= sizeof( wiov ) / sizeof( wiov[0] ) )
+        abort();
+
+    wiov[0].iov_base = mta->wbuf;
+    wiov[0].iov_len = mta->wbuflen;
+    memcpy( wiov + 1, iov, iovcnt * sizeof( *iov ) );
+    mta->wbuflen = 0;
+
+    if( write_all( mta, wiov, iovcnt + 1 ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    return MTA_OK;
+}
+
+/* writev everything, continuing after partial writes.  iov is modified.
+ * Returns 0, or -1 with errno set.
+ */
+
+static int write_all( MAGTAPE *mta, struct iovec *iov, int iovcnt ) {
+    int fd = fileno( mta->fd );
+
+    while( iovcnt ) {
+        struct timespec start;
+        ssize_t n;
+
+        if( iov->iov_len == 0 ) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        if( mta->zip || mta->aio ) {
+            n = mta->zip? mtzip_write( mta->zip, iov, iovcnt ):
+                mtaio_write( mta->aio, iov, iovcnt );
+            mta->stats.writens += elapsed_ns( &start );
+            if( n < 0 )
+                return -1;
+            if( mta->aio )
+                mta->stats.writes += (uint64_t)n;
+            while( iovcnt ) {
+                mta->stats.written += iov->iov_len;
+                iov++;
+                iovcnt--;
+            }
+            return 0;
+        }
+        n = writev( fd, iov, iovcnt );
+        mta->stats.writens += elapsed_ns( &start );
+        mta->stats.writes++;
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return -1;
+        }
+        mta->stats.written += (uint64_t)n;
+        while( iovcnt && (size_t)n >= iov->iov_len ) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if( iovcnt ) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int magtape_index( MAGTAPE *mta, int scan ) {
+    unsigned int rc;
+
+    if( mta->index == NULL ) {
+        if( !strcmp( mta->filename, "-" ) || mta->zip )
+            return 1;
+        mta->index = index_new();
+        if( mta->index == NULL )
+            return 1;
+        if( !(mta->status & MTS_WRITE) && mta->offset == 0 )
+            (void) index_load( mta );
+    }
+    if( !scan || (mta->status & MTS_WRITE) || mta->index->complete )
+        return 0;
+
+    rc = index_scan( mta, (uint32_t)-1, 0 );
+    return rc != MTA_OK;
+}
+
+unsigned int magtape_seek( MAGTAPE *mta, uint32_t file, uint32_t record ) {
+    struct mta_index *idx;
+    uint64_t offset;
+
+    if( mta->status & MTS_WRITE )
+        abort();
+
+    mta->pending = NULL;
+    if( magtape_index( mta, 0 ) != 0 )
+        return MTA_IOE;
+    idx = mta->index;
+
+    while( 1 ) {
+        uint32_t count;
+        unsigned int rc;
+
+        if( file < idx->nfiles ) {
+            count = ( (file + 1 < idx->nfiles)? idx->files[file+1].first:
+                      idx->nrecs ) - idx->files[file].first;
+            if( record < count ) {
+                offset = idx->recs[idx->files[file].first + record].offset;
+                break;
+            }
+            if( idx->files[file].mark != IDX_NOMARK ) {
+                if( record == count ) {
+                    offset = idx->files[file].mark;
+                    break;
+                }
+                return MTA_EOM; /* The file ends before record */
+            }
+        }
+        if( idx->complete )
+            return MTA_EOM;
+        rc = index_scan( mta, file, record );
+        if( rc != MTA_OK )
+            return rc;
+        idx = mta->index;
+        if( idx == NULL )
+            return MTA_IOE;
+    }
+
+    if( set_offset( mta, (off_t)offset ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    mta->status &= ~(MTS_TM | MTS_ERROR | MTS_EOM | MTS_EOT | MTS_NOPOS);
+    if( record == 0 && file > 0 )
+        mta->status |= MTS_TM;
+    mta->filenum = file;
+    mta->blocknum = record;
+
+    if( mta->reellen )
+        mta->reelpos = index_reelpos( mta, file, record );
+    return MTA_OK;
+}
+
+/* Linear position of an indexed record */
+
+static double index_reelpos( MAGTAPE *mta, uint32_t file, uint32_t record ) {
+    struct mta_index *idx = mta->index;
+    double pos;
+    uint32_t i, f;
+
+    pos = BOT_POS * 12.0;
+    for( i = 0; i < idx->files[file].first + record && i < idx->nrecs; i++ )
+        pos += mta->irg +
+            ((double)((idx->recs[i].rectype & MT_CNT) + 9) / mta->density);
+    for( f = 0; f < file; f++ )
+        pos += 3.0;
+
+    return pos;
+}
+
+void magtape_report( const char *tag, MAGTAPE *pos, const char *fmt, ... ) {
+    va_list ap;
+
+    va_start( ap, fmt );
+    magtape_vreport( tag, pos, fmt, ap );
+    va_end( ap );
+
+    return;
+}
+
+void magtape_vreport( const char *tag, MAGTAPE *pos, const char *fmt, va_list ap ) {
+    char *msg = NULL;
+    size_t len = 0, done;
+    int err = errno;
+    FILE *fp;
+
+    /* Without memory for the line, write it in pieces */
+
+    fp = open_memstream( &msg, &len );
+    flockfile( stderr );
+    if( fp == NULL ) {
+        if( tag )
+            fputs( tag, stderr );
+        vfprintf( stderr, fmt, ap );
+        if( pos )
+            magtape_pprintf( stderr, pos, 1 );
+        funlockfile( stderr );
+        errno = err;
+        return;
+    }
+    if( tag )
+        fputs( tag, fp );
+    vfprintf( fp, fmt, ap );
+    if( pos )
+        magtape_pprintf( fp, pos, 1 );
+    if( fclose( fp ) == 0 ) {
+        fflush( stderr );
+        for( done = 0; done < len; ) {
+            ssize_t n = write( fileno( stderr ), msg + done, len - done );
+
+            if( n < 0 && errno == EINTR )
+                continue;
+            if( n <= 0 )
+                break;
+            done += (size_t)n;
+        }
+    }
+    funlockfile( stderr );
+    free( msg );
+    errno = err;
+
+    return;
+}
+
+void magtape_pprintf( FILE *out, MAGTAPE *mta, int nl ) {
+    if( mta->status & MTS_NOPOS ) {
+        fprintf( out, "offset %jd", (intmax_t)mta->offset );
+    } else {
+        fprintf( out, "file %" PRIu32 ", record %" PRIu32, mta->filenum, mta->blocknum );
+    }
+    if( mta->reellen && !(mta->status & MTS_NOPOS) ) {
+        if( mta->status & MTS_METRIC )
+            fprintf( out, " (%.1fm)", mta->reelpos / 39.3701 );
+        else
+            fprintf( out, " (%.1fft)", mta->reelpos / 12 );
+    }
+    fprintf( out, " of %s%s",
+              mta->filename, nl? "\n": "" );
+}
+
+/* Map a regular input file.  If this isn't possible, stdio is used.
+ */
+
+static void map_image( MAGTAPE *mta ) {
+    struct stat st;
+    void *map;
+
+    if( fstat( fileno( mta->fd ), &st ) != 0 || !S_ISREG( st.st_mode ) ||
+        st.st_size == 0 || (uintmax_t)st.st_size > (uintmax_t)SIZE_MAX )
+        return;
+
+    map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                fileno( mta->fd ), 0 );
+    if( map == MAP_FAILED )
+        return;
+    (void) madvise( map, (size_t)st.st_size, MADV_SEQUENTIAL );
+
+    mta->map = map;
+    mta->mapsize = (size_t)st.st_size;
+    mta->status |= MTS_MAPPED;
+    return;
+}
+
+/* Copy frames from the image, returning the number available.
+ */
+
+static size_t get_frames( MAGTAPE *mta, void *buffer, size_t length ) {
+    size_t n;
+
+    if( mta->status & MTS_MAPPED ) {
+        n = mta->mapsize - (size_t)mta->offset;
+        if( n > length )
+            n = length;
+        memcpy( buffer, mta->map + mta->offset, n );
+    } else if( mta->zip ) {
+        n = mtzip_read( mta->zip, buffer, length );
+    } else {
+        n = source_read( mta, buffer, length );
+    }
+    mta->offset += n;
+    return n;
+}
+
+/* Locate frames in the image without copying them if possible.
+ * *data is NULL if a buffer can't be allocated.
+ */
+
+static size_t view_frames( MAGTAPE *mta, const uint8_t **data, size_t length ) {
+    size_t n;
+
+    if( mta->status & MTS_MAPPED ) {
+        n = mta->mapsize - (size_t)mta->offset;
+        if( n > length )
+            n = length;
+        *data = mta->map + mta->offset;
+        mta->offset += n;
+        return n;
+    }
+
+    if( length > mta->recbufsize ) {
+        uint8_t *nbuf;
+        size_t nsize;
+
+        nsize = mta->recbufsize? mta->recbufsize: 4096;
+        while( nsize < length )
+            nsize *= 2;
+        nbuf = realloc( mta->recbuf, nsize );
+        if( nbuf == NULL ) {
+            *data = NULL;
+            return 0;
+        }
+        mta->recbuf = nbuf;
+        mta->recbufsize = nsize;
+    }
+    if( length > mta->stats.peakbuf )
+        mta->stats.peakbuf = length;
+    *data = mta->recbuf;
+    return get_frames( mta, mta->recbuf, length );
+}
+
+/* Skip frames, returning the number skipped.  Unmapped images that
+ * can't seek are read.  A seek past the end is detected by the next read.
+ */
+
+static size_t skip_frames( MAGTAPE *mta, size_t length ) {
+    size_t n;
+
+    if( mta->status & MTS_MAPPED ) {
+        n = mta->mapsize - (size_t)mta->offset;
+        if( n > length )
+            n = length;
+        mta->offset += n;
+        return n;
+    }
+
+    if( mta->ring && mta->zip == NULL && mta->npeek == 0 ) {
+        n = ring_skip( mta->ring, length );
+        mta->offset += n;
+        return n;
+    }
+
+    if( mta->aio && mta->zip == NULL &&
+        mtaio_seek( mta->aio, mta->offset + (off_t)length ) == 0 ) {
+        mta->offset += length;
+        return length;
+    }
+
+    if( mta->zip == NULL && mta->npeek == 0 && mta->aio == NULL &&
+        fseeko( mta->fd, (off_t)length, SEEK_CUR ) == 0 ) {
+        mta->offset += length;
+        return length;
+    }
+
+    for( n = 0; n < length; ) {
+        uint8_t discard[4096];
+        size_t chunk, got;
+
+        chunk = length - n;
+        if( chunk > sizeof( discard ) )
+            chunk = sizeof( discard );
+        got = get_frames( mta, discard, chunk );
+        n += got;
+        if( got != chunk )
+            break;
+    }
+    return n;
+}
+
+/* Position at an absolute image offset.
+ */
+
+static int set_offset( MAGTAPE *mta, off_t offset ) {
+    if( mta->status & MTS_MAPPED ) {
+        if( offset < 0 || (uint64_t)offset > (uint64_t)mta->mapsize )
+            return 1;
+    } else {
+        if( mta->zip || mta->npeek || (mta->ring && !mta->ring->seekable) ) {
+            errno = ESPIPE;
+            return 1;
+        }
+        if( mta->ring ) {
+            if( offset < 0 ) {
+                errno = EINVAL;
+                return 1;
+            }
+            ring_seek( mta->ring, offset );
+        } else if( mta->aio ) {
+            if( mtaio_seek( mta->aio, offset ) != 0 )
+                return 1;
+        } else {
+            if( fseeko( mta->fd, offset, SEEK_SET ) != 0 )
+                return 1;
+            clearerr( mta->fd );
+        }
+    }
+    mta->offset = offset;
+    return 0;
+}
+
+/* Detect a compressed input image, or open compressed output.
+ * The first frames of a regular file or the readahead ring are read
+ * without moving; those of a pipe are kept in peek until get_frames
+ * returns them.  Returns 0, or -1 with errno set.
+ */
+
+static int open_zip( MAGTAPE *mta ) {
+    mtzip_format format;
+    struct stat st;
+    uint8_t magic[4];
+    size_t n;
+
+    if( mta->status & MTS_WRITE ) {
+        format = mtzip_suffix( mta->filename );
+        if( format == MTZIP_NONE )
+            return 0;
+    } else {
+        if( mta->ring ) {
+            n = ring_peek( mta->ring, magic, sizeof( magic ) );
+            if( n < sizeof( magic ) && source_failed( mta ) )
+                return -1;
+        } else if( fstat( fileno( mta->fd ), &st ) == 0 && S_ISREG( st.st_mode ) ) {
+            off_t pos = lseek( fileno( mta->fd ), 0, SEEK_CUR );
+            ssize_t got;
+
+            got = (pos < 0)? -1: pread( fileno( mta->fd ), magic, sizeof( magic ), pos );
+            if( got < 0 )
+                return -1;
+            n = (size_t)got;
+        } else {
+            n = fread( mta->peek, 1, sizeof( mta->peek ), mta->fd );
+            if( n < sizeof( mta->peek ) && ferror( mta->fd ) )
+                return -1;
+            memcpy( magic, mta->peek, n );
+            mta->npeek = n;
+        }
+        format = mtzip_detect( magic, n );
+        if( format == MTZIP_NONE )
+            return 0;
+    }
+    if( !mtzip_available( format ) ) {
+        fprintf( stderr, "%s: %s compression is not supported by this build\n",
+                 mta->filename, mtzip_name( format ) );
+        errno = ENOTSUP;
+        return -1;
+    }
+    if( mta->status & MTS_WRITE )
+        mta->zip = mtzip_open_write( fileno( mta->fd ), format, 0, 0 );
+    else
+        mta->zip = mtzip_open_read( zip_source, mta, format, mta->peek, mta->npeek );
+    if( mta->zip == NULL )
+        return -1;
+    mta->npeek = 0;
+    return 0;
+}
+
+/* Read compressed frames for the decompressor.
+ */
+
+static ssize_t zip_source( void *arg, void *buffer, size_t length ) {
+    MAGTAPE *mta = arg;
+    size_t n;
+
+    n = source_read( mta, buffer, length );
+    if( n == 0 && source_failed( mta ) )
+        return -1;
+    return (ssize_t)n;
+}
+
+/* Read frames from an unmapped image: peek, then the ring or stdio.
+ */
+
+static size_t source_read( MAGTAPE *mta, void *buffer, size_t length ) {
+    size_t n = 0;
+
+    if( mta->npeek ) {
+        n = (mta->npeek < length)? mta->npeek: length;
+        memcpy( buffer, mta->peek, n );
+        memmove( mta->peek, mta->peek + n, mta->npeek - n );
+        mta->npeek -= n;
+    }
+    if( n < length ) {
+        if( mta->ring )
+            n += ring_read( mta->ring, (uint8_t *)buffer + n, length - n );
+        else if( mta->aio )
+            n += mtaio_read( mta->aio, (uint8_t *)buffer + n, length - n );
+        else
+            n += fread( (uint8_t *)buffer + n, sizeof( uint8_t ), length - n, mta->fd );
+    }
+    return n;
+}
+
+/* Whether a short read of the image file failed.  errno is set if so.
+ */
+
+static int source_failed( MAGTAPE *mta ) {
+    if( mta->ring ) {
+        int err;
+
+        pthread_mutex_lock( &mta->ring->lock );
+        err = mta->ring->error;
+        pthread_mutex_unlock( &mta->ring->lock );
+        if( err ) {
+            errno = err;
+            return 1;
+        }
+        return 0;
+    }
+    if( mta->aio ) {
+        if( mtaio_error( mta->aio ) ) {
+            errno = mtaio_error( mta->aio );
+            return 1;
+        }
+        return 0;
+    }
+    return ferror( mta->fd );
+}
+
+/* Whether a short read was due to an error.  errno is set if so.
+ */
+
+static int read_failed( MAGTAPE *mta ) {
+    if( mta->zip && mtzip_error( mta->zip ) ) {
+        errno = mtzip_error( mta->zip );
+        return 1;
+    }
+    return source_failed( mta );
+}
+
+/* The readahead depth requested by the environment, or 0.
+ */
+
+static size_t readahead_depth( void ) {
+    const char *env = getenv( "MAGTAPE_READAHEAD" );
+    unsigned long long depth;
+    char *end;
+
+    if( env == NULL || *env == '\0' )
+        return 0;
+    errno = 0;
+    depth = strtoull( env, &end, 10 );
+    switch( *end ) {
+    case 'g': case 'G':
+        depth *= 1024;
+        /* FALLTHRU */
+    case 'm': case 'M':
+        depth *= 1024;
+        /* FALLTHRU */
+    case 'k': case 'K':
+        depth *= 1024;
+        end++;
+        break;
+    }
+    if( errno || *end != '\0' || depth > SIZE_MAX / 2 ) {
+        fprintf( stderr, "MAGTAPE_READAHEAD: invalid size %s\n", env );
+        return 0;
+    }
+    if( depth && depth < MTA_RAMIN )
+        depth = MTA_RAMIN;
+    return (size_t)depth;
+}
+
+/* The mtaio flags selected by a mode's modifiers, or by the environment
+ * if there are none.  -1 selects stdio.
+ */
+
+static int aio_flags( const char *flags ) {
+    const char *env;
+
+    if( *flags )
+        return strchr( flags, 'd' )? MTAIO_DIRECT: 0;
+
+    env = getenv( "MAGTAPE_IO" );
+    if( env == NULL || *env == '\0' || !strcmp( env, "stdio" ) )
+        return -1;
+    if( !strcmp( env, "uring" ) )
+        return 0;
+    if( !strcmp( env, "direct" ) )
+        return MTAIO_DIRECT;
+    fprintf( stderr, "MAGTAPE_IO: invalid method %s\n", env );
+    return -1;
+}
+
+/* Start reading ahead into a ring of depth bytes.
+ * The file must not have been read through stdio.
+ * Returns 0, or -1 if readahead isn't possible.
+ */
+
+static int ring_start( MAGTAPE *mta, size_t depth ) {
+    struct mta_ring *r;
+    struct stat st;
+
+    r = calloc( 1, sizeof( *r ) );
+    if( r == NULL )
+        return -1;
+    r->size = depth;
+    r->buf = malloc( depth );
+    if( r->buf == NULL ) {
+        free( r );
+        return -1;
+    }
+    r->fd = fileno( mta->fd );
+    if( fstat( r->fd, &st ) == 0 && S_ISREG( st.st_mode ) &&
+        (r->base = lseek( r->fd, 0, SEEK_CUR )) >= 0 ) {
+        r->seekable = 1;
+#ifdef POSIX_FADV_SEQUENTIAL
+        (void) posix_fadvise( r->fd, r->base, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+    } else {
+        r->base = 0;
+    }
+    pthread_mutex_init( &r->lock, NULL );
+    pthread_cond_init( &r->data, NULL );
+    pthread_cond_init( &r->space, NULL );
+    if( pthread_create( &r->filler, NULL, ring_fill, r ) ) {
+        pthread_mutex_destroy( &r->lock );
+        pthread_cond_destroy( &r->data );
+        pthread_cond_destroy( &r->space );
+        free( r->buf );
+        free( r );
+        return -1;
+    }
+    mta->ring = r;
+    return 0;
+}
+
+/* Readahead thread: keep the ring full.
+ * A regular file is also advised to be read a ring ahead of the filler,
+ * so the kernel's reads overlap ours.  The thread can only be cancelled
+ * while waiting in read(), which is how a blocked pipe is abandoned.
+ */
+
+static void *ring_fill( void *arg ) {
+    struct mta_ring *r = arg;
+
+    (void) pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+
+    pthread_mutex_lock( &r->lock );
+    while( !r->stop ) {
+        size_t used, start, len;
+        unsigned int gen;
+        ssize_t n;
+        off_t pos;
+
+        used = (size_t)(r->head - r->tail);
+        if( r->eof || r->error || used == r->size ) {
+            pthread_cond_wait( &r->space, &r->lock );
+            continue;
+        }
+        pos = r->head;
+        gen = r->gen;
+        start = (size_t)(pos % (off_t)r->size);
+        len = r->size - used;
+        if( len > r->size - start )
+            len = r->size - start;
+        if( len > MTA_RACHUNK )
+            len = MTA_RACHUNK;
+        pthread_mutex_unlock( &r->lock );
+
+        if( r->seekable ) {
+#ifdef POSIX_FADV_WILLNEED
+            (void) posix_fadvise( r->fd, r->base + pos + (off_t)r->size,
+                                  (off_t)len, POSIX_FADV_WILLNEED );
+#endif
+            n = pread( r->fd, r->buf + start, len, r->base + pos );
+        } else {
+            (void) pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+            n = read( r->fd, r->buf + start, len );
+            (void) pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+        }
+
+        pthread_mutex_lock( &r->lock );
+        if( gen != r->gen )
+            continue;
+        if( n > 0 )
+            r->head += n;
+        else if( n == 0 )
+            r->eof = 1;
+        else if( errno != EINTR )
+            r->error = errno;
+        pthread_cond_broadcast( &r->data );
+    }
+    pthread_mutex_unlock( &r->lock );
+    return NULL;
+}
+
+/* Take frames from the ring, waiting for them as needed.  Returns the
+ * number taken, which is short only at the end of the image or on error.
+ */
+
+static size_t ring_read( struct mta_ring *r, uint8_t *buffer, size_t length ) {
+    size_t got = 0;
+
+    pthread_mutex_lock( &r->lock );
+    while( got < length ) {
+        size_t avail = (size_t)(r->head - r->tail), start, n;
+
+        if( avail == 0 ) {
+            if( r->eof || r->error )
+                break;
+            pthread_cond_wait( &r->data, &r->lock );
+            continue;
+        }
+        start = (size_t)(r->tail % (off_t)r->size);
+        n = length - got;
+        if( n > avail )
+            n = avail;
+        if( n > r->size - start )
+            n = r->size - start;
+        pthread_mutex_unlock( &r->lock );
+        memcpy( buffer + got, r->buf + start, n );
+        pthread_mutex_lock( &r->lock );
+        r->tail += (off_t)n;
+        got += n;
+        pthread_cond_signal( &r->space );
+    }
+    pthread_mutex_unlock( &r->lock );
+    return got;
+}
+
+/* Copy the next frames without taking them.
+ */
+
+static size_t ring_peek( struct mta_ring *r, uint8_t *buffer, size_t length ) {
+    size_t avail, start, n;
+
+    pthread_mutex_lock( &r->lock );
+    while( (avail = (size_t)(r->head - r->tail)) < length && !r->eof && !r->error )
+        pthread_cond_wait( &r->data, &r->lock );
+    start = (size_t)(r->tail % (off_t)r->size);
+    for( n = 0; n < length && n < avail; n++ )
+        buffer[n] = r->buf[(start + n) % r->size];
+    pthread_mutex_unlock( &r->lock );
+    return n;
+}
+
+/* Discard frames.  A seekable image skips a long run that hasn't been
+ * read ahead, rather than waiting for it.
+ */
+
+static size_t ring_skip( struct mta_ring *r, size_t length ) {
+    size_t got = 0;
+
+    pthread_mutex_lock( &r->lock );
+    while( got < length ) {
+        size_t avail = (size_t)(r->head - r->tail), n;
+
+        if( avail == 0 ) {
+            if( r->seekable && length - got >= MTA_RACHUNK ) {
+                pthread_mutex_unlock( &r->lock );
+                ring_seek( r, r->tail + (off_t)(length - got) );
+                return length;
+            }
+            if( r->eof || r->error )
+                break;
+            pthread_cond_wait( &r->data, &r->lock );
+            continue;
+        }
+        n = length - got;
+        if( n > avail )
+            n = avail;
+        r->tail += (off_t)n;
+        got += n;
+        pthread_cond_signal( &r->space );
+    }
+    pthread_mutex_unlock( &r->lock );
+    return got;
+}
+
+/* Reposition a seekable image.  Frames already read ahead are kept if
+ * offset is among them; otherwise the ring restarts there.
+ */
+
+static void ring_seek( struct mta_ring *r, off_t offset ) {
+    pthread_mutex_lock( &r->lock );
+    if( offset >= r->tail && offset <= r->head ) {
+        r->tail = offset;
+    } else {
+        r->head =
+            r->tail = offset;
+        r->gen++;
+        r->eof = 0;
+        r->error = 0;
+    }
+    pthread_cond_signal( &r->space );
+    pthread_mutex_unlock( &r->lock );
+    return;
+}
+
+/* Stop the readahead thread and free the ring.
+ */
+
+static void ring_stop( struct mta_ring *r ) {
+    pthread_mutex_lock( &r->lock );
+    r->stop = 1;
+    pthread_cond_signal( &r->space );
+    pthread_mutex_unlock( &r->lock );
+    if( !r->seekable )
+        (void) pthread_cancel( r->filler );
+    (void) pthread_join( r->filler, NULL );
+
+    pthread_mutex_destroy( &r->lock );
+    pthread_cond_destroy( &r->data );
+    pthread_cond_destroy( &r->space );
+    free( r->buf );
+    free( r );
+    return;
+}
+
+/* Read the length word at an offset.  The current offset is changed.
+ */
+
+static unsigned int get_word_at( MAGTAPE *mta, off_t offset, uint32_t *word ) {
+    uint8_t bytes[4];
+
+    if( set_offset( mta, offset ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    if( get_frames( mta, bytes, 4 ) != 4 ) {
+        mta->status |= MTS_ERROR;
+        if( read_failed( mta ) )
+            return MTA_IOE;
+        return MTA_FMT;
+    }
+    *word = ((uint32_t) bytes[3] << 24) | ((uint32_t) bytes[2] << 16) |
+        ((uint32_t) bytes[1] <<  8) | (bytes[0]);
+    return MTA_OK;
+}
+
+/* Determine whether the last thing before offset (ignoring gaps) is a
+ * tape mark, as MTS_TM would be if it had been read forward.
+ */
+
+static int after_mark( MAGTAPE *mta, off_t offset ) {
+    off_t save = mta->offset;
+    uint32_t word;
+    int mark = 0;
+
+    while( offset >= 4 ) {
+        if( get_word_at( mta, offset - 4, &word ) != MTA_OK ) {
+            mta->status &= ~MTS_ERROR;
+            break;
+        }
+        if( word != MT_GAP ) {
+            mark = (word == MT_TM);
+            break;
+        }
+        offset -= 4;
+    }
+    (void) set_offset( mta, save );
+    return mark;
+}
+
+/* Count the records in the file that ends at offset.  The index is used
+ * if it covers the file; otherwise the length words are walked back to
+ * the preceding tape mark.
+ */
+
+static uint32_t count_back( MAGTAPE *mta, off_t offset ) {
+    struct mta_index *idx = mta->index;
+    off_t save = mta->offset, pos;
+    uint32_t n = 0;
+
+    if( idx && mta->filenum + 1 < idx->nfiles )
+        return idx->files[mta->filenum+1].first - idx->files[mta->filenum].first;
+
+    for( pos = offset; pos >= 4; ) {
+        uint32_t word, length;
+
+        if( get_word_at( mta, pos - 4, &word ) != MTA_OK ) {
+            mta->status &= ~MTS_ERROR;
+            break;
+        }
+        if( word == MT_TM )
+            break;
+        if( word == MT_GAP || word == MT_EOM ) {
+            pos -= 4;
+            continue;
+        }
+        if( word & MT_MBZ || MT_RSVD(word) )
+            break;
+        length = word & MT_CNT;
+        pos -= 8 + (off_t)((length + 1) & ~1u);
+        n++;
+    }
+    (void) set_offset( mta, save );
+    return n;
+}
+
+static struct mta_index *index_new( void ) {
+    struct mta_index *idx;
+
+    idx = calloc( 1, sizeof( *idx ) );
+    if( idx == NULL )
+        return NULL;
+
+    idx->files = malloc( 16 * sizeof( *idx->files ) );
+    if( idx->files == NULL ) {
+        free( idx );
+        return NULL;
+    }
+    idx->maxfiles = 16;
+    idx->nfiles = 1;
+    idx->files[0].first = 0;
+    idx->files[0].offset = 0;
+    idx->files[0].mark = IDX_NOMARK;
+    return idx;
+}
+
+static void index_free( struct mta_index *idx ) {
+    if( idx == NULL )
+        return;
+    free( idx->files );
+    free( idx->recs );
+    free( idx );
+}
+
+/* Record an element of the image in the index if it extends the indexed
+ * region.  start is the offset of its leading length word; the image
+ * position is just past it.  Allocation failure disables indexing.
+ */
+
+static void index_note( MAGTAPE *mta, off_t start, uint32_t rectype ) {
+    struct mta_index *idx = mta->index;
+
+    if( idx == NULL || idx->complete || start != idx->end )
+        return;
+
+    idx->end = mta->offset;
+    idx->dirty = 1;
+
+    if( rectype == MT_EOM ) {
+        idx->complete = 1;
+        return;
+    }
+    if( rectype == MT_GAP )
+        return;
+
+    if( rectype == MT_TM ) {
+        if( idx->nfiles == idx->maxfiles ) {
+            struct mta_idxfile *nf;
+
+            nf = realloc( idx->files, 2 * idx->maxfiles * sizeof( *nf ) );
+            if( nf == NULL )
+                goto nomem;
+            idx->files = nf;
+            idx->maxfiles *= 2;
+        }
+        idx->files[idx->nfiles-1].mark = (uint64_t)start;
+        idx->files[idx->nfiles].first = idx->nrecs;
+        idx->files[idx->nfiles].offset = (uint64_t)mta->offset;
+        idx->files[idx->nfiles].mark = IDX_NOMARK;
+        idx->nfiles++;
+        return;
+    }
+
+    if( idx->nrecs == idx->maxrecs ) {
+        struct mta_idxrec *nr;
+        uint32_t nmax;
+
+        nmax = idx->maxrecs? 2 * idx->maxrecs: 1024;
+        nr = realloc( idx->recs, nmax * sizeof( *nr ) );
+        if( nr == NULL )
+            goto nomem;
+        idx->recs = nr;
+        idx->maxrecs = nmax;
+    }
+    idx->recs[idx->nrecs].offset = (uint64_t)start;
+    idx->recs[idx->nrecs].rectype = rectype;
+    idx->nrecs++;
+    return;
+
+ nomem:
+    magtape_report( mta->tag, NULL, "%s: index disabled: %s\n", mta->filename, strerror( errno ) );
+    index_free( idx );
+    mta->index = NULL;
+    return;
+}
+
+/* Extend the index by reading headers from the end of the indexed region
+ * until record of file is indexed (or to the end of the image), then
+ * restore the tape's position.
+ */
+
+static unsigned int index_scan( MAGTAPE *mta, uint32_t file, uint32_t record ) {
+    struct mta_index *idx = mta->index;
+    MAGTAPE save;
+    unsigned int rc = MTA_OK;
+
+    save = *mta;
+
+    if( set_offset( mta, idx->end ) != 0 ) {
+        *mta = save;
+        return MTA_IOE;
+    }
+    mta->filenum = idx->nfiles -1;
+    mta->blocknum = idx->nrecs - idx->files[idx->nfiles-1].first;
+    mta->status &= ~(MTS_TM | MTS_ERROR | MTS_EOM | MTS_NOISY);
+    if( mta->filenum && !mta->blocknum &&
+        idx->files[idx->nfiles-1].offset == (uint64_t)idx->end )
+        mta->status |= MTS_TM;
+    mta->reellen = 0.0;
+
+    while( !idx->complete ) {
+        uint32_t recsize;
+
+        if( idx->nfiles > file + 1 && file != (uint32_t)-1 )
+            break;
+        if( idx->nfiles == file + 1 &&
+            idx->nrecs - idx->files[file].first > record )
+            break;
+
+        rc = read_record( mta, NULL, 0, NULL, &recsize );
+        idx = mta->index;
+        if( idx == NULL ) {
+            rc = MTA_IOE;
+            break;
+        }
+        if( rc == MTA_IOE || rc == MTA_FMT )
+            break;
+        if( rc == MTA_EOM && !idx->complete ) {
+            rc = MTA_FMT;
+            break;
+        }
+        rc = MTA_OK;
+    }
+
+    save.index = mta->index;
+    save.recbuf = mta->recbuf;
+    save.recbufsize = mta->recbufsize;
+    *mta = save;
+    if( set_offset( mta, save.offset ) != 0 ) {
+        mta->status |= MTS_ERROR;
+        return MTA_IOE;
+    }
+    return rc;
+}
+
+static void put_le( uint8_t *p, uint64_t v, int n ) {
+    while( n-- ) {
+        *p++ = v & 0xFF;
+        v >>= 8;
+    }
+}
+
+static uint64_t get_le( const uint8_t *p, int n ) {
+    uint64_t v = 0;
+
+    while( n-- )
+        v = (v << 8) | p[n];
+    return v;
+}
+
+/* Load the sidecar if it describes the current image.  Its entries must
+ * lie within the image, and its files must partition its records; if
+ * not, it is ignored.
+ */
+
+static int index_load( MAGTAPE *mta ) {
+    struct mta_index *idx = mta->index;
+    struct stat st, ist;
+    uint8_t hdr[IDX_HDRSIZE], ent[IDX_FILESIZE];
+    uint64_t size, end;
+    uint32_t nfiles, nrecs, first = 0, i;
+    char *name;
+    FILE *fp;
+    int rc = 1;
+
+    if( fstat( fileno( mta->fd ), &st ) != 0 )
+        return 1;
+
+    name = malloc( strlen( mta->filename ) + sizeof( ".idx" ) );
+    if( name == NULL )
+        return 1;
+    sprintf( name, "%s.idx", mta->filename );
+    fp = fopen( name, "rb" );
+    free( name );
+    if( fp == NULL )
+        return 1;
+
+    if( fread( hdr, 1, IDX_HDRSIZE, fp ) != IDX_HDRSIZE ||
+        memcmp( hdr, IDX_MAGIC, 8 ) ||
+        get_le( hdr+8, 8 ) != (uint64_t)st.st_size ||
+        get_le( hdr+16, 8 ) != (uint64_t)st.st_mtim.tv_sec ||
+        get_le( hdr+44, 4 ) != (uint64_t)st.st_mtim.tv_nsec )
+        goto done;
+
+    size = (uint64_t)st.st_size;
+    end = get_le( hdr+24, 8 );
+    nfiles = (uint32_t)get_le( hdr+32, 4 );
+    nrecs = (uint32_t)get_le( hdr+36, 4 );
+    if( nfiles == 0 || end > size || fstat( fileno( fp ), &ist ) != 0 ||
+        (uint64_t)ist.st_size != IDX_HDRSIZE + (uint64_t)nfiles * IDX_FILESIZE +
+                                 (uint64_t)nrecs * IDX_RECSIZE )
+        goto done;
+
+    free( idx->files );
+    idx->files = malloc( nfiles * sizeof( *idx->files ) );
+    idx->recs = malloc( (nrecs? nrecs: 1) * sizeof( *idx->recs ) );
+    idx->maxfiles = idx->nfiles = 0;
+    idx->maxrecs = idx->nrecs = 0;
+    if( idx->files == NULL || idx->recs == NULL )
+        goto done;
+    idx->maxfiles = nfiles;
+    idx->maxrecs = nrecs? nrecs: 1;
+
+    for( i = 0; i < nfiles; i++ ) {
+        if( fread( ent, 1, IDX_FILESIZE, fp ) != IDX_FILESIZE )
+            goto done;
+        idx->files[i].first = (uint32_t)get_le( ent, 4 );
+        idx->files[i].offset = get_le( ent+4, 8 );
+        idx->files[i].mark = get_le( ent+12, 8 );
+        if( idx->files[i].first < first || idx->files[i].first > nrecs ||
+            idx->files[i].offset > size ||
+            (idx->files[i].mark != IDX_NOMARK && idx->files[i].mark > size) )
+            goto done;
+        first = idx->files[i].first;
+    }
+    for( i = 0; i < nrecs; i++ ) {
+        if( fread( ent, 1, IDX_RECSIZE, fp ) != IDX_RECSIZE )
+            goto done;
+        idx->recs[i].offset = get_le( ent, 8 );
+        idx->recs[i].rectype = (uint32_t)get_le( ent+8, 4 );
+        if( idx->recs[i].offset > size )
+            goto done;
+    }
+    idx->nfiles = nfiles;
+    idx->nrecs = nrecs;
+    idx->end = (off_t)end;
+    idx->complete = get_le( hdr+40, 4 ) != 0;
+    idx->dirty = 0;
+    rc = 0;
+
+ done:
+    fclose( fp );
+    if( rc ) { /* Start over */
+        idx = index_new();
+        if( idx != NULL ) {
+            index_free( mta->index );
+            mta->index = idx;
+        }
+    }
+    return rc;
+}
+
+/* Write the sidecar.  The image must be closed, so its final size and
+ * modification time are recorded.
+ */
+
+static int index_save( MAGTAPE *mta ) {
+    struct mta_index *idx = mta->index;
+    struct stat st;
+    uint8_t hdr[IDX_HDRSIZE], ent[IDX_FILESIZE];
+    char *name, *tmp;
+    FILE *fp;
+    uint32_t i;
+    int rc = 1;
+
+    if( stat( mta->filename, &st ) != 0 )
+        return 1;
+
+    name = malloc( 2 * (strlen( mta->filename ) + sizeof( ".idx.tmp" )) );
+    if( name == NULL )
+        return 1;
+    tmp = name + strlen( mta->filename ) + sizeof( ".idx.tmp" );
+    sprintf( name, "%s.idx", mta->filename );
+    sprintf( tmp, "%s.idx.tmp", mta->filename );
+
+    fp = fopen( tmp, "wb" );
+    if( fp == NULL ) {
+        free( name );
+        return 1;
+    }
+
+    memset( hdr, 0, sizeof( hdr ) );
+    memcpy( hdr, IDX_MAGIC, 8 );
+    put_le( hdr+8, (uint64_t)st.st_size, 8 );
+    put_le( hdr+16, (uint64_t)st.st_mtim.tv_sec, 8 );
+    put_le( hdr+24, (uint64_t)idx->end, 8 );
+    put_le( hdr+32, idx->nfiles, 4 );
+    put_le( hdr+36, idx->nrecs, 4 );
+    put_le( hdr+40, (uint64_t)idx->complete, 4 );
+    put_le( hdr+44, (uint64_t)st.st_mtim.tv_nsec, 4 );
+    if( fwrite( hdr, 1, IDX_HDRSIZE, fp ) != IDX_HDRSIZE )
+        goto done;
+
+    for( i = 0; i < idx->nfiles; i++ ) {
+        put_le( ent, idx->files[i].first, 4 );
+        put_le( ent+4, idx->files[i].offset, 8 );
+        put_le( ent+12, idx->files[i].mark, 8 );
+        if( fwrite( ent, 1, IDX_FILESIZE, fp ) != IDX_FILESIZE )
+            goto done;
+    }
+    for( i = 0; i < idx->nrecs; i++ ) {
+        put_le( ent, idx->recs[i].offset, 8 );
+        put_le( ent+8, idx->recs[i].rectype, 4 );
+        if( fwrite( ent, 1, IDX_RECSIZE, fp ) != IDX_RECSIZE )
+            goto done;
+    }
+    rc = 0;
+
+ done:
+    if( fclose( fp ) )
+        rc = 1;
+    if( rc == 0 && rename( tmp, name ) != 0 )
+        rc = 1;
+    if( rc ) {
+        fprintf( stderr, "%s: %s\n", name, strerror( errno ) );
+        (void) remove( tmp );
+    }
+    free( name );
+    return rc;
+}
+
+/* Move the linear position back */
+
+static void unwind_pos( MAGTAPE *mta, const double distance ) {
+    if( !mta->reellen )
+        return;
+
+    mta->reelpos -= distance;
+    if( mta->reelpos < BOT_POS * 12.0 )
+        mta->reelpos = BOT_POS * 12.0;
+    if( mta->reelpos < mta->eotpos )
+        mta->status &= ~MTS_EOT;
+
+    return;
+}
+
+static int update_pos( MAGTAPE *mta, const double distance ) {
+    double oldpos;
+
+    if( !mta->reellen )
+        return 0;
+
+    oldpos = mta->reelpos;
+    mta->reelpos += distance;
+    if( oldpos < mta->eotpos && mta->reelpos >= mta->eotpos ) {
+        mta->status |= MTS_EOT;
+        return 1;
+    }
+    return 0;
+}
+
+/* Count a data record */
+
+static void count_record( MAGTAPE *mta, uint32_t rectype ) {
+    uint32_t length = rectype & MT_CNT;
+    unsigned int b;
+
+    mta->stats.records++;
+    mta->stats.frames += length;
+    if( rectype & MT_ERR )
+        mta->stats.errors++;
+    for( b = 0; b < MTA_SIZE_BUCKETS -1 && (length >> b) != 0; b++ )
+        ;
+    mta->stats.sizes[b]++;
+
+    return;
+}
+
+static uint64_t elapsed_ns( const struct timespec *start ) {
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (uint64_t)(now.tv_sec - start->tv_sec) * UINT64_C(1000000000) +
+        (uint64_t)(now.tv_nsec - start->tv_nsec);
+}
+
+void magtape_close( MAGTAPE **mta ) {
+    if( (mta[0]->status & MTS_WRITE) && !(mta[0]->status & MTS_EOM) ) {
+        if( magtape_mark( *mta, MTA_EOM_MARK ) != MTA_OK )
+            fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+    }
+
+    if( (mta[0]->status & MTS_WRITE) &&
+        magtape_flush( *mta, mta[0]->sync ) != MTA_OK )
+        fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+
+    if( mta[0]->status & MTS_MAPPED )
+        (void) munmap( mta[0]->map, mta[0]->mapsize );
+
+    if( mta[0]->zip && mtzip_close( mta[0]->zip ) != 0 )
+        fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+
+    if( mta[0]->ring )
+        ring_stop( mta[0]->ring );
+
+    if( mta[0]->aio && mtaio_close( mta[0]->aio ) != 0 )
+        fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+
+    if( fclose( mta[0]->fd ) )
+        fprintf( stderr, "%s: %s\n", mta[0]->filename, strerror( errno ) );
+
+    if( mta[0]->index ) {
+        if( mta[0]->index->dirty )
+            (void) index_save( *mta );
+        index_free( mta[0]->index );
+    }
 
+    free( mta[0]->recbuf );
+    free( mta[0]->rbuf );
+    free( mta[0]->wbuf );
     free( mta[0]->filename );
     free( *mta );
 
@@ -21,8 +21,43 @@
 #define MAGTAPE_H
 
 #include <inttypes.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
+
+struct mta_index;
+struct mta_ring;
+struct mtaio;
+struct mtzip;
+
+/* When buffered output is written to the image */
+
+typedef enum mta_flushpolicy {
+    MTA_FLUSH_FULL,         /* When the buffer fills, and at close */
+    MTA_FLUSH_MARK,         /* Also after each tape mark */
+    MTA_FLUSH_RECORD        /* After each record and tape mark */
+} mta_flushpolicy;
+
+/* Activity counters, maintained for every tape.  Records are data
+ * records read (including skipped) or written, excluding noise.
+ * Bucket b of sizes counts records of 2^(b-1) to 2^b -1 frames.
+ */
+
+#define MTA_SIZE_BUCKETS 25
+
+typedef struct mta_stats {
+    uint64_t records;
+    uint64_t errors;        /* Records with the data error flag */
+    uint64_t marks;         /* Tape marks */
+    uint64_t noise;         /* Noise records skipped */
+    uint64_t frames;        /* Frames in records */
+    uint64_t sizes[MTA_SIZE_BUCKETS];
+    uint64_t writes;        /* System calls writing the image */
+    uint64_t written;       /* Bytes they wrote */
+    uint64_t writens;       /* Nanoseconds spent in them */
+    size_t  peakbuf;        /* Most frames held in a buffer */
+} mta_stats;
 
 typedef struct _MAGTAPE {
     char    *filename;
@@ -36,6 +71,10 @@ typedef struct _MAGTAPE {
 
 #define MTS_WRITE      0x10000
 #define MTS_METRIC     0x20000
+#define MTS_MAPPED     0x40000
+#define MTS_SKIPPING   0x80000
+#define MTS_NOPOS      0x100000 /* File and record numbers unknown */
+#define MTS_NOISY      0x200000 /* Report noise records even when skipping */
 
     FILE    *fd;
     double  reellen;
@@ -43,12 +82,60 @@ typedef struct _MAGTAPE {
     double  eotpos;
     double density;
     double irg;
+    off_t   offset;         /* Byte offset of next frame in the image */
+    uint8_t *map;           /* Read-only mapping of the image, if MTS_MAPPED */
+    size_t  mapsize;
+    uint8_t *recbuf;        /* Record buffer for views of unmapped images */
+    size_t  recbufsize;
+    uint8_t *rbuf;          /* stdio buffer of unmapped input */
+    struct mta_ring *ring;  /* Readahead of the input, if enabled */
+    struct mta_index *index; /* Record index, if enabled */
+    uint8_t *wbuf;          /* Output buffer (page-aligned) */
+    size_t  wbufsize;
+    size_t  wbuflen;        /* Frames in wbuf not yet written */
+    mta_flushpolicy flush;
+    int     sync;           /* fdatasync when flushed by policy */
+    off_t   laststart;      /* Offset of the last record or mark read */
+    uint32_t lasttype;      /* and its length word */
+    const uint8_t *pending; /* Frames of the last record, if it was too large */
+    struct _MAGTAPE *copyin; /* Input of a pending copy */
+    off_t   copystart;      /* Pending range of copyin's image */
+    off_t   copyend;
+    struct mtzip *zip;      /* Compressed image stream, if any */
+    struct mtaio *aio;      /* io_uring stream of the image file, if any */
+    uint8_t peek[4];        /* Frames read from a pipe to detect compression */
+    size_t  npeek;          /* and not yet returned */
+    const char *tag;        /* Prefix of diagnostics, if not NULL */
+    mta_stats stats;
 } MAGTAPE;
 
+/* Open an image.  A gzip or zstd compressed input image is detected
+ * from its first frames and decompressed as it is read; it can't be
+ * mapped, indexed or read in reverse.  Output is compressed if the file
+ * name ends in .gz or .zst.
+ *
+ * If MAGTAPE_READAHEAD is set in the environment to a size (with an
+ * optional K, M or G suffix), input is not mapped.  Instead, a thread
+ * reads the image into a ring buffer of that size ahead of the records
+ * being read, so that reading overlaps processing.  This helps with
+ * slow or remote storage, and with pipes.
+ *
+ * mode is "r" or "w", optionally followed by "u" to transfer a regular
+ * file with io_uring, keeping several large transfers in flight, or "d"
+ * to do so with O_DIRECT, bypassing the page cache.  Without these,
+ * MAGTAPE_IO in the environment may select uring or direct.  stdio is
+ * used if io_uring isn't available, and for compressed output.
+ */
 MAGTAPE *magtape_open( const char *filename, const char *mode );
 
 int magtape_setsize( MAGTAPE *mta, const char *length, const char *density );
 
+/* Read the next record into buffer.
+ * If it is larger than maxlen, the first maxlen frames are returned with
+ * MTA_BTL and *recsize set to its full length.  The record is held, and
+ * the next magtape_read or magtape_read_view returns it again, so that
+ * it can be read into a larger buffer.
+ */
 unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen, uint32_t *recsize );
 
 #define MTA_OK  0 /* Record read OK */
@@ -60,6 +147,81 @@ unsigned int magtape_read( MAGTAPE *mta, unsigned char *buffer, const size_t max
 #define MTA_FMT 6 /* Format error in tape file */
 #define MTA_BTL 7 /* Block too large for buffer */
 #define MTA_EOT 8 /* EOT encountered on write */
+#define MTA_BOT 9 /* BOT encountered on reverse motion */
+
+/* Read the next record without copying it to a caller buffer.
+ * *data points to the record's frames, either in the file mapping or in
+ * a buffer owned by mta.  It remains valid until the next operation on mta.
+ * Returns the same status codes as magtape_read, except MTA_BTL.
+ */
+unsigned int magtape_read_view( MAGTAPE *mta, const uint8_t **data, uint32_t *recsize );
+
+/* Read a batch of consecutive records into arena.
+ * Each record read, and the tape mark or condition that ends the batch,
+ * gets a descriptor.  A record's frames are at arena + offset, aligned to
+ * 8 bytes.  The batch ends after maxdesc descriptors, at a tape mark,
+ * or at a record that doesn't fit in the rest of the arena.  That record
+ * is held for the next call.  If it doesn't fit in an empty arena, it is
+ * returned with MTA_BTL and its full length, as by magtape_read.
+ * Other non-data statuses end the batch in their descriptor.
+ * Returns the number of descriptors filled, which is 0 only if maxdesc is.
+ */
+
+typedef struct mta_recdesc {
+    size_t   offset;        /* Of the frames in the arena */
+    uint32_t length;        /* Frames in the record, or 0 */
+    uint32_t status;        /* As returned by magtape_read */
+    uint32_t filenum;       /* Position after the record */
+    uint32_t blocknum;
+} mta_recdesc;
+
+size_t magtape_read_batch( MAGTAPE *mta, uint8_t *arena, size_t arenasize,
+                           mta_recdesc *desc, size_t maxdesc );
+
+/* Skip the next record, reading only its length words.
+ * *recsize is set to the record's length.  Returns the same status codes
+ * as magtape_read, except MTA_BTL.  Once used, a mapped image is read
+ * in random order rather than ahead of the current position.  Noise
+ * records are skipped silently unless MTS_NOISY is set.
+ */
+unsigned int magtape_skip_record( MAGTAPE *mta, uint32_t *recsize );
+
+/* Skip the records up to and including the next tape mark.
+ * *records (if not NULL) is set to the number of records skipped.
+ * Returns MTA_TM or MTA_EOF if a tape mark was passed, or the status
+ * that ended the skip.
+ */
+unsigned int magtape_skip_file( MAGTAPE *mta, uint32_t *records );
+
+/* Reverse motion, using the length word that follows each record.
+ *
+ * magtape_read_reverse reads the record before the current position
+ * and leaves the tape positioned before it.  The frames are returned in
+ * forward order.  Noise records are skipped, as by magtape_read.
+ * Crossing a tape mark returns MTA_TM and positions before the mark, at
+ * the end of the previous file.  Reaching the start of the image returns
+ * MTA_BOT.  An input that can't seek returns MTA_IOE.
+ *
+ * magtape_backspace_record does the same without reading the frames;
+ * buffer may be NULL.  magtape_backspace_file backspaces until a tape
+ * mark has been crossed or BOT is reached; *records (if not NULL) is set
+ * to the number of records passed.
+ *
+ * filenum, blocknum and reelpos are maintained in both directions;
+ * blocknum after crossing a tape mark is the record count of the file
+ * it precedes.
+ */
+unsigned int magtape_read_reverse( MAGTAPE *mta, unsigned char *buffer, const size_t maxlen, uint32_t *recsize );
+unsigned int magtape_backspace_record( MAGTAPE *mta, uint32_t *recsize );
+unsigned int magtape_backspace_file( MAGTAPE *mta, uint32_t *records );
+
+/* Position an input tape at the end of its data (before any EOM marker),
+ * without reading it.  File and record numbers come from the index if it
+ * is complete (see magtape_index).  Otherwise they are unknown, and
+ * MTS_NOPOS is set until the next magtape_seek.
+ * Returns MTA_OK, MTA_IOE or MTA_FMT.
+ */
+unsigned int magtape_eom( MAGTAPE *mta );
 
 unsigned int magtape_write( MAGTAPE *mta, unsigned char *buffer, const size_t recsize );
 #define MTA_DATA_ERROR(len) ((len) | 0x80000000)
@@ -71,8 +233,76 @@ typedef enum mta_marktype {
 } mta_marktype;
 unsigned int magtape_mark( MAGTAPE *mta, mta_marktype type );
 
+/* Output is collected in a large buffer and written with as few system
+ * calls as possible; a record that doesn't fit is written together with
+ * the buffer's contents.  Consequently, an I/O error may be reported by a
+ * later call than the one that caused it.
+ *
+ * magtape_setflush sets when the buffer is written (default MTA_FLUSH_FULL),
+ * and whether the data is also synchronized to the device each time.
+ * magtape_flush writes the buffer now, and synchronizes if sync is set.
+ * Both return MTA_OK or MTA_IOE.
+ */
+unsigned int magtape_setflush( MAGTAPE *mta, mta_flushpolicy policy, int sync );
+unsigned int magtape_flush( MAGTAPE *mta, int sync );
+
+/* Record index.
+ * The index holds the image offset, length and error flag of every
+ * record, and the position of every tape mark.  It is kept in a sidecar
+ * file (the image name with .idx appended), which is loaded if it matches
+ * the image and rewritten at close if it changed.  Once enabled, reads
+ * and writes extend the index as a side effect.  scan indexes the rest
+ * of an input image immediately.  Returns 0 on success.
+ */
+int magtape_index( MAGTAPE *mta, int scan );
+
+/* Position an input tape so that the next read returns record (0-based)
+ * of file.  record may equal the number of records in the file, which
+ * positions at the tape mark that ends it.  The index is enabled and
+ * extended as required.  Returns MTA_OK, or MTA_EOM if the record does
+ * not exist, MTA_FMT or MTA_IOE.
+ */
+unsigned int magtape_seek( MAGTAPE *mta, uint32_t file, uint32_t record );
+
+/* Write the record or tape mark last read from in to out, unchanged.
+ * The last read must have been magtape_read_view; the record's frames,
+ * length and error flag are copied as they were.
+ *
+ * When in is mapped, consecutive items are not copied immediately, but
+ * accumulate as a range of in's image.  The range is copied in the
+ * kernel (copy_file_range or splice where possible) when the output is
+ * flushed or something else is written.  in must not be closed until
+ * out has been flushed or closed.
+ *
+ * Returns the same status codes as magtape_write.
+ */
+unsigned int magtape_copy_last( MAGTAPE *out, MAGTAPE *in );
+
+/* Reserve length frames of the image at the current position, for the
+ * caller to fill by pwrite to *fd from *offset, possibly from several
+ * threads.  They must be whole records and tape marks.  counts supplies
+ * their records, errors, marks, frames and sizes for the statistics, and
+ * blocknum the records after the last mark (or in all, if there is none).
+ * The image is positioned after them.  Reel position isn't estimated.
+ *
+ * Only uncompressed, unindexed output to a regular file through stdio
+ * can be reserved; otherwise errno is ESPIPE.
+ * Returns MTA_OK, MTA_EOM after an EOM mark, or MTA_IOE with errno set.
+ */
+unsigned int magtape_reserve( MAGTAPE *mta, off_t length, const mta_stats *counts,
+                              uint32_t blocknum, int *fd, off_t *offset );
+
 void magtape_pprintf( FILE *out, MAGTAPE *mta, int nl );
 
+/* Write a diagnostic to stderr: tag, if not NULL, then the message, then
+ * pos's position, if pos isn't NULL.  The line is formatted first and
+ * written with one write(2), so diagnostics from other threads - or
+ * other processes sharing stderr - can't split it.  errno is preserved.
+ */
+void magtape_report( const char *tag, MAGTAPE *pos, const char *fmt, ... )
+    __attribute__(( format( printf, 3, 4 ) ));
+void magtape_vreport( const char *tag, MAGTAPE *pos, const char *fmt, va_list ap );
+
 void magtape_close( MAGTAPE **mta );
 
 #endif
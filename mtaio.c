@@ -0,0 +1,627 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Asynchronous tape image streams.
+ *
+ * io_uring support requires its kernel header (HAVE_IO_URING); the
+ * library isn't used.  Without it, streams can't be opened.
+ *
+ * A stream has MTAIO_DEPTH slots of MTAIO_BUFSIZE bytes, used in file
+ * order.  Reading starts a read into every slot; the reader consumes
+ * them in turn, and refills each at the end of the window as it is
+ * emptied.  Writing fills the current slot, starts its write when it is
+ * full, and moves on to the next slot once that slot's previous write
+ * has completed.
+ *
+ * O_DIRECT transfers must be aligned, in offset and length, to the
+ * device's block size.  Slots are, and reads start at an aligned offset.
+ * A flush writes the aligned part of a partial slot directly, and the
+ * remainder through the page cache; the remainder stays in the slot,
+ * and is written again directly when the slot is full.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE       /* O_DIRECT */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifdef HAVE_IO_URING
+#  include <linux/io_uring.h>
+#  ifndef __NR_io_uring_setup
+#    undef HAVE_IO_URING
+#  endif
+#endif
+
+#include "buf36.h"
+#include "mtaio.h"
+
+#ifndef MTAIO_DEPTH             /* Transfers in flight */
+#  define MTAIO_DEPTH 8
+#endif
+
+#ifndef MTAIO_BUFSIZE           /* Bytes per transfer */
+#  define MTAIO_BUFSIZE (1024 * 1024)
+#endif
+
+#define MTAIO_ALIGN 4096        /* O_DIRECT alignment: the largest block size */
+
+#ifdef HAVE_IO_URING
+
+typedef enum {
+    SLOT_FREE,                  /* Writing: filling, or written */
+    SLOT_BUSY,                  /* Transfer in flight */
+    SLOT_READY                  /* Reading: read, or failed */
+} slotstate_T;
+
+typedef struct {
+    uint8_t *buf;
+    off_t   off;                /* File offset of buf[0] */
+    size_t  len;                /* Bytes to transfer, or filled */
+    size_t  done;               /* Bytes transferred */
+    size_t  pos;                /* Bytes consumed by the reader */
+    slotstate_T state;
+} slot_T;
+
+struct mtaio {
+    int     fd;
+    int     ringfd;
+    int     writing;
+    int     direct;             /* O_DIRECT was set */
+    int     fixed;              /* Buffers are registered */
+    int     oflags;             /* fd's file status flags before */
+    int     error;              /* errno of the first error */
+    off_t   base;               /* File offset of stream offset 0 */
+    off_t   next;               /* Reading: file offset of the next read */
+    unsigned int cur;           /* Slot being consumed or filled */
+    unsigned int busy;          /* Transfers in flight */
+    slot_T  slots[MTAIO_DEPTH];
+    buf36_T mem;
+
+    uint8_t *sqmap, *cqmap;
+    size_t  sqmapsize, cqmapsize;
+    struct io_uring_sqe *sqes;
+    size_t  sqessize;
+    unsigned int *sqtail, *sqarray, sqmask;
+    unsigned int *cqhead, *cqtail, cqmask;
+    struct io_uring_cqe *cqes;
+};
+
+static MTAIO *setup( int fd, int flags, int writing );
+static int map_rings( MTAIO *aio, struct io_uring_params *p );
+static void teardown( MTAIO *aio );
+static int submit( MTAIO *aio, unsigned int i );
+static int reap( MTAIO *aio, int wait );
+static void complete( MTAIO *aio, unsigned int i, int res );
+static int drain( MTAIO *aio );
+static void start_reads( MTAIO *aio, off_t offset );
+static int refill( MTAIO *aio );
+static int rotate( MTAIO *aio, size_t len );
+
+/* Reading */
+
+MTAIO *mtaio_open_read( int fd, int flags ) {
+    MTAIO *aio;
+
+    aio = setup( fd, flags, 0 );
+    if( aio == NULL )
+        return NULL;
+    start_reads( aio, aio->base );
+    return aio;
+}
+
+size_t mtaio_read( MTAIO *aio, void *buffer, size_t length ) {
+    uint8_t *bp = buffer;
+    size_t got = 0;
+
+    while( got < length ) {
+        slot_T *s = aio->slots + aio->cur;
+        size_t n;
+
+        while( s->state == SLOT_BUSY ) {
+            if( reap( aio, 1 ) != 0 )
+                return got;
+        }
+        if( s->pos < s->done ) {
+            n = s->done - s->pos;
+            if( n > length - got )
+                n = length - got;
+            memcpy( bp + got, s->buf + s->pos, n );
+            s->pos += n;
+            got += n;
+            continue;
+        }
+        if( s->done < s->len || aio->error ) /* End of file */
+            break;
+        if( refill( aio ) != 0 )
+            break;
+    }
+    return got;
+}
+
+int mtaio_seek( MTAIO *aio, off_t offset ) {
+    off_t target = aio->base + offset;
+
+    if( !aio->error && target >= aio->slots[aio->cur].off && target < aio->next ) {
+        while( 1 ) {            /* Within the reads started: consume up to it */
+            slot_T *s = aio->slots + aio->cur;
+
+            while( s->state == SLOT_BUSY ) {
+                if( reap( aio, 1 ) != 0 )
+                    return -1;
+            }
+            if( target <= s->off + (off_t)s->done ||
+                s->done < s->len || aio->error ) {
+                s->pos = (target <= s->off + (off_t)s->done)?
+                    (size_t)(target - s->off): s->done;
+                return 0;
+            }
+            s->pos = s->done;
+            if( refill( aio ) != 0 )
+                return 0;
+        }
+    }
+    if( drain( aio ) != 0 )
+        return -1;
+    start_reads( aio, target );
+    return 0;
+}
+
+int mtaio_error( MTAIO *aio ) {
+    return aio->error;
+}
+
+/* Start reading at offset, into every slot.
+ */
+
+static void start_reads( MTAIO *aio, off_t offset ) {
+    off_t aligned = aio->direct? (offset & ~(off_t)(MTAIO_ALIGN - 1)): offset;
+    unsigned int i;
+
+    aio->error = 0;
+    aio->cur = 0;
+    aio->next = aligned;
+    for( i = 0; i < MTAIO_DEPTH; i++ ) {
+        slot_T *s = aio->slots + i;
+
+        s->off = aio->next;
+        s->len = MTAIO_BUFSIZE;
+        s->done = 0;
+        s->pos = 0;
+        aio->next += MTAIO_BUFSIZE;
+        if( submit( aio, i ) != 0 ) {
+            aio->error = errno;
+            s->state = SLOT_READY;
+        }
+    }
+    aio->slots[0].pos = (size_t)(offset - aligned);
+    return;
+}
+
+/* Reuse the consumed current slot for the next read, and move on.
+ * Returns 0, or -1 if the read can't be started.
+ */
+
+static int refill( MTAIO *aio ) {
+    slot_T *s = aio->slots + aio->cur;
+
+    s->off = aio->next;
+    s->len = MTAIO_BUFSIZE;
+    s->done = 0;
+    s->pos = 0;
+    if( submit( aio, aio->cur ) != 0 ) {
+        aio->error = errno;
+        s->state = SLOT_READY;
+        return -1;
+    }
+    aio->next += MTAIO_BUFSIZE;
+    aio->cur = (aio->cur + 1) % MTAIO_DEPTH;
+    return 0;
+}
+
+/* Writing */
+
+MTAIO *mtaio_open_write( int fd, int flags ) {
+    MTAIO *aio;
+
+    aio = setup( fd, flags, 1 );
+    if( aio == NULL )
+        return NULL;
+    aio->slots[0].off = aio->base;
+    return aio;
+}
+
+int mtaio_write( MTAIO *aio, const struct iovec *iov, int iovcnt ) {
+    int started = 0;
+
+    for( ; iovcnt > 0; iov++, iovcnt-- ) {
+        const uint8_t *p = iov->iov_base;
+        size_t left = iov->iov_len;
+
+        while( left ) {
+            slot_T *s = aio->slots + aio->cur;
+            size_t n = MTAIO_BUFSIZE - s->len;
+
+            if( n > left )
+                n = left;
+            memcpy( s->buf + s->len, p, n );
+            s->len += n;
+            p += n;
+            left -= n;
+            if( s->len == MTAIO_BUFSIZE ) {
+                if( rotate( aio, MTAIO_BUFSIZE ) != 0 )
+                    return -1;
+                started++;
+            }
+        }
+    }
+    if( aio->error ) {
+        errno = aio->error;
+        return -1;
+    }
+    return started;
+}
+
+int mtaio_flush( MTAIO *aio ) {
+    slot_T *s = aio->slots + aio->cur;
+    size_t len = s->len;
+
+    if( aio->direct )
+        len &= ~(size_t)(MTAIO_ALIGN - 1);
+    if( len && rotate( aio, len ) != 0 )
+        return -1;
+    if( drain( aio ) != 0 )
+        return -1;
+
+    s = aio->slots + aio->cur;
+    if( aio->direct && s->len && !aio->error ) { /* Unaligned remainder */
+        size_t done = 0;
+
+        if( fcntl( aio->fd, F_SETFL, aio->oflags ) != 0 )
+            return -1;
+        while( done < s->len ) {
+            ssize_t n = pwrite( aio->fd, s->buf + done, s->len - done,
+                                s->off + (off_t)done );
+            if( n < 0 ) {
+                if( errno == EINTR )
+                    continue;
+                aio->error = errno;
+                break;
+            }
+            done += (size_t)n;
+        }
+        if( fcntl( aio->fd, F_SETFL, aio->oflags | O_DIRECT ) != 0 && !aio->error )
+            aio->error = errno;
+    }
+    if( aio->error ) {
+        errno = aio->error;
+        return -1;
+    }
+    return 0;
+}
+
+/* Start writing the first len bytes of the current slot, and move the
+ * rest to the next slot, which becomes current.
+ */
+
+static int rotate( MTAIO *aio, size_t len ) {
+    unsigned int next = (aio->cur + 1) % MTAIO_DEPTH;
+    slot_T *s = aio->slots + aio->cur, *t = aio->slots + next;
+
+    while( t->state == SLOT_BUSY ) {
+        if( reap( aio, 1 ) != 0 )
+            return -1;
+    }
+    t->off = s->off + (off_t)len;
+    t->len = s->len - len;
+    t->done = 0;
+    memcpy( t->buf, s->buf + len, t->len );
+
+    s->len = len;
+    s->done = 0;
+    if( submit( aio, aio->cur ) != 0 )
+        return -1;
+    aio->cur = next;
+    return 0;
+}
+
+int mtaio_close( MTAIO *aio ) {
+    int rc = 0;
+
+    if( aio->writing )
+        rc = mtaio_flush( aio );
+    else
+        (void) drain( aio );
+    teardown( aio );
+    return rc;
+}
+
+/* The ring */
+
+static MTAIO *setup( int fd, int flags, int writing ) {
+    struct io_uring_params p;
+    struct iovec iov[MTAIO_DEPTH];
+    struct stat st;
+    MTAIO *aio;
+    unsigned int i;
+
+    if( fstat( fd, &st ) != 0 )
+        return NULL;
+    if( !S_ISREG( st.st_mode ) ) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    aio = calloc( 1, sizeof( *aio ) );
+    if( aio == NULL )
+        return NULL;
+    aio->fd = fd;
+    aio->writing = writing;
+    aio->ringfd = -1;
+    aio->base = lseek( fd, 0, SEEK_CUR );
+    if( aio->base < 0 ||
+        buf36_reserve( &aio->mem, (size_t)MTAIO_DEPTH * MTAIO_BUFSIZE ) != 0 ) {
+        free( aio );
+        return NULL;
+    }
+    for( i = 0; i < MTAIO_DEPTH; i++ ) {
+        aio->slots[i].buf = (uint8_t *)aio->mem.data + (size_t)i * MTAIO_BUFSIZE;
+        iov[i].iov_base = aio->slots[i].buf;
+        iov[i].iov_len = MTAIO_BUFSIZE;
+    }
+
+    memset( &p, 0, sizeof( p ) );
+    aio->ringfd = (int)syscall( __NR_io_uring_setup, MTAIO_DEPTH, &p );
+    if( aio->ringfd < 0 || map_rings( aio, &p ) != 0 ) {
+        int err = errno;
+
+        teardown( aio );
+        errno = err;
+        return NULL;
+    }
+
+    /* Registration pins the buffers, which may exceed RLIMIT_MEMLOCK */
+
+    aio->fixed = syscall( __NR_io_uring_register, aio->ringfd,
+                          IORING_REGISTER_BUFFERS, iov, MTAIO_DEPTH ) == 0;
+
+    aio->oflags = fcntl( fd, F_GETFL );
+    if( (flags & MTAIO_DIRECT) && aio->oflags != -1 &&
+        (aio->base & (MTAIO_ALIGN - 1)) == 0 )
+        aio->direct = fcntl( fd, F_SETFL, aio->oflags | O_DIRECT ) == 0;
+    return aio;
+}
+
+static int map_rings( MTAIO *aio, struct io_uring_params *p ) {
+    aio->sqmapsize = p->sq_off.array + p->sq_entries * sizeof( unsigned int );
+    aio->cqmapsize = p->cq_off.cqes + p->cq_entries * sizeof( struct io_uring_cqe );
+    if( p->features & IORING_FEAT_SINGLE_MMAP ) {
+        if( aio->cqmapsize > aio->sqmapsize )
+            aio->sqmapsize = aio->cqmapsize;
+        aio->cqmapsize = 0;
+    }
+    aio->sqmap = mmap( NULL, aio->sqmapsize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, aio->ringfd, IORING_OFF_SQ_RING );
+    if( aio->sqmap == MAP_FAILED ) {
+        aio->sqmap = NULL;
+        return -1;
+    }
+    if( aio->cqmapsize ) {
+        aio->cqmap = mmap( NULL, aio->cqmapsize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, aio->ringfd, IORING_OFF_CQ_RING );
+        if( aio->cqmap == MAP_FAILED ) {
+            aio->cqmap = NULL;
+            return -1;
+        }
+    } else {
+        aio->cqmap = aio->sqmap;
+    }
+    aio->sqessize = p->sq_entries * sizeof( struct io_uring_sqe );
+    aio->sqes = mmap( NULL, aio->sqessize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, aio->ringfd, IORING_OFF_SQES );
+    if( aio->sqes == MAP_FAILED ) {
+        aio->sqes = NULL;
+        return -1;
+    }
+
+    aio->sqtail = (unsigned int *)(aio->sqmap + p->sq_off.tail);
+    aio->sqmask = *(unsigned int *)(aio->sqmap + p->sq_off.ring_mask);
+    aio->sqarray = (unsigned int *)(aio->sqmap + p->sq_off.array);
+    aio->cqhead = (unsigned int *)(aio->cqmap + p->cq_off.head);
+    aio->cqtail = (unsigned int *)(aio->cqmap + p->cq_off.tail);
+    aio->cqmask = *(unsigned int *)(aio->cqmap + p->cq_off.ring_mask);
+    aio->cqes = (struct io_uring_cqe *)(aio->cqmap + p->cq_off.cqes);
+    return 0;
+}
+
+static void teardown( MTAIO *aio ) {
+    if( aio->direct )
+        (void) fcntl( aio->fd, F_SETFL, aio->oflags );
+    if( aio->sqes )
+        (void) munmap( aio->sqes, aio->sqessize );
+    if( aio->cqmap && aio->cqmap != aio->sqmap )
+        (void) munmap( aio->cqmap, aio->cqmapsize );
+    if( aio->sqmap )
+        (void) munmap( aio->sqmap, aio->sqmapsize );
+    if( aio->ringfd >= 0 )
+        (void) close( aio->ringfd );
+    buf36_free( &aio->mem );
+    free( aio );
+    return;
+}
+
+/* Start the rest of slot i's transfer.  The submission queue is at least
+ * MTAIO_DEPTH long, so it can't be full.  Returns 0, or -1 with errno set.
+ */
+
+static int submit( MTAIO *aio, unsigned int i ) {
+    slot_T *s = aio->slots + i;
+    unsigned int tail = *aio->sqtail, idx = tail & aio->sqmask;
+    struct io_uring_sqe *sqe = aio->sqes + idx;
+
+    memset( sqe, 0, sizeof( *sqe ) );
+    if( aio->fixed ) {
+        sqe->opcode = aio->writing? IORING_OP_WRITE_FIXED: IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t)i;
+    } else {
+        sqe->opcode = aio->writing? IORING_OP_WRITE: IORING_OP_READ;
+    }
+    sqe->fd = aio->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(s->buf + s->done);
+    sqe->len = (uint32_t)(s->len - s->done);
+    sqe->off = (uint64_t)(s->off + (off_t)s->done);
+    sqe->user_data = i;
+    aio->sqarray[idx] = idx;
+    __atomic_store_n( aio->sqtail, tail + 1, __ATOMIC_RELEASE );
+
+    while( syscall( __NR_io_uring_enter, aio->ringfd, 1, 0, 0, NULL, 0 ) < 0 ) {
+        if( errno != EINTR ) {
+            __atomic_store_n( aio->sqtail, tail, __ATOMIC_RELEASE );
+            return -1;
+        }
+    }
+    s->state = SLOT_BUSY;
+    aio->busy++;
+    return 0;
+}
+
+/* Process completions, waiting for one if wait.
+ * Returns 0, or -1 with errno set if waiting failed.
+ */
+
+static int reap( MTAIO *aio, int wait ) {
+    unsigned int head, tail;
+
+    if( wait ) {
+        while( syscall( __NR_io_uring_enter, aio->ringfd, 0, 1,
+                        IORING_ENTER_GETEVENTS, NULL, 0 ) < 0 ) {
+            if( errno != EINTR ) {
+                if( !aio->error )
+                    aio->error = errno;
+                return -1;
+            }
+        }
+    }
+    head = *aio->cqhead;
+    tail = __atomic_load_n( aio->cqtail, __ATOMIC_ACQUIRE );
+    for( ; head != tail; head++ ) {
+        struct io_uring_cqe *cqe = aio->cqes + (head & aio->cqmask);
+
+        complete( aio, (unsigned int)cqe->user_data, cqe->res );
+    }
+    __atomic_store_n( aio->cqhead, head, __ATOMIC_RELEASE );
+    return 0;
+}
+
+/* Handle slot i's completion.  A short transfer is continued, except a
+ * direct read that ends off a block boundary, which is the end of file.
+ */
+
+static void complete( MTAIO *aio, unsigned int i, int res ) {
+    slot_T *s = aio->slots + i;
+
+    aio->busy--;
+    if( res == -EINTR || res == -EAGAIN ) {
+        if( submit( aio, i ) == 0 )
+            return;
+        res = -errno;
+    }
+    if( res < 0 ) {
+        if( !aio->error )
+            aio->error = -res;
+    } else {
+        s->done += (size_t)res;
+        if( res > 0 && s->done < s->len &&
+            !(aio->direct && !aio->writing && (s->done & (MTAIO_ALIGN - 1))) &&
+            submit( aio, i ) == 0 )
+            return;
+        if( res == 0 && aio->writing && !aio->error )
+            aio->error = EIO;
+    }
+    s->state = aio->writing? SLOT_FREE: SLOT_READY;
+    return;
+}
+
+/* Wait for every transfer in flight.
+ */
+
+static int drain( MTAIO *aio ) {
+    while( aio->busy ) {
+        if( reap( aio, 1 ) != 0 )
+            return -1;
+    }
+    return 0;
+}
+
+#else /* No io_uring */
+
+MTAIO *mtaio_open_read( int fd, int flags ) {
+    (void) fd;
+    (void) flags;
+    errno = ENOSYS;
+    return NULL;
+}
+
+MTAIO *mtaio_open_write( int fd, int flags ) {
+    (void) fd;
+    (void) flags;
+    errno = ENOSYS;
+    return NULL;
+}
+
+size_t mtaio_read( MTAIO *aio, void *buffer, size_t length ) {
+    (void) aio;
+    (void) buffer;
+    (void) length;
+    abort();
+}
+
+int mtaio_seek( MTAIO *aio, off_t offset ) {
+    (void) aio;
+    (void) offset;
+    abort();
+}
+
+int mtaio_error( MTAIO *aio ) {
+    (void) aio;
+    abort();
+}
+
+int mtaio_write( MTAIO *aio, const struct iovec *iov, int iovcnt ) {
+    (void) aio;
+    (void) iov;
+    (void) iovcnt;
+    abort();
+}
+
+int mtaio_flush( MTAIO *aio ) {
+    (void) aio;
+    abort();
+}
+
+int mtaio_close( MTAIO *aio ) {
+    (void) aio;
+    abort();
+}
+
+#endif
+
+/* EOF */
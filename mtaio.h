@@ -0,0 +1,62 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef MTAIO_H
+#define MTAIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Asynchronous tape image streams.
+ *
+ * A stream reads or writes a regular file sequentially, keeping several
+ * large transfers in flight with io_uring, in buffers registered with
+ * the kernel.  With MTAIO_DIRECT, transfers bypass the page cache, so a
+ * one-pass conversion of a large image doesn't evict everything else.
+ *
+ * io_uring is used through its system calls.  If the kernel (or build)
+ * doesn't support it, or fd isn't a regular file, opening a stream fails
+ * and the caller uses ordinary I/O.
+ *
+ * Offsets are relative to fd's position when the stream is opened.
+ */
+
+typedef struct mtaio MTAIO;
+
+#define MTAIO_DIRECT 1          /* Use O_DIRECT if the file system allows */
+
+/* Read from fd.  mtaio_read returns the number of bytes read, which is
+ * short only at the end of the file or on error.  mtaio_seek positions
+ * the next read; a position past the end is detected by that read.
+ * mtaio_error returns the errno of the first error since opening or
+ * the last seek, or 0.
+ */
+MTAIO *mtaio_open_read( int fd, int flags );
+size_t mtaio_read( MTAIO *aio, void *buffer, size_t length );
+int mtaio_seek( MTAIO *aio, off_t offset );
+int mtaio_error( MTAIO *aio );
+
+/* Write to fd.  mtaio_write returns the number of transfers it started,
+ * or -1 with errno set.  mtaio_flush waits until everything written has
+ * reached the file.  mtaio_flush and mtaio_close return 0, or -1 with
+ * errno set.  mtaio_close flushes and frees aio in either direction;
+ * fd remains open.
+ */
+MTAIO *mtaio_open_write( int fd, int flags );
+int mtaio_write( MTAIO *aio, const struct iovec *iov, int iovcnt );
+int mtaio_flush( MTAIO *aio );
+int mtaio_close( MTAIO *aio );
+
+#endif
@@ -0,0 +1,618 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Compressed tape image streams.
+ *
+ * gzip support requires zlib (HAVE_ZLIB), zstd support libzstd
+ * (HAVE_ZSTD).  Without them, the format is detected but can't be used.
+ *
+ * Output blocks are compressed independently, which costs a little
+ * compression but lets them be compressed in parallel.  Blocks live in a
+ * ring of slots.  The writer fills a slot and queues it; workers compress
+ * queued slots, oldest first.  Before a slot is refilled, the writer waits
+ * for its previous block to be compressed and writes it, so blocks are
+ * written in order and at most one ring of them is in memory.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "mtzip.h"
+
+#define MTZIP_INSIZE  (256 * 1024)   /* Compressed input buffer */
+#define MTZIP_BLOCK   (1024 * 1024)  /* Uncompressed output block */
+#define MTZIP_MAXTHREADS 16
+
+typedef enum {
+    ZB_FREE,
+    ZB_QUEUED,                  /* Filled, waiting for a worker */
+    ZB_BUSY,                    /* Being compressed */
+    ZB_DONE                     /* Compressed, waiting to be written */
+} zbstate_T;
+
+typedef struct {
+    zbstate_T state;
+    uint64_t seq;
+    uint8_t *data;              /* Uncompressed */
+    size_t  len;
+    uint8_t *out;               /* Compressed */
+    size_t  outsize;
+    size_t  outlen;
+    int     error;
+} zblock_T;
+
+struct mtzip {
+    mtzip_format format;
+    int     writing;
+    int     error;              /* errno of the first error */
+
+    /* Reading */
+    mtzip_readfn *readfn;
+    void    *arg;
+    uint8_t *in;
+    size_t  inlen, inpos;
+    int     eof;                /* No more compressed input */
+    int     end;                /* No more decompressed output */
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zd;
+    size_t  zdhint;             /* Last ZSTD_decompressStream result */
+#endif
+
+    /* Writing */
+    int     fd;
+    int     level;
+    unsigned int nthreads;
+    pthread_t *threads;
+    zblock_T *slots;
+    unsigned int nslots;
+    uint64_t seq;               /* Sequence of the block being filled */
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    int     stop;
+};
+
+static int compress_block( MTZIP *zip, zblock_T *b );
+static void *zip_worker( void *arg );
+static int submit( MTZIP *zip );
+static int retire( MTZIP *zip, zblock_T *b );
+static int write_out( int fd, const uint8_t *data, size_t len );
+
+mtzip_format mtzip_detect( const uint8_t *magic, size_t len ) {
+    /* A gzip header can't be mistaken for a length word unless its flags
+     * are 0 and the tape starts with a 559,903-frame record.
+     */
+
+    if( len >= 3 && magic[0] == 0x1F && magic[1] == 0x8B && magic[2] == 0x08 )
+        return MTZIP_GZIP;
+    if( len >= 4 && magic[0] == 0x28 && magic[1] == 0xB5 &&
+        magic[2] == 0x2F && magic[3] == 0xFD )
+        return MTZIP_ZSTD;
+    return MTZIP_NONE;
+}
+
+mtzip_format mtzip_suffix( const char *filename ) {
+    size_t len = strlen( filename );
+
+    if( len > 3 && !strcmp( filename + len - 3, ".gz" ) )
+        return MTZIP_GZIP;
+    if( len > 4 && !strcmp( filename + len - 4, ".zst" ) )
+        return MTZIP_ZSTD;
+    return MTZIP_NONE;
+}
+
+int mtzip_available( mtzip_format format ) {
+    switch( format ) {
+#ifdef HAVE_ZLIB
+    case MTZIP_GZIP:
+        return 1;
+#endif
+#ifdef HAVE_ZSTD
+    case MTZIP_ZSTD:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *mtzip_name( mtzip_format format ) {
+    switch( format ) {
+    case MTZIP_GZIP:
+        return "gzip";
+    case MTZIP_ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+/* Reading */
+
+MTZIP *mtzip_open_read( mtzip_readfn *readfn, void *arg, mtzip_format format,
+                        const uint8_t *prefix, size_t prelen ) {
+    MTZIP *zip;
+
+    if( !mtzip_available( format ) ) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    zip = calloc( 1, sizeof( *zip ) );
+    if( zip == NULL )
+        return NULL;
+    zip->format = format;
+    zip->readfn = readfn;
+    zip->arg = arg;
+    zip->in = malloc( MTZIP_INSIZE );
+    if( zip->in == NULL || prelen > MTZIP_INSIZE ) {
+        free( zip->in );
+        free( zip );
+        return NULL;
+    }
+    memcpy( zip->in, prefix, prelen );
+    zip->inlen = prelen;
+
+    switch( format ) {
+#ifdef HAVE_ZLIB
+    case MTZIP_GZIP:
+        if( inflateInit2( &zip->zs, 15 + 32 ) != Z_OK ) { /* gzip header */
+            free( zip->in );
+            free( zip );
+            errno = ENOMEM;
+            return NULL;
+        }
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case MTZIP_ZSTD:
+        zip->zd = ZSTD_createDStream();
+        if( zip->zd == NULL ) {
+            free( zip->in );
+            free( zip );
+            errno = ENOMEM;
+            return NULL;
+        }
+        (void) ZSTD_initDStream( zip->zd );
+        break;
+#endif
+    default:
+        abort();
+    }
+    return zip;
+}
+
+/* Get more compressed input.  Returns 0 if there is none.
+ */
+
+static int refill( MTZIP *zip ) {
+    ssize_t n;
+
+    if( zip->inpos < zip->inlen )
+        return 1;
+    if( zip->eof )
+        return 0;
+    n = zip->readfn( zip->arg, zip->in, MTZIP_INSIZE );
+    if( n <= 0 ) {
+        zip->eof = 1;
+        if( n < 0 )
+            zip->error = errno? errno: EIO;
+        return 0;
+    }
+    zip->inpos = 0;
+    zip->inlen = (size_t)n;
+    return 1;
+}
+
+size_t mtzip_read( MTZIP *zip, void *buffer, size_t length ) {
+    uint8_t *bp = buffer;
+    size_t got = 0;
+
+    while( got < length && !zip->end && !zip->error ) {
+        int more = refill( zip );
+
+        switch( zip->format ) {
+#ifdef HAVE_ZLIB
+        case MTZIP_GZIP: {
+            size_t want = length - got;
+            int rc;
+
+            if( !more ) {   /* Input ended inside a member */
+                zip->error = EIO;
+                break;
+            }
+            if( want > UINT_MAX )
+                want = UINT_MAX;
+            zip->zs.next_in = zip->in + zip->inpos;
+            zip->zs.avail_in = (uInt)(zip->inlen - zip->inpos);
+            zip->zs.next_out = bp + got;
+            zip->zs.avail_out = (uInt)want;
+            rc = inflate( &zip->zs, Z_NO_FLUSH );
+            zip->inpos = zip->inlen - zip->zs.avail_in;
+            got += want - zip->zs.avail_out;
+            if( rc == Z_STREAM_END ) {
+                /* Another member may follow */
+                if( refill( zip ) )
+                    (void) inflateReset( &zip->zs );
+                else if( !zip->error )
+                    zip->end = 1;
+            } else if( rc != Z_OK && rc != Z_BUF_ERROR ) {
+                zip->error = EIO;
+            }
+            break;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case MTZIP_ZSTD: {
+            ZSTD_inBuffer in;
+            ZSTD_outBuffer out;
+
+            if( !more ) {
+                if( zip->zdhint != 0 )  /* Input ended inside a frame */
+                    zip->error = EIO;
+                else if( !zip->error )
+                    zip->end = 1;
+                break;
+            }
+            in.src = zip->in;
+            in.size = zip->inlen;
+            in.pos = zip->inpos;
+            out.dst = bp;
+            out.size = length;
+            out.pos = got;
+            zip->zdhint = ZSTD_decompressStream( zip->zd, &out, &in );
+            if( ZSTD_isError( zip->zdhint ) ) {
+                zip->error = EIO;
+                break;
+            }
+            zip->inpos = in.pos;
+            got = out.pos;
+            break;
+        }
+#endif
+        default:
+            (void) bp;
+            (void) more;
+            abort();
+        }
+    }
+    return got;
+}
+
+int mtzip_error( MTZIP *zip ) {
+    return zip->error;
+}
+
+/* Writing */
+
+MTZIP *mtzip_open_write( int fd, mtzip_format format, int level, unsigned int threads ) {
+    MTZIP *zip;
+    unsigned int i;
+
+    if( !mtzip_available( format ) ) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    if( threads == 0 ) {
+        long n = sysconf( _SC_NPROCESSORS_ONLN );
+
+        threads = (n > 1)? (unsigned int)n: 0; /* One CPU: compress inline */
+    }
+    if( threads > MTZIP_MAXTHREADS )
+        threads = MTZIP_MAXTHREADS;
+
+    zip = calloc( 1, sizeof( *zip ) );
+    if( zip == NULL )
+        return NULL;
+    zip->format = format;
+    zip->writing = 1;
+    zip->fd = fd;
+    zip->level = level;
+    if( level == 0 )
+        zip->level = (format == MTZIP_ZSTD)? 3: 6;
+    zip->nthreads = threads;
+    zip->nslots = threads? 2 * threads + 1: 1;
+    zip->slots = calloc( zip->nslots, sizeof( *zip->slots ) );
+    if( zip->slots == NULL ) {
+        free( zip );
+        return NULL;
+    }
+    pthread_mutex_init( &zip->lock, NULL );
+    pthread_cond_init( &zip->work, NULL );
+    pthread_cond_init( &zip->done, NULL );
+
+    if( threads ) {
+        zip->threads = calloc( threads, sizeof( *zip->threads ) );
+        if( zip->threads == NULL ) {
+            (void) mtzip_close( zip );
+            return NULL;
+        }
+        for( i = 0; i < threads; i++ ) {
+            if( pthread_create( zip->threads + i, NULL, zip_worker, zip ) ) {
+                zip->nthreads = i;
+                (void) mtzip_close( zip );
+                return NULL;
+            }
+        }
+    }
+    return zip;
+}
+
+int mtzip_write( MTZIP *zip, const struct iovec *iov, int iovcnt ) {
+    int i;
+
+    if( zip->error ) {
+        errno = zip->error;
+        return -1;
+    }
+    for( i = 0; i < iovcnt; i++ ) {
+        const uint8_t *src = iov[i].iov_base;
+        size_t len = iov[i].iov_len;
+
+        while( len ) {
+            zblock_T *b = zip->slots + zip->seq % zip->nslots;
+            size_t n;
+
+            if( b->state != ZB_FREE && retire( zip, b ) != 0 )
+                return -1;
+            if( b->data == NULL && (b->data = malloc( MTZIP_BLOCK )) == NULL )
+                return -1;
+            n = MTZIP_BLOCK - b->len;
+            if( n > len )
+                n = len;
+            memcpy( b->data + b->len, src, n );
+            b->len += n;
+            src += n;
+            len -= n;
+            if( b->len == MTZIP_BLOCK && submit( zip ) != 0 )
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int mtzip_flush( MTZIP *zip ) {
+    unsigned int i;
+
+    if( zip->slots[zip->seq % zip->nslots].len && submit( zip ) != 0 )
+        return -1;
+
+    /* Oldest first: the next slot to be filled holds the oldest block */
+
+    for( i = 0; i < zip->nslots; i++ ) {
+        zblock_T *b = zip->slots + (zip->seq + i) % zip->nslots;
+
+        if( b->state != ZB_FREE && retire( zip, b ) != 0 )
+            return -1;
+    }
+    if( zip->error ) {
+        errno = zip->error;
+        return -1;
+    }
+    return 0;
+}
+
+int mtzip_close( MTZIP *zip ) {
+    int rc = 0;
+    unsigned int i;
+
+    if( zip->writing ) {
+        rc = mtzip_flush( zip );
+
+        pthread_mutex_lock( &zip->lock );
+        zip->stop = 1;
+        pthread_cond_broadcast( &zip->work );
+        pthread_mutex_unlock( &zip->lock );
+        for( i = 0; i < zip->nthreads; i++ )
+            pthread_join( zip->threads[i], NULL );
+
+        for( i = 0; i < zip->nslots; i++ ) {
+            free( zip->slots[i].data );
+            free( zip->slots[i].out );
+        }
+        pthread_mutex_destroy( &zip->lock );
+        pthread_cond_destroy( &zip->work );
+        pthread_cond_destroy( &zip->done );
+        free( zip->threads );
+        free( zip->slots );
+    } else {
+        switch( zip->format ) {
+#ifdef HAVE_ZLIB
+        case MTZIP_GZIP:
+            (void) inflateEnd( &zip->zs );
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case MTZIP_ZSTD:
+            (void) ZSTD_freeDStream( zip->zd );
+            break;
+#endif
+        default:
+            break;
+        }
+        free( zip->in );
+    }
+    free( zip );
+
+    return rc;
+}
+
+/* Queue the block being filled for compression.
+ */
+
+static int submit( MTZIP *zip ) {
+    zblock_T *b = zip->slots + zip->seq % zip->nslots;
+
+    b->seq = zip->seq++;
+    if( zip->nthreads == 0 ) {
+        b->state = ZB_DONE;
+        b->error = compress_block( zip, b );
+        return retire( zip, b );
+    }
+    pthread_mutex_lock( &zip->lock );
+    b->state = ZB_QUEUED;
+    pthread_cond_signal( &zip->work );
+    pthread_mutex_unlock( &zip->lock );
+
+    return 0;
+}
+
+/* Wait for a block to be compressed, write it and free its slot.
+ */
+
+static int retire( MTZIP *zip, zblock_T *b ) {
+    pthread_mutex_lock( &zip->lock );
+    while( b->state != ZB_DONE )
+        pthread_cond_wait( &zip->done, &zip->lock );
+    pthread_mutex_unlock( &zip->lock );
+
+    if( b->error && !zip->error )
+        zip->error = b->error;
+    if( !zip->error && write_out( zip->fd, b->out, b->outlen ) != 0 )
+        zip->error = errno;
+    b->state = ZB_FREE;
+    b->len = 0;
+    b->error = 0;
+
+    if( zip->error ) {
+        errno = zip->error;
+        return -1;
+    }
+    return 0;
+}
+
+static void *zip_worker( void *arg ) {
+    MTZIP *zip = arg;
+
+    pthread_mutex_lock( &zip->lock );
+    while( 1 ) {
+        zblock_T *b = NULL;
+        unsigned int i;
+
+        for( i = 0; i < zip->nslots; i++ ) {
+            zblock_T *s = zip->slots + i;
+
+            if( s->state == ZB_QUEUED && (b == NULL || s->seq < b->seq) )
+                b = s;
+        }
+        if( b == NULL ) {
+            if( zip->stop )
+                break;
+            pthread_cond_wait( &zip->work, &zip->lock );
+            continue;
+        }
+        b->state = ZB_BUSY;
+        pthread_mutex_unlock( &zip->lock );
+
+        b->error = compress_block( zip, b );
+
+        pthread_mutex_lock( &zip->lock );
+        b->state = ZB_DONE;
+        pthread_cond_broadcast( &zip->done );
+    }
+    pthread_mutex_unlock( &zip->lock );
+
+    return NULL;
+}
+
+/* Compress a block as a complete member or frame.
+ * Returns 0 or an errno value.
+ */
+
+static int compress_block( MTZIP *zip, zblock_T *b ) {
+    size_t bound;
+
+    switch( zip->format ) {
+#ifdef HAVE_ZLIB
+    case MTZIP_GZIP: {
+        z_stream zs;
+        int rc;
+
+        memset( &zs, 0, sizeof( zs ) );
+        if( deflateInit2( &zs, zip->level, Z_DEFLATED, 15 + 16, 8,
+                          Z_DEFAULT_STRATEGY ) != Z_OK )
+            return ENOMEM;
+        bound = deflateBound( &zs, (uLong)b->len );
+        if( bound > b->outsize ) {
+            free( b->out );
+            b->outsize = 0;
+            if( (b->out = malloc( bound )) == NULL ) {
+                (void) deflateEnd( &zs );
+                return ENOMEM;
+            }
+            b->outsize = bound;
+        }
+        zs.next_in = b->data;
+        zs.avail_in = (uInt)b->len;
+        zs.next_out = b->out;
+        zs.avail_out = (uInt)b->outsize;
+        rc = deflate( &zs, Z_FINISH );
+        b->outlen = b->outsize - zs.avail_out;
+        (void) deflateEnd( &zs );
+        return (rc == Z_STREAM_END)? 0: EIO;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case MTZIP_ZSTD: {
+        size_t n;
+
+        bound = ZSTD_compressBound( b->len );
+        if( bound > b->outsize ) {
+            free( b->out );
+            b->outsize = 0;
+            if( (b->out = malloc( bound )) == NULL )
+                return ENOMEM;
+            b->outsize = bound;
+        }
+        n = ZSTD_compress( b->out, b->outsize, b->data, b->len, zip->level );
+        if( ZSTD_isError( n ) )
+            return EIO;
+        b->outlen = n;
+        return 0;
+    }
+#endif
+    default:
+        (void) bound;
+        abort();
+    }
+}
+
+static int write_out( int fd, const uint8_t *data, size_t len ) {
+    while( len ) {
+        ssize_t n = write( fd, data, len );
+
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* EOF */
@@ -0,0 +1,75 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef MTZIP_H
+#define MTZIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* Compressed tape image streams.
+ *
+ * Reading decompresses a gzip or zstd image sequentially, including
+ * images made of several concatenated members or frames.
+ *
+ * Writing collects the image in blocks, which are compressed in parallel
+ * by a pool of threads, each block as an independent gzip member or zstd
+ * frame, and written in order.  Standard tools read the result as a
+ * single stream.
+ */
+
+typedef enum mtzip_format {
+    MTZIP_NONE,
+    MTZIP_GZIP,
+    MTZIP_ZSTD
+} mtzip_format;
+
+typedef struct mtzip MTZIP;
+
+/* Identify a compressed image from its first (up to 4) bytes */
+mtzip_format mtzip_detect( const uint8_t *magic, size_t len );
+
+/* The output format implied by a file name: .gz or .zst */
+mtzip_format mtzip_suffix( const char *filename );
+
+/* Whether this build supports a format, and its name */
+int mtzip_available( mtzip_format format );
+const char *mtzip_name( mtzip_format format );
+
+/* Read compressed input with readfn, which returns the number of bytes
+ * read, 0 at the end, or -1 with errno set.  prefix holds bytes of the
+ * image already read.  mtzip_read returns the number of bytes read,
+ * which is short only at the end of the image or on error.  mtzip_error
+ * returns the errno of the first error, or 0.
+ */
+typedef ssize_t mtzip_readfn( void *arg, void *buffer, size_t length );
+
+MTZIP *mtzip_open_read( mtzip_readfn *readfn, void *arg, mtzip_format format,
+                        const uint8_t *prefix, size_t prelen );
+size_t mtzip_read( MTZIP *zip, void *buffer, size_t length );
+int mtzip_error( MTZIP *zip );
+
+/* Write to fd.  level 0 selects the format's default; threads 0 uses
+ * one per online CPU.  mtzip_flush compresses and writes everything
+ * buffered.  All return 0, or -1 with errno set.  mtzip_close flushes
+ * and frees zip in either direction.
+ */
+MTZIP *mtzip_open_write( int fd, mtzip_format format, int level, unsigned int threads );
+int mtzip_write( MTZIP *zip, const struct iovec *iov, int iovcnt );
+int mtzip_flush( MTZIP *zip );
+int mtzip_close( MTZIP *zip );
+
+#endif
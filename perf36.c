@@ -0,0 +1,164 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Performance counters.
+ *
+ * The counters are opened as one group, so they are scheduled together
+ * and one read returns them all.  The first event that opens leads the
+ * group.  Kernel mode is counted if permitted, since much of the time
+ * in tape I/O is spent there; otherwise only user mode is.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf36.h"
+
+static const struct perf36_event {
+    const char *const name;
+    uint32_t type;
+    uint64_t config;
+} events[PERF36_NEVENTS] = {
+#ifdef __linux__
+    { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cache_misses",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "page_faults",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+#else
+    { "cycles",        0, 0 },
+    { "instructions",  0, 0 },
+    { "cache_misses",  0, 0 },
+    { "branch_misses", 0, 0 },
+    { "page_faults",   0, 0 },
+#endif
+};
+
+#ifdef __linux__
+static int open_group( perf36_T *pc, int useronly ) {
+    int i;
+
+    pc->nopen = 0;
+    pc->useronly = useronly;
+    pc->error = 0;
+
+    for( i = 0; i < PERF36_NEVENTS; i++ ) {
+        struct perf_event_attr attr;
+        int fd;
+
+        memset( &attr, 0, sizeof( attr ) );
+        attr.size = sizeof( attr );
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = (pc->nopen == 0);
+        attr.exclude_kernel = useronly;
+        attr.exclude_hv = 1;
+
+        fd = (int)syscall( SYS_perf_event_open, &attr, 0, -1,
+                           (pc->nopen? pc->fd[pc->order[0]]: -1), 0 );
+        if( fd < 0 ) {
+            if( !pc->error )
+                pc->error = errno;
+            continue;
+        }
+        pc->fd[i] = fd;
+        pc->order[pc->nopen++] = (perf36_event_T)i;
+    }
+    return pc->nopen;
+}
+#endif
+
+int perf36_open( perf36_T *pc ) {
+    int i;
+
+    for( i = 0; i < PERF36_NEVENTS; i++ )
+        pc->fd[i] = -1;
+    pc->nopen = 0;
+    pc->useronly = 0;
+
+#ifdef __linux__
+    open_group( pc, 0 );
+    if( pc->error == EACCES || pc->error == EPERM ) {
+        perf36_T user;
+
+        for( i = 0; i < PERF36_NEVENTS; i++ )
+            user.fd[i] = -1;
+        if( open_group( &user, 1 ) > pc->nopen ) {
+            perf36_close( pc );
+            *pc = user;
+        } else {
+            perf36_close( &user );
+        }
+    }
+    if( pc->nopen ) {
+        int leader = pc->fd[pc->order[0]];
+
+        (void) ioctl( leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+        (void) ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    }
+#else
+    pc->error = ENOSYS;
+#endif
+    return pc->nopen;
+}
+
+int perf36_read( perf36_T *pc, uint64_t value[PERF36_NEVENTS] ) {
+    uint64_t buf[1 + PERF36_NEVENTS];
+    ssize_t n;
+    int i;
+
+    memset( value, 0, PERF36_NEVENTS * sizeof( value[0] ) );
+    if( !pc->nopen )
+        return 0;
+
+    n = read( pc->fd[pc->order[0]], buf, (1 + (size_t)pc->nopen) * sizeof( buf[0] ) );
+    if( n < 0 )
+        return -1;
+    if( (size_t)n < (1 + (size_t)pc->nopen) * sizeof( buf[0] ) || buf[0] != (uint64_t)pc->nopen ) {
+        errno = EIO;
+        return -1;
+    }
+    for( i = 0; i < pc->nopen; i++ )
+        value[pc->order[i]] = buf[1 + i];
+
+    return 0;
+}
+
+void perf36_close( perf36_T *pc ) {
+    int i;
+
+    for( i = 0; i < PERF36_NEVENTS; i++ ) {
+        if( pc->fd[i] >= 0 )
+            (void) close( pc->fd[i] );
+        pc->fd[i] = -1;
+    }
+    pc->nopen = 0;
+
+    return;
+}
+
+const char *perf36_name( perf36_event_T event ) {
+    return events[event].name;
+}
+
+/* EOF */
@@ -0,0 +1,57 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef PERF36_H
+#define PERF36_H
+
+#include <stdint.h>
+
+/* Performance counters of the calling thread, for profiling.
+ *
+ * Uses perf_event_open on Linux.  Counters that the CPU, kernel or
+ * permissions don't provide are simply not opened; if none are, the
+ * caller can carry on without them.
+ */
+
+typedef enum {
+    PERF36_CYCLES,
+    PERF36_INSTRUCTIONS,
+    PERF36_CACHE_MISSES,
+    PERF36_BRANCH_MISSES,
+    PERF36_PAGE_FAULTS,
+    PERF36_NEVENTS
+} perf36_event_T;
+
+typedef struct {
+    int fd[PERF36_NEVENTS];     /* -1 if not open */
+    perf36_event_T order[PERF36_NEVENTS]; /* Events in group read order */
+    int nopen;
+    int useronly;               /* Kernel mode is not counted */
+    int error;                  /* errno of the first event that failed */
+} perf36_T;
+
+/* Open and start the counters.  Returns the number opened.
+ */
+int perf36_open( perf36_T *pc );
+
+/* Read all the counters; unopened ones read as 0.  Returns 0, or -1
+ * with errno set.
+ */
+int perf36_read( perf36_T *pc, uint64_t value[PERF36_NEVENTS] );
+
+void perf36_close( perf36_T *pc );
+
+const char *perf36_name( perf36_event_T event );
+
+#endif
@@ -0,0 +1,1130 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+/* Vector implementations of the core-dump and high-density packing modes,
+ * of direct conversions between them, and of bulk text extraction and
+ * encoding.
+ *
+ * The approach is the same at every vector width.  A byte shuffle gathers
+ * the frames of each 36-bit word into a 64-bit lane, most significant
+ * frame highest.  Shifts and masks then extract the 36-bit value, which
+ * is split into the wd36_T halves (lh in the low 32 bits of the lane).
+ * Packing runs the same steps in reverse.
+ *
+ * Shuffles only operate within 128-bit lanes, so wider vectors are
+ * loaded and stored a 128-bit lane at a time, at the stride of the
+ * frames they hold.  The vector loops only run while whole 16-byte
+ * loads and stores fit in the caller's buffers; the remainder is done
+ * by the scalar code.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout36.h"
+#include "simd36.h"
+
+#ifdef SIMD36_X86
+#include <immintrin.h>
+
+#define M18 INT64_C(0777777)
+#define M36 INT64_C(0777777777777)
+
+/* Frame shuffles.  -1 selects zero. */
+
+#define CD_UNPACK_SHUF   4,  3,  2,  1,  0, -1, -1, -1,  9,  8,  7,  6,  5, -1, -1, -1
+#define HD_UNPACK_SHUF   4,  3,  2,  1,  0, -1, -1, -1,  8,  7,  6,  5,  4, -1, -1, -1
+#define CD_PACK_SHUF     4,  3,  2,  1,  0, 12, 11, 10,  9,  8, -1, -1, -1, -1, -1, -1
+#define HD_PACK_SHUF0    4,  3,  2,  1,  0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+#define HD_PACK_SHUF1   -1, -1, -1, -1, 12, 11, 10,  9,  8, -1, -1, -1, -1, -1, -1, -1
+
+/* SSSE3: 2 words per iteration */
+
+__attribute__((target("ssse3")))
+size_t unpack_core_dump_ssse3(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m128i shuf = _mm_setr_epi8( CD_UNPACK_SHUF );
+    const __m128i lo4 = _mm_set1_epi64x( 017 );
+    const __m128i m18 = _mm_set1_epi64x( M18 );
+    size_t wc, n;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 2 <= wc && insize - 5 * n >= 16; n += 2 ) {
+        __m128i x, v;
+
+        x = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(inbuf + 5 * n) ), shuf );
+        v = _mm_or_si128( _mm_andnot_si128( lo4, _mm_srli_epi64( x, 4 ) ),
+                          _mm_and_si128( x, lo4 ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + n),
+                          _mm_or_si128( _mm_srli_epi64( v, 18 ),
+                                        _mm_slli_epi64( _mm_and_si128( v, m18 ), 32 ) ) );
+    }
+    if( n < wc )
+        (void) unpack_core_dump( inbuf + 5 * n, 5 * (wc - n), outbuf + n, wc - n );
+
+    return wc;
+}
+
+__attribute__((target("ssse3")))
+size_t pack_core_dump_ssse3(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m128i shuf = _mm_setr_epi8( CD_PACK_SHUF );
+    const __m128i lo4 = _mm_set1_epi64x( 017 );
+    const __m128i m18 = _mm_set1_epi64x( M18 );
+    size_t bc, n;
+
+    bc = wc * 5;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 2 <= wc && bufsize - 5 * n >= 16; n += 2 ) {
+        __m128i x, v;
+
+        x = _mm_loadu_si128( (const __m128i *)(inbuf + n) );
+        v = _mm_or_si128( _mm_slli_epi64( _mm_and_si128( x, m18 ), 18 ),
+                          _mm_and_si128( _mm_srli_epi64( x, 32 ), m18 ) );
+        v = _mm_or_si128( _mm_slli_epi64( _mm_andnot_si128( lo4, v ), 4 ),
+                          _mm_and_si128( v, lo4 ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + 5 * n), _mm_shuffle_epi8( v, shuf ) );
+    }
+    if( n < wc )
+        (void) pack_core_dump( inbuf + n, wc - n, outbuf + 5 * n, bufsize - 5 * n );
+
+    return bc;
+}
+
+__attribute__((target("ssse3")))
+size_t unpack_high_density_ssse3(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m128i shuf = _mm_setr_epi8( HD_UNPACK_SHUF );
+    const __m128i even = _mm_set_epi64x( 0, M36 );
+    const __m128i odd = _mm_set_epi64x( M36, 0 );
+    const __m128i m18 = _mm_set1_epi64x( M18 );
+    size_t wc, n;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    wc = (insize / 9) * 2;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 2 <= wc && insize - 9 * (n / 2) >= 16; n += 2 ) {
+        __m128i x, v;
+
+        x = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(inbuf + 9 * (n / 2)) ), shuf );
+        v = _mm_or_si128( _mm_and_si128( _mm_srli_epi64( x, 4 ), even ),
+                          _mm_and_si128( x, odd ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + n),
+                          _mm_or_si128( _mm_srli_epi64( v, 18 ),
+                                        _mm_slli_epi64( _mm_and_si128( v, m18 ), 32 ) ) );
+    }
+    for( ; n < wc; n += 2 ) {
+        wd36_T pair[2];
+
+        (void) unpack_high_density( inbuf + 9 * (n / 2), 9, pair, 2 );
+        memcpy( outbuf + n, pair, ((wc - n < 2)? wc - n: 2) * sizeof( wd36_T ) );
+    }
+
+    return wc;
+}
+
+__attribute__((target("ssse3")))
+size_t pack_high_density_ssse3(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m128i shuf0 = _mm_setr_epi8( HD_PACK_SHUF0 );
+    const __m128i shuf1 = _mm_setr_epi8( HD_PACK_SHUF1 );
+    const __m128i even = _mm_set_epi64x( 0, -1 );
+    const __m128i m18 = _mm_set1_epi64x( M18 );
+    size_t bc, n;
+
+    bc = (((wc +1) & ~1) * 9) / 2;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 2 <= wc && bufsize - 9 * (n / 2) >= 16; n += 2 ) {
+        __m128i x, v;
+
+        x = _mm_loadu_si128( (const __m128i *)(inbuf + n) );
+        v = _mm_or_si128( _mm_slli_epi64( _mm_and_si128( x, m18 ), 18 ),
+                          _mm_and_si128( _mm_srli_epi64( x, 32 ), m18 ) );
+        v = _mm_or_si128( _mm_and_si128( _mm_slli_epi64( v, 4 ), even ),
+                          _mm_andnot_si128( even, v ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + 9 * (n / 2)),
+                          _mm_or_si128( _mm_shuffle_epi8( v, shuf0 ),
+                                        _mm_shuffle_epi8( v, shuf1 ) ) );
+    }
+    if( n < wc )
+        (void) pack_high_density( inbuf + n, wc - n, outbuf + 9 * (n / 2),
+                                  bufsize - 9 * (n / 2) );
+
+    return bc;
+}
+
+/* AVX2: 4 words per iteration */
+
+#define LOAD2X128( p, stride ) \
+    _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (const __m128i *)(p) ) ), \
+                             _mm_loadu_si128( (const __m128i *)((p) + (stride)) ), 1 )
+
+#define STORE2X128( p, stride, x ) do {                                   \
+        _mm_storeu_si128( (__m128i *)(p), _mm256_castsi256_si128( x ) );  \
+        _mm_storeu_si128( (__m128i *)((p) + (stride)),                    \
+                          _mm256_extracti128_si256( x, 1 ) );             \
+    } while( 0 )
+
+__attribute__((target("avx2")))
+size_t unpack_core_dump_avx2(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m256i shuf = _mm256_setr_epi8( CD_UNPACK_SHUF, CD_UNPACK_SHUF );
+    const __m256i lo4 = _mm256_set1_epi64x( 017 );
+    const __m256i m18 = _mm256_set1_epi64x( M18 );
+    size_t wc, n;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 4 <= wc && insize - 5 * n >= 26; n += 4 ) {
+        __m256i x, v;
+
+        x = _mm256_shuffle_epi8( LOAD2X128( inbuf + 5 * n, 10 ), shuf );
+        v = _mm256_or_si256( _mm256_andnot_si256( lo4, _mm256_srli_epi64( x, 4 ) ),
+                             _mm256_and_si256( x, lo4 ) );
+        _mm256_storeu_si256( (__m256i *)(outbuf + n),
+                             _mm256_or_si256( _mm256_srli_epi64( v, 18 ),
+                                              _mm256_slli_epi64( _mm256_and_si256( v, m18 ), 32 ) ) );
+    }
+    if( n < wc )
+        (void) unpack_core_dump_ssse3( inbuf + 5 * n, 5 * (wc - n), outbuf + n, wc - n );
+
+    return wc;
+}
+
+__attribute__((target("avx2")))
+size_t pack_core_dump_avx2(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m256i shuf = _mm256_setr_epi8( CD_PACK_SHUF, CD_PACK_SHUF );
+    const __m256i lo4 = _mm256_set1_epi64x( 017 );
+    const __m256i m18 = _mm256_set1_epi64x( M18 );
+    size_t bc, n;
+
+    bc = wc * 5;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 4 <= wc && bufsize - 5 * n >= 26; n += 4 ) {
+        __m256i x, v;
+
+        x = _mm256_loadu_si256( (const __m256i *)(inbuf + n) );
+        v = _mm256_or_si256( _mm256_slli_epi64( _mm256_and_si256( x, m18 ), 18 ),
+                             _mm256_and_si256( _mm256_srli_epi64( x, 32 ), m18 ) );
+        v = _mm256_or_si256( _mm256_slli_epi64( _mm256_andnot_si256( lo4, v ), 4 ),
+                             _mm256_and_si256( v, lo4 ) );
+        v = _mm256_shuffle_epi8( v, shuf );
+        STORE2X128( outbuf + 5 * n, 10, v );
+    }
+    if( n < wc )
+        (void) pack_core_dump_ssse3( inbuf + n, wc - n, outbuf + 5 * n, bufsize - 5 * n );
+
+    return bc;
+}
+
+__attribute__((target("avx2")))
+size_t unpack_high_density_avx2(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m256i shuf = _mm256_setr_epi8( HD_UNPACK_SHUF, HD_UNPACK_SHUF );
+    const __m256i shift = _mm256_setr_epi64x( 4, 0, 4, 0 );
+    const __m256i m36 = _mm256_set1_epi64x( M36 );
+    const __m256i m18 = _mm256_set1_epi64x( M18 );
+    size_t wc, n;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    wc = (insize / 9) * 2;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 4 <= wc && insize - 9 * (n / 2) >= 25; n += 4 ) {
+        __m256i x, v;
+
+        x = _mm256_shuffle_epi8( LOAD2X128( inbuf + 9 * (n / 2), 9 ), shuf );
+        v = _mm256_and_si256( _mm256_srlv_epi64( x, shift ), m36 );
+        _mm256_storeu_si256( (__m256i *)(outbuf + n),
+                             _mm256_or_si256( _mm256_srli_epi64( v, 18 ),
+                                              _mm256_slli_epi64( _mm256_and_si256( v, m18 ), 32 ) ) );
+    }
+    if( n < wc )
+        (void) unpack_high_density_ssse3( inbuf + 9 * (n / 2), insize - 9 * (n / 2),
+                                          outbuf + n, wc - n );
+
+    return wc;
+}
+
+__attribute__((target("avx2")))
+size_t pack_high_density_avx2(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m256i shuf0 = _mm256_setr_epi8( HD_PACK_SHUF0, HD_PACK_SHUF0 );
+    const __m256i shuf1 = _mm256_setr_epi8( HD_PACK_SHUF1, HD_PACK_SHUF1 );
+    const __m256i shift = _mm256_setr_epi64x( 4, 0, 4, 0 );
+    const __m256i m18 = _mm256_set1_epi64x( M18 );
+    size_t bc, n;
+
+    bc = (((wc +1) & ~1) * 9) / 2;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 4 <= wc && bufsize - 9 * (n / 2) >= 25; n += 4 ) {
+        __m256i x, v;
+
+        x = _mm256_loadu_si256( (const __m256i *)(inbuf + n) );
+        v = _mm256_or_si256( _mm256_slli_epi64( _mm256_and_si256( x, m18 ), 18 ),
+                             _mm256_and_si256( _mm256_srli_epi64( x, 32 ), m18 ) );
+        v = _mm256_sllv_epi64( v, shift );
+        v = _mm256_or_si256( _mm256_shuffle_epi8( v, shuf0 ),
+                             _mm256_shuffle_epi8( v, shuf1 ) );
+        STORE2X128( outbuf + 9 * (n / 2), 9, v );
+    }
+    if( n < wc )
+        (void) pack_high_density_ssse3( inbuf + n, wc - n, outbuf + 9 * (n / 2),
+                                        bufsize - 9 * (n / 2) );
+
+    return bc;
+}
+
+/* AVX-512: 8 words per iteration */
+
+#define LOAD4X128( p, stride ) \
+    _mm512_inserti32x4( _mm512_inserti32x4( _mm512_inserti32x4(                  \
+        _mm512_castsi128_si512( _mm_loadu_si128( (const __m128i *)(p) ) ),        \
+        _mm_loadu_si128( (const __m128i *)((p) + (stride)) ), 1 ),                \
+        _mm_loadu_si128( (const __m128i *)((p) + 2 * (stride)) ), 2 ),            \
+        _mm_loadu_si128( (const __m128i *)((p) + 3 * (stride)) ), 3 )
+
+#define STORE4X128( p, stride, x ) do {                                             \
+        _mm_storeu_si128( (__m128i *)(p), _mm512_castsi512_si128( x ) );            \
+        _mm_storeu_si128( (__m128i *)((p) + (stride)),                              \
+                          _mm512_extracti32x4_epi32( x, 1 ) );                      \
+        _mm_storeu_si128( (__m128i *)((p) + 2 * (stride)),                          \
+                          _mm512_extracti32x4_epi32( x, 2 ) );                      \
+        _mm_storeu_si128( (__m128i *)((p) + 3 * (stride)),                          \
+                          _mm512_extracti32x4_epi32( x, 3 ) );                      \
+    } while( 0 )
+
+#define BCAST128( ... ) _mm512_broadcast_i32x4( _mm_setr_epi8( __VA_ARGS__ ) )
+
+__attribute__((target("avx512f,avx512bw")))
+size_t unpack_core_dump_avx512(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m512i shuf = BCAST128( CD_UNPACK_SHUF );
+    const __m512i lo4 = _mm512_set1_epi64( 017 );
+    const __m512i m18 = _mm512_set1_epi64( M18 );
+    size_t wc, n;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 8 <= wc && insize - 5 * n >= 46; n += 8 ) {
+        __m512i x, v;
+
+        x = _mm512_shuffle_epi8( LOAD4X128( inbuf + 5 * n, 10 ), shuf );
+        v = _mm512_or_si512( _mm512_andnot_si512( lo4, _mm512_srli_epi64( x, 4 ) ),
+                             _mm512_and_si512( x, lo4 ) );
+        _mm512_storeu_si512( (void *)(outbuf + n),
+                             _mm512_or_si512( _mm512_srli_epi64( v, 18 ),
+                                              _mm512_slli_epi64( _mm512_and_si512( v, m18 ), 32 ) ) );
+    }
+    if( n < wc )
+        (void) unpack_core_dump_avx2( inbuf + 5 * n, 5 * (wc - n), outbuf + n, wc - n );
+
+    return wc;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t pack_core_dump_avx512(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m512i shuf = BCAST128( CD_PACK_SHUF );
+    const __m512i lo4 = _mm512_set1_epi64( 017 );
+    const __m512i m18 = _mm512_set1_epi64( M18 );
+    size_t bc, n;
+
+    bc = wc * 5;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 8 <= wc && bufsize - 5 * n >= 46; n += 8 ) {
+        __m512i x, v;
+
+        x = _mm512_loadu_si512( (const void *)(inbuf + n) );
+        v = _mm512_or_si512( _mm512_slli_epi64( _mm512_and_si512( x, m18 ), 18 ),
+                             _mm512_and_si512( _mm512_srli_epi64( x, 32 ), m18 ) );
+        v = _mm512_or_si512( _mm512_slli_epi64( _mm512_andnot_si512( lo4, v ), 4 ),
+                             _mm512_and_si512( v, lo4 ) );
+        v = _mm512_shuffle_epi8( v, shuf );
+        STORE4X128( outbuf + 5 * n, 10, v );
+    }
+    if( n < wc )
+        (void) pack_core_dump_avx2( inbuf + n, wc - n, outbuf + 5 * n, bufsize - 5 * n );
+
+    return bc;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t unpack_high_density_avx512(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc) {
+    const __m512i shuf = BCAST128( HD_UNPACK_SHUF );
+    const __m512i shift = _mm512_setr_epi64( 4, 0, 4, 0, 4, 0, 4, 0 );
+    const __m512i m36 = _mm512_set1_epi64( M36 );
+    const __m512i m18 = _mm512_set1_epi64( M18 );
+    size_t wc, n;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    wc = (insize / 9) * 2;
+    if( wc > maxwc )
+        wc = maxwc;
+
+    for( n = 0; n + 8 <= wc && insize - 9 * (n / 2) >= 43; n += 8 ) {
+        __m512i x, v;
+
+        x = _mm512_shuffle_epi8( LOAD4X128( inbuf + 9 * (n / 2), 9 ), shuf );
+        v = _mm512_and_si512( _mm512_srlv_epi64( x, shift ), m36 );
+        _mm512_storeu_si512( (void *)(outbuf + n),
+                             _mm512_or_si512( _mm512_srli_epi64( v, 18 ),
+                                              _mm512_slli_epi64( _mm512_and_si512( v, m18 ), 32 ) ) );
+    }
+    if( n < wc )
+        (void) unpack_high_density_avx2( inbuf + 9 * (n / 2), insize - 9 * (n / 2),
+                                         outbuf + n, wc - n );
+
+    return wc;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t pack_high_density_avx512(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize) {
+    const __m512i shuf0 = BCAST128( HD_PACK_SHUF0 );
+    const __m512i shuf1 = BCAST128( HD_PACK_SHUF1 );
+    const __m512i shift = _mm512_setr_epi64( 4, 0, 4, 0, 4, 0, 4, 0 );
+    const __m512i m18 = _mm512_set1_epi64( M18 );
+    size_t bc, n;
+
+    bc = (((wc +1) & ~1) * 9) / 2;
+    if( bc > bufsize )
+        abort();
+
+    for( n = 0; n + 8 <= wc && bufsize - 9 * (n / 2) >= 43; n += 8 ) {
+        __m512i x, v;
+
+        x = _mm512_loadu_si512( (const void *)(inbuf + n) );
+        v = _mm512_or_si512( _mm512_slli_epi64( _mm512_and_si512( x, m18 ), 18 ),
+                             _mm512_and_si512( _mm512_srli_epi64( x, 32 ), m18 ) );
+        v = _mm512_sllv_epi64( v, shift );
+        v = _mm512_or_si512( _mm512_shuffle_epi8( v, shuf0 ),
+                             _mm512_shuffle_epi8( v, shuf1 ) );
+        STORE4X128( outbuf + 9 * (n / 2), 9, v );
+    }
+    if( n < wc )
+        (void) pack_high_density_avx2( inbuf + n, wc - n, outbuf + 9 * (n / 2),
+                                       bufsize - 9 * (n / 2) );
+
+    return bc;
+}
+
+/* Direct core-dump <-> high-density conversions.
+ * Each 128-bit lane converts one pair of words: 10 core-dump frames to
+ * 9 high-density frames, or the reverse.  The words never leave the
+ * registers.
+ */
+
+__attribute__((target("ssse3")))
+size_t transcode_core_dump_to_high_density_ssse3(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m128i ushuf = _mm_setr_epi8( CD_UNPACK_SHUF );
+    const __m128i pshuf0 = _mm_setr_epi8( HD_PACK_SHUF0 );
+    const __m128i pshuf1 = _mm_setr_epi8( HD_PACK_SHUF1 );
+    const __m128i lo4 = _mm_set1_epi64x( 017 );
+    const __m128i even = _mm_set_epi64x( 0, -1 );
+    size_t wc, bc, k;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    bc = ((wc + 1) / 2) * 9;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; 2 * k + 2 <= wc && insize - 10 * k >= 16 && bufsize - 9 * k >= 16; k++ ) {
+        __m128i x, v;
+
+        x = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(inbuf + 10 * k) ), ushuf );
+        v = _mm_or_si128( _mm_andnot_si128( lo4, _mm_srli_epi64( x, 4 ) ),
+                          _mm_and_si128( x, lo4 ) );
+        v = _mm_or_si128( _mm_and_si128( _mm_slli_epi64( v, 4 ), even ),
+                          _mm_andnot_si128( even, v ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + 9 * k),
+                          _mm_or_si128( _mm_shuffle_epi8( v, pshuf0 ),
+                                        _mm_shuffle_epi8( v, pshuf1 ) ) );
+    }
+    if( 2 * k < wc )
+        (void) transcoder( PK_CORE_DUMP, PK_HIGH_DENSITY )( inbuf + 10 * k, 5 * (wc - 2 * k),
+                                                            outbuf + 9 * k, bufsize - 9 * k );
+
+    return bc;
+}
+
+__attribute__((target("ssse3")))
+size_t transcode_high_density_to_core_dump_ssse3(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m128i ushuf = _mm_setr_epi8( HD_UNPACK_SHUF );
+    const __m128i pshuf = _mm_setr_epi8( CD_PACK_SHUF );
+    const __m128i lo4 = _mm_set1_epi64x( 017 );
+    const __m128i even = _mm_set_epi64x( 0, M36 );
+    const __m128i odd = _mm_set_epi64x( M36, 0 );
+    size_t np, bc, k;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    np = insize / 9;
+    bc = np * 10;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; k < np && insize - 9 * k >= 16 && bufsize - 10 * k >= 16; k++ ) {
+        __m128i x, v;
+
+        x = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(inbuf + 9 * k) ), ushuf );
+        v = _mm_or_si128( _mm_and_si128( _mm_srli_epi64( x, 4 ), even ),
+                          _mm_and_si128( x, odd ) );
+        v = _mm_or_si128( _mm_slli_epi64( _mm_andnot_si128( lo4, v ), 4 ),
+                          _mm_and_si128( v, lo4 ) );
+        _mm_storeu_si128( (__m128i *)(outbuf + 10 * k), _mm_shuffle_epi8( v, pshuf ) );
+    }
+    if( k < np )
+        (void) transcoder( PK_HIGH_DENSITY, PK_CORE_DUMP )( inbuf + 9 * k, 9 * (np - k),
+                                                            outbuf + 10 * k, bufsize - 10 * k );
+
+    return bc;
+}
+
+__attribute__((target("avx2")))
+size_t transcode_core_dump_to_high_density_avx2(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m256i ushuf = _mm256_setr_epi8( CD_UNPACK_SHUF, CD_UNPACK_SHUF );
+    const __m256i pshuf0 = _mm256_setr_epi8( HD_PACK_SHUF0, HD_PACK_SHUF0 );
+    const __m256i pshuf1 = _mm256_setr_epi8( HD_PACK_SHUF1, HD_PACK_SHUF1 );
+    const __m256i lo4 = _mm256_set1_epi64x( 017 );
+    const __m256i shift = _mm256_setr_epi64x( 4, 0, 4, 0 );
+    size_t wc, bc, k;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    bc = ((wc + 1) / 2) * 9;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; 2 * k + 4 <= wc && insize - 10 * k >= 26 && bufsize - 9 * k >= 25; k += 2 ) {
+        __m256i x, v;
+
+        x = _mm256_shuffle_epi8( LOAD2X128( inbuf + 10 * k, 10 ), ushuf );
+        v = _mm256_or_si256( _mm256_andnot_si256( lo4, _mm256_srli_epi64( x, 4 ) ),
+                             _mm256_and_si256( x, lo4 ) );
+        v = _mm256_sllv_epi64( v, shift );
+        v = _mm256_or_si256( _mm256_shuffle_epi8( v, pshuf0 ),
+                             _mm256_shuffle_epi8( v, pshuf1 ) );
+        STORE2X128( outbuf + 9 * k, 9, v );
+    }
+    if( 2 * k < wc )
+        (void) transcode_core_dump_to_high_density_ssse3( inbuf + 10 * k, 5 * (wc - 2 * k),
+                                                          outbuf + 9 * k, bufsize - 9 * k );
+
+    return bc;
+}
+
+__attribute__((target("avx2")))
+size_t transcode_high_density_to_core_dump_avx2(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m256i ushuf = _mm256_setr_epi8( HD_UNPACK_SHUF, HD_UNPACK_SHUF );
+    const __m256i pshuf = _mm256_setr_epi8( CD_PACK_SHUF, CD_PACK_SHUF );
+    const __m256i lo4 = _mm256_set1_epi64x( 017 );
+    const __m256i shift = _mm256_setr_epi64x( 4, 0, 4, 0 );
+    const __m256i m36 = _mm256_set1_epi64x( M36 );
+    size_t np, bc, k;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    np = insize / 9;
+    bc = np * 10;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; k + 2 <= np && insize - 9 * k >= 25 && bufsize - 10 * k >= 26; k += 2 ) {
+        __m256i x, v;
+
+        x = _mm256_shuffle_epi8( LOAD2X128( inbuf + 9 * k, 9 ), ushuf );
+        v = _mm256_and_si256( _mm256_srlv_epi64( x, shift ), m36 );
+        v = _mm256_or_si256( _mm256_slli_epi64( _mm256_andnot_si256( lo4, v ), 4 ),
+                             _mm256_and_si256( v, lo4 ) );
+        v = _mm256_shuffle_epi8( v, pshuf );
+        STORE2X128( outbuf + 10 * k, 10, v );
+    }
+    if( k < np )
+        (void) transcode_high_density_to_core_dump_ssse3( inbuf + 9 * k, 9 * (np - k),
+                                                          outbuf + 10 * k, bufsize - 10 * k );
+
+    return bc;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t transcode_core_dump_to_high_density_avx512(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m512i ushuf = BCAST128( CD_UNPACK_SHUF );
+    const __m512i pshuf0 = BCAST128( HD_PACK_SHUF0 );
+    const __m512i pshuf1 = BCAST128( HD_PACK_SHUF1 );
+    const __m512i lo4 = _mm512_set1_epi64( 017 );
+    const __m512i shift = _mm512_setr_epi64( 4, 0, 4, 0, 4, 0, 4, 0 );
+    size_t wc, bc, k;
+
+    if( insize % 5 )
+        return (size_t)-1;
+
+    wc = insize / 5;
+    bc = ((wc + 1) / 2) * 9;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; 2 * k + 8 <= wc && insize - 10 * k >= 46 && bufsize - 9 * k >= 43; k += 4 ) {
+        __m512i x, v;
+
+        x = _mm512_shuffle_epi8( LOAD4X128( inbuf + 10 * k, 10 ), ushuf );
+        v = _mm512_or_si512( _mm512_andnot_si512( lo4, _mm512_srli_epi64( x, 4 ) ),
+                             _mm512_and_si512( x, lo4 ) );
+        v = _mm512_sllv_epi64( v, shift );
+        v = _mm512_or_si512( _mm512_shuffle_epi8( v, pshuf0 ),
+                             _mm512_shuffle_epi8( v, pshuf1 ) );
+        STORE4X128( outbuf + 9 * k, 9, v );
+    }
+    if( 2 * k < wc )
+        (void) transcode_core_dump_to_high_density_avx2( inbuf + 10 * k, 5 * (wc - 2 * k),
+                                                         outbuf + 9 * k, bufsize - 9 * k );
+
+    return bc;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t transcode_high_density_to_core_dump_avx512(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize) {
+    const __m512i ushuf = BCAST128( HD_UNPACK_SHUF );
+    const __m512i pshuf = BCAST128( CD_PACK_SHUF );
+    const __m512i lo4 = _mm512_set1_epi64( 017 );
+    const __m512i shift = _mm512_setr_epi64( 4, 0, 4, 0, 4, 0, 4, 0 );
+    const __m512i m36 = _mm512_set1_epi64( M36 );
+    size_t np, bc, k;
+
+    if( insize % 9 )
+        return (size_t)-1;
+
+    np = insize / 9;
+    bc = np * 10;
+    if( bc > bufsize )
+        abort();
+
+    for( k = 0; k + 4 <= np && insize - 9 * k >= 43 && bufsize - 10 * k >= 46; k += 4 ) {
+        __m512i x, v;
+
+        x = _mm512_shuffle_epi8( LOAD4X128( inbuf + 9 * k, 9 ), ushuf );
+        v = _mm512_and_si512( _mm512_srlv_epi64( x, shift ), m36 );
+        v = _mm512_or_si512( _mm512_slli_epi64( _mm512_andnot_si512( lo4, v ), 4 ),
+                             _mm512_and_si512( v, lo4 ) );
+        v = _mm512_shuffle_epi8( v, pshuf );
+        STORE4X128( outbuf + 10 * k, 10, v );
+    }
+    if( k < np )
+        (void) transcode_high_density_to_core_dump_avx2( inbuf + 9 * k, 9 * (np - k),
+                                                         outbuf + 10 * k, bufsize - 10 * k );
+
+    return bc;
+}
+
+/* Text extraction.
+ *
+ * Each 64-bit lane holds a wd36_T, lh in the low half.  7-bit text is
+ * assembled as the 35-bit value of the characters, whose 7-bit fields are
+ * then spread to bytes; 8-bit text is the value less its 4 low bits.
+ * A shuffle puts the characters in order and packs them together.
+ *
+ * With flags, each vector's worth of text is stored as it is, then
+ * filtered in place if it includes a character the flags act on.
+ */
+
+#define T7_SHUF   4,  3,  2,  1,  0, 12, 11, 10,  9,  8, -1, -1, -1, -1, -1, -1
+#define T8_SHUF   3,  2,  1,  0, 11, 10,  9,  8, -1, -1, -1, -1, -1, -1, -1, -1
+
+/* Append the k characters stored at buf + done, filtering them if
+ * necessary.  Returns the new length.
+ */
+
+__attribute__((target("ssse3")))
+static inline size_t text_append( uint8_t *buf, size_t done, __m128i x, int k, int flags ) {
+    __m128i hit = _mm_setzero_si128();
+
+    if( !flags )
+        return done + k;
+    if( flags & TEXT_STRIPNUL )
+        hit = _mm_cmpeq_epi8( x, _mm_setzero_si128() );
+    if( flags & TEXT_CRLF )
+        hit = _mm_or_si128( hit, _mm_cmpeq_epi8( x, _mm_set1_epi8( '\n' ) ) );
+    if( (_mm_movemask_epi8( hit ) & ((1 << k) - 1)) == 0 )
+        return done + k;
+    return filtertext( buf, done, buf + done, k, flags );
+}
+
+/* Decode the words the vector loop left with the scalar code */
+
+static size_t text_tail( textfn_T fn, const wd36_T *data, size_t wc,
+                         uint8_t *buf, size_t done, int flags ) {
+    size_t len;
+
+    len = fn( data, wc, buf + done, 0 );
+    if( flags )
+        return filtertext( buf, done, buf + done, len, flags );
+    return done + len;
+}
+
+/* SSSE3: 2 words (7-bit) or 4 words (8-bit) per iteration */
+
+#define T7_SPREAD( t, m7, and, or, sll )                                   \
+    or( or( or( and( t, m7 ), and( sll( t, 1 ), sll( m7, 8 ) ) ),            \
+            or( and( sll( t, 2 ), sll( m7, 16 ) ), and( sll( t, 3 ), sll( m7, 24 ) ) ) ), \
+        and( sll( t, 4 ), sll( m7, 32 ) ) )
+
+__attribute__((target("ssse3")))
+size_t decode7ascii_n_ssse3( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    const __m128i shuf = _mm_setr_epi8( T7_SHUF );
+    const __m128i m7 = _mm_set1_epi64x( 0177 );
+    const __m128i m17 = _mm_set1_epi64x( 0377777 );
+    const __m128i m35 = _mm_set1_epi64x( INT64_C(0377777777777) );
+    size_t n, done = 0;
+
+    for( n = 0; n + 4 <= wc; n += 2 ) {
+        __m128i x, t;
+
+        x = _mm_loadu_si128( (const __m128i *)(data + n) );
+        t = _mm_or_si128( _mm_and_si128( _mm_slli_epi64( x, 17 ), m35 ),
+                          _mm_and_si128( _mm_srli_epi64( x, 33 ), m17 ) );
+        x = _mm_shuffle_epi8( T7_SPREAD( t, m7, _mm_and_si128, _mm_or_si128, _mm_slli_epi64 ),
+                              shuf );
+        _mm_storeu_si128( (__m128i *)(buf + done), x );
+        done = text_append( buf, done, x, 10, flags );
+    }
+    return text_tail( decode7ascii_n, data + n, wc - n, buf, done, flags );
+}
+
+__attribute__((target("ssse3")))
+size_t decode8ascii_n_ssse3( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    const __m128i shuf = _mm_setr_epi8( T8_SHUF );
+    const __m128i m14 = _mm_set1_epi64x( 037777 );
+    const __m128i m32 = _mm_set1_epi64x( 0xFFFFFFFF );
+    size_t n, done = 0;
+
+    for( n = 0; n + 4 <= wc; n += 4 ) {
+        __m128i x, y;
+
+        x = _mm_loadu_si128( (const __m128i *)(data + n) );
+        y = _mm_loadu_si128( (const __m128i *)(data + n + 2) );
+        x = _mm_or_si128( _mm_and_si128( _mm_slli_epi64( x, 14 ), m32 ),
+                          _mm_and_si128( _mm_srli_epi64( x, 36 ), m14 ) );
+        y = _mm_or_si128( _mm_and_si128( _mm_slli_epi64( y, 14 ), m32 ),
+                          _mm_and_si128( _mm_srli_epi64( y, 36 ), m14 ) );
+        x = _mm_unpacklo_epi64( _mm_shuffle_epi8( x, shuf ), _mm_shuffle_epi8( y, shuf ) );
+        _mm_storeu_si128( (__m128i *)(buf + done), x );
+        done = text_append( buf, done, x, 16, flags );
+    }
+    return text_tail( decode8ascii_n, data + n, wc - n, buf, done, flags );
+}
+
+/* AVX2: 4 words (7-bit) or 8 words (8-bit) per iteration */
+
+__attribute__((target("avx2")))
+size_t decode7ascii_n_avx2( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    const __m256i shuf = _mm256_setr_epi8( T7_SHUF, T7_SHUF );
+    const __m256i m7 = _mm256_set1_epi64x( 0177 );
+    const __m256i m17 = _mm256_set1_epi64x( 0377777 );
+    const __m256i m35 = _mm256_set1_epi64x( INT64_C(0377777777777) );
+    size_t n, done = 0;
+
+    for( n = 0; n + 6 <= wc; n += 4 ) {
+        __m256i x, t;
+        __m128i lo, hi;
+
+        x = _mm256_loadu_si256( (const __m256i *)(data + n) );
+        t = _mm256_or_si256( _mm256_and_si256( _mm256_slli_epi64( x, 17 ), m35 ),
+                             _mm256_and_si256( _mm256_srli_epi64( x, 33 ), m17 ) );
+        x = _mm256_shuffle_epi8( T7_SPREAD( t, m7, _mm256_and_si256, _mm256_or_si256,
+                                            _mm256_slli_epi64 ), shuf );
+        lo = _mm256_castsi256_si128( x );
+        hi = _mm256_extracti128_si256( x, 1 );
+        _mm_storeu_si128( (__m128i *)(buf + done), lo );
+        done = text_append( buf, done, lo, 10, flags );
+        _mm_storeu_si128( (__m128i *)(buf + done), hi );
+        done = text_append( buf, done, hi, 10, flags );
+    }
+    return text_tail( decode7ascii_n, data + n, wc - n, buf, done, flags );
+}
+
+__attribute__((target("avx2")))
+size_t decode8ascii_n_avx2( const wd36_T *data, size_t wc, uint8_t *buf, int flags ) {
+    const __m256i shuf = _mm256_setr_epi8( T8_SHUF, T8_SHUF );
+    const __m256i m14 = _mm256_set1_epi64x( 037777 );
+    const __m256i m32 = _mm256_set1_epi64x( 0xFFFFFFFF );
+    size_t n, done = 0;
+
+    for( n = 0; n + 8 <= wc; n += 8 ) {
+        __m256i x, y;
+
+        x = _mm256_loadu_si256( (const __m256i *)(data + n) );
+        y = _mm256_loadu_si256( (const __m256i *)(data + n + 4) );
+        x = _mm256_or_si256( _mm256_and_si256( _mm256_slli_epi64( x, 14 ), m32 ),
+                             _mm256_and_si256( _mm256_srli_epi64( x, 36 ), m14 ) );
+        y = _mm256_or_si256( _mm256_and_si256( _mm256_slli_epi64( y, 14 ), m32 ),
+                             _mm256_and_si256( _mm256_srli_epi64( y, 36 ), m14 ) );
+        x = _mm256_unpacklo_epi64( _mm256_shuffle_epi8( x, shuf ), _mm256_shuffle_epi8( y, shuf ) );
+        x = _mm256_permute4x64_epi64( x, 0xD8 );
+        _mm256_storeu_si256( (__m256i *)(buf + done), x );
+        if( flags ) {
+            done = text_append( buf, done, _mm256_castsi256_si128( x ), 16, flags );
+            _mm_storeu_si128( (__m128i *)(buf + done), _mm256_extracti128_si256( x, 1 ) );
+            done = text_append( buf, done, _mm256_extracti128_si256( x, 1 ), 16, flags );
+        } else {
+            done += 32;
+        }
+    }
+    return text_tail( decode8ascii_n, data + n, wc - n, buf, done, flags );
+}
+
+/* Text encoding: the reverse of extraction.  7-bit characters are put
+ * in a lane in reverse order and their fields gathered into the 35-bit
+ * value; 8-bit characters are byte-reversed into 32 bits.  Only whole
+ * words of text are done here; the scalar code does the rest, including
+ * a final partial word and the zero fill.
+ */
+
+#define E7_SHUF   4,  3,  2,  1,  0, -1, -1, -1,  9,  8,  7,  6,  5, -1, -1, -1
+#define E8_SHUF0  3,  2,  1,  0, -1, -1, -1, -1,  7,  6,  5,  4, -1, -1, -1, -1
+#define E8_SHUF1 11, 10,  9,  8, -1, -1, -1, -1, 15, 14, 13, 12, -1, -1, -1, -1
+
+#define E7_GATHER( y, and, or, srl, set1 )                                  \
+    or( or( or( and( y, set1( 0177 ) ), and( srl( y, 1 ), set1( INT64_C(0177) << 7 ) ) ), \
+            or( and( srl( y, 2 ), set1( INT64_C(0177) << 14 ) ),                \
+                and( srl( y, 3 ), set1( INT64_C(0177) << 21 ) ) ) ),            \
+        and( srl( y, 4 ), set1( INT64_C(0177) << 28 ) ) )
+
+__attribute__((target("ssse3")))
+size_t encode7ascii_n_ssse3( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    const __m128i shuf = _mm_setr_epi8( E7_SHUF );
+    const __m128i c7 = _mm_set1_epi64x( INT64_C(0x7F7F7F7F7F) );
+    const __m128i m18 = _mm_set1_epi64x( M18 );
+    size_t full, n;
+
+    full = len / 5;
+    if( full > wds )
+        full = wds;
+
+    for( n = 0; n + 2 <= full && len - 5 * n >= 16; n += 2 ) {
+        __m128i y, t;
+
+        y = _mm_and_si128( _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i *)(text + 5 * n) ),
+                                             shuf ), c7 );
+        t = E7_GATHER( y, _mm_and_si128, _mm_or_si128, _mm_srli_epi64, _mm_set1_epi64x );
+        _mm_storeu_si128( (__m128i *)(data + n),
+                          _mm_or_si128( _mm_srli_epi64( t, 17 ),
+                                        _mm_slli_epi64( _mm_and_si128( _mm_slli_epi64( t, 1 ), m18 ),
+                                                        32 ) ) );
+    }
+    return n + encode7ascii_n( text + 5 * n, len - 5 * n, data + n, wds - n );
+}
+
+__attribute__((target("ssse3")))
+size_t encode8ascii_n_ssse3( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    const __m128i shuf0 = _mm_setr_epi8( E8_SHUF0 );
+    const __m128i shuf1 = _mm_setr_epi8( E8_SHUF1 );
+    const __m128i hi18 = _mm_set1_epi64x( M18 << 32 );
+    size_t full, n;
+
+    full = len / 4;
+    if( full > wds )
+        full = wds;
+
+    for( n = 0; n + 4 <= full; n += 4 ) {
+        __m128i x, w;
+
+        x = _mm_loadu_si128( (const __m128i *)(text + 4 * n) );
+        w = _mm_shuffle_epi8( x, shuf0 );
+        _mm_storeu_si128( (__m128i *)(data + n),
+                          _mm_or_si128( _mm_srli_epi64( w, 14 ),
+                                        _mm_and_si128( _mm_slli_epi64( w, 36 ), hi18 ) ) );
+        w = _mm_shuffle_epi8( x, shuf1 );
+        _mm_storeu_si128( (__m128i *)(data + n + 2),
+                          _mm_or_si128( _mm_srli_epi64( w, 14 ),
+                                        _mm_and_si128( _mm_slli_epi64( w, 36 ), hi18 ) ) );
+    }
+    return n + encode8ascii_n( text + 4 * n, len - 4 * n, data + n, wds - n );
+}
+
+__attribute__((target("avx2")))
+size_t encode7ascii_n_avx2( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    const __m256i shuf = _mm256_setr_epi8( E7_SHUF, E7_SHUF );
+    const __m256i c7 = _mm256_set1_epi64x( INT64_C(0x7F7F7F7F7F) );
+    const __m256i m18 = _mm256_set1_epi64x( M18 );
+    size_t full, n;
+
+    full = len / 5;
+    if( full > wds )
+        full = wds;
+
+    for( n = 0; n + 4 <= full && len - 5 * n >= 26; n += 4 ) {
+        __m256i y, t;
+
+        y = _mm256_and_si256( _mm256_shuffle_epi8( LOAD2X128( text + 5 * n, 10 ), shuf ), c7 );
+        t = E7_GATHER( y, _mm256_and_si256, _mm256_or_si256, _mm256_srli_epi64,
+                       _mm256_set1_epi64x );
+        _mm256_storeu_si256( (__m256i *)(data + n),
+                             _mm256_or_si256( _mm256_srli_epi64( t, 17 ),
+                                              _mm256_slli_epi64( _mm256_and_si256( _mm256_slli_epi64( t, 1 ),
+                                                                                   m18 ), 32 ) ) );
+    }
+    return n + encode7ascii_n( text + 5 * n, len - 5 * n, data + n, wds - n );
+}
+
+__attribute__((target("avx2")))
+size_t encode8ascii_n_avx2( const uint8_t *text, size_t len, wd36_T *data, size_t wds ) {
+    const __m256i shuf0 = _mm256_setr_epi8( E8_SHUF0, E8_SHUF0 );
+    const __m256i shuf1 = _mm256_setr_epi8( E8_SHUF1, E8_SHUF1 );
+    const __m256i hi18 = _mm256_set1_epi64x( M18 << 32 );
+    size_t full, n;
+
+    full = len / 4;
+    if( full > wds )
+        full = wds;
+
+    for( n = 0; n + 8 <= full; n += 8 ) {
+        __m256i x, lo, hi;
+
+        x = _mm256_loadu_si256( (const __m256i *)(text + 4 * n) );
+        lo = _mm256_shuffle_epi8( x, shuf0 );
+        hi = _mm256_shuffle_epi8( x, shuf1 );
+        lo = _mm256_or_si256( _mm256_srli_epi64( lo, 14 ),
+                              _mm256_and_si256( _mm256_slli_epi64( lo, 36 ), hi18 ) );
+        hi = _mm256_or_si256( _mm256_srli_epi64( hi, 14 ),
+                              _mm256_and_si256( _mm256_slli_epi64( hi, 36 ), hi18 ) );
+        _mm256_storeu_si256( (__m256i *)(data + n), _mm256_permute2x128_si256( lo, hi, 0x20 ) );
+        _mm256_storeu_si256( (__m256i *)(data + n + 4), _mm256_permute2x128_si256( lo, hi, 0x31 ) );
+    }
+    return n + encode8ascii_n( text + 4 * n, len - 4 * n, data + n, wds - n );
+}
+
+#endif /* SIMD36_X86 */
+
+/* Kernel selection */
+
+/* Each row is keyed on both the hand-written scalar functions and the
+ * ones generated from the same layout, so either selects the kernel.
+ */
+
+static struct kernel {
+    unpackfn_T unpack;
+    packfn_T pack;
+    unpackfn_T gunpack;
+    packfn_T gpack;
+    simd36_level_T level;
+    unpackfn_T vunpack;
+    packfn_T vpack;
+} kernels[] = {
+#ifdef SIMD36_X86
+#define KERNEL( ref, mode, level, isa )                                 \
+    { unpack_##ref, pack_##ref, unpack_gen_##mode, pack_gen_##mode,     \
+      level, unpack_##isa, pack_##isa }
+    KERNEL( core_dump,    core_dump,    SIMD36_AVX512, core_dump_avx512 ),
+    KERNEL( core_dump,    core_dump,    SIMD36_AVX2,   core_dump_avx2 ),
+    KERNEL( core_dump,    core_dump,    SIMD36_SSSE3,  core_dump_ssse3 ),
+    KERNEL( high_density, high_density, SIMD36_AVX512, high_density_avx512 ),
+    KERNEL( high_density, high_density, SIMD36_AVX2,   high_density_avx2 ),
+    KERNEL( high_density, high_density, SIMD36_SSSE3,  high_density_ssse3 ),
+    KERNEL( sixbit_7,     sixbit,       SIMD36_AVX2,   gen_sixbit_avx2 ),
+    KERNEL( sixbit_7,     sixbit,       SIMD36_SSSE3,  gen_sixbit_ssse3 ),
+    KERNEL( industry,     industry,     SIMD36_AVX2,   gen_industry_avx2 ),
+    KERNEL( industry,     industry,     SIMD36_SSSE3,  gen_industry_ssse3 ),
+    KERNEL( ansi_ascii,   ansi_ascii,   SIMD36_AVX2,   gen_ansi_ascii_avx2 ),
+    KERNEL( ansi_ascii,   ansi_ascii,   SIMD36_SSSE3,  gen_ansi_ascii_ssse3 ),
+#undef KERNEL
+#endif
+    { NULL, NULL, NULL, NULL, SIMD36_NONE, NULL, NULL }
+};
+
+static struct xkernel {
+    packformat_T from, to;
+    simd36_level_T level;
+    transcodefn_T fn;
+} xkernels[] = {
+#ifdef SIMD36_X86
+    { PK_CORE_DUMP, PK_HIGH_DENSITY, SIMD36_AVX512, transcode_core_dump_to_high_density_avx512 },
+    { PK_CORE_DUMP, PK_HIGH_DENSITY, SIMD36_AVX2,   transcode_core_dump_to_high_density_avx2 },
+    { PK_CORE_DUMP, PK_HIGH_DENSITY, SIMD36_SSSE3,  transcode_core_dump_to_high_density_ssse3 },
+    { PK_HIGH_DENSITY, PK_CORE_DUMP, SIMD36_AVX512, transcode_high_density_to_core_dump_avx512 },
+    { PK_HIGH_DENSITY, PK_CORE_DUMP, SIMD36_AVX2,   transcode_high_density_to_core_dump_avx2 },
+    { PK_HIGH_DENSITY, PK_CORE_DUMP, SIMD36_SSSE3,  transcode_high_density_to_core_dump_ssse3 },
+#endif
+    { PK_NFORMATS, PK_NFORMATS, SIMD36_NONE, NULL }
+};
+
+static struct tkernel {
+    textfn_T fn;
+    simd36_level_T level;
+    textfn_T vfn;
+} tkernels[] = {
+#ifdef SIMD36_X86
+    { decode7ascii_n, SIMD36_AVX2,  decode7ascii_n_avx2 },
+    { decode7ascii_n, SIMD36_SSSE3, decode7ascii_n_ssse3 },
+    { decode8ascii_n, SIMD36_AVX2,  decode8ascii_n_avx2 },
+    { decode8ascii_n, SIMD36_SSSE3, decode8ascii_n_ssse3 },
+#endif
+    { NULL, SIMD36_NONE, NULL }
+};
+
+static struct ekernel {
+    encodefn_T fn;
+    simd36_level_T level;
+    encodefn_T vfn;
+} ekernels[] = {
+#ifdef SIMD36_X86
+    { encode7ascii_n, SIMD36_AVX2,  encode7ascii_n_avx2 },
+    { encode7ascii_n, SIMD36_SSSE3, encode7ascii_n_ssse3 },
+    { encode8ascii_n, SIMD36_AVX2,  encode8ascii_n_avx2 },
+    { encode8ascii_n, SIMD36_SSSE3, encode8ascii_n_ssse3 },
+#endif
+    { NULL, SIMD36_NONE, NULL }
+};
+
+static const char *const levelnames[] = {
+    "none", "ssse3", "avx2", "avx512"
+};
+
+simd36_level_T simd36_level( void ) {
+    static int level = -1;
+    const char *cap;
+    int i;
+
+    if( level >= 0 )
+        return (simd36_level_T)level;
+
+    level = SIMD36_NONE;
+#ifdef SIMD36_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "ssse3" ) )
+        level = SIMD36_SSSE3;
+    if( __builtin_cpu_supports( "avx2" ) )
+        level = SIMD36_AVX2;
+    if( __builtin_cpu_supports( "avx512f" ) && __builtin_cpu_supports( "avx512bw" ) )
+        level = SIMD36_AVX512;
+#endif
+
+    cap = getenv( "DATA36_SIMD" );
+    if( cap != NULL ) {
+        for( i = SIMD36_NONE; i <= SIMD36_AVX512; i++ ) {
+            if( !strcmp( cap, levelnames[i] ) ) {
+                if( i < level )
+                    level = i;
+                break;
+            }
+        }
+    }
+    return (simd36_level_T)level;
+}
+
+const char *simd36_levelname( simd36_level_T level ) {
+    return levelnames[level];
+}
+
+unpackfn_T simd36_unpack( unpackfn_T fn ) {
+    return simd36_unpack_level( fn, simd36_level() );
+}
+
+packfn_T simd36_pack( packfn_T fn ) {
+    return simd36_pack_level( fn, simd36_level() );
+}
+
+transcodefn_T simd36_transcode( packformat_T from, packformat_T to ) {
+    return simd36_transcode_level( from, to, simd36_level() );
+}
+
+textfn_T simd36_text( textfn_T fn ) {
+    return simd36_text_level( fn, simd36_level() );
+}
+
+encodefn_T simd36_encode( encodefn_T fn ) {
+    return simd36_encode_level( fn, simd36_level() );
+}
+
+unpackfn_T simd36_unpack_level( unpackfn_T fn, simd36_level_T level ) {
+    struct kernel *kp;
+
+    for( kp = kernels; kp->unpack; kp++ ) {
+        if( (kp->unpack == fn || kp->gunpack == fn) && kp->level <= level )
+            return kp->vunpack;
+    }
+    return fn;
+}
+
+packfn_T simd36_pack_level( packfn_T fn, simd36_level_T level ) {
+    struct kernel *kp;
+
+    for( kp = kernels; kp->pack; kp++ ) {
+        if( (kp->pack == fn || kp->gpack == fn) && kp->level <= level )
+            return kp->vpack;
+    }
+    return fn;
+}
+
+transcodefn_T simd36_transcode_level( packformat_T from, packformat_T to,
+                                      simd36_level_T level ) {
+    struct xkernel *kp;
+
+    for( kp = xkernels; kp->fn; kp++ ) {
+        if( kp->from == from && kp->to == to && kp->level <= level )
+            return kp->fn;
+    }
+    return transcoder( from, to );
+}
+
+textfn_T simd36_text_level( textfn_T fn, simd36_level_T level ) {
+    struct tkernel *kp;
+
+    for( kp = tkernels; kp->fn; kp++ ) {
+        if( kp->fn == fn && kp->level <= level )
+            return kp->vfn;
+    }
+    return fn;
+}
+
+encodefn_T simd36_encode_level( encodefn_T fn, simd36_level_T level ) {
+    struct ekernel *kp;
+
+    for( kp = ekernels; kp->fn; kp++ ) {
+        if( kp->fn == fn && kp->level <= level )
+            return kp->vfn;
+    }
+    return fn;
+}
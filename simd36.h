@@ -0,0 +1,106 @@
+/* Backup-10 for POSIX environments
+ */
+
+/* Copyright (c) 2015 Timothe Litt litt at acm ddot org
+ * All rights reserved.
+ *
+ * This software is provided under GPL V2, including its disclaimer of
+ * warranty.  Licensing under other terms may be available from the author.
+ *
+ * See the LICENSE file for the well-known text of GPL V2.
+ *
+ * Bug reports, fixes, suggestions and improvements are welcome.
+ */
+
+#ifndef SIMD36_H
+#define SIMD36_H
+
+#include "data36.h"
+
+/* Vector implementations of the tape packing modes.
+ *
+ * Each is a drop-in replacement for the scalar function of the same
+ * name in data36.c, and produces identical results.  They exist only
+ * where the compiler and CPU support them; use the selection functions
+ * to get the best one for the CPU that's running.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SIMD36_X86 1
+
+size_t unpack_core_dump_ssse3(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_core_dump_avx2(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_core_dump_avx512(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t pack_core_dump_ssse3(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t pack_core_dump_avx2(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t pack_core_dump_avx512(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+
+size_t unpack_high_density_ssse3(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_high_density_avx2(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t unpack_high_density_avx512(const uint8_t *inbuf, size_t insize, wd36_T *outbuf, size_t maxwc);
+size_t pack_high_density_ssse3(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t pack_high_density_avx2(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+size_t pack_high_density_avx512(wd36_T *inbuf, size_t wc, uint8_t *outbuf, const size_t bufsize);
+
+size_t transcode_core_dump_to_high_density_ssse3(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+size_t transcode_core_dump_to_high_density_avx2(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+size_t transcode_core_dump_to_high_density_avx512(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+size_t transcode_high_density_to_core_dump_ssse3(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+size_t transcode_high_density_to_core_dump_avx2(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+size_t transcode_high_density_to_core_dump_avx512(const uint8_t *inbuf, size_t insize, uint8_t *outbuf, const size_t bufsize);
+
+size_t decode7ascii_n_ssse3( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t decode7ascii_n_avx2( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t decode8ascii_n_ssse3( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t decode8ascii_n_avx2( const wd36_T *data, size_t wc, uint8_t *buf, int flags );
+size_t encode7ascii_n_ssse3( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+size_t encode7ascii_n_avx2( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+size_t encode8ascii_n_ssse3( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+size_t encode8ascii_n_avx2( const uint8_t *text, size_t len, wd36_T *data, size_t wds );
+#endif
+
+/* CPU feature levels, in increasing order */
+
+typedef enum {
+    SIMD36_NONE,
+    SIMD36_SSSE3,
+    SIMD36_AVX2,
+    SIMD36_AVX512
+} simd36_level_T;
+
+/* The highest level supported by this CPU.  The environment variable
+ * DATA36_SIMD (none, ssse3, avx2 or avx512) can lower it.
+ */
+simd36_level_T simd36_level( void );
+const char *simd36_levelname( simd36_level_T level );
+
+/* Return the fastest implementation of a scalar packing function,
+ * either the data36.c one or that generated by layout36.c.  Returns fn
+ * if there is nothing better.
+ */
+unpackfn_T simd36_unpack( unpackfn_T fn );
+packfn_T simd36_pack( packfn_T fn );
+
+/* Return the fastest direct conversion between two packing modes.
+ */
+transcodefn_T simd36_transcode( packformat_T from, packformat_T to );
+
+/* Return the fastest bulk text extraction: decode7ascii_n or decode8ascii_n.
+ */
+textfn_T simd36_text( textfn_T fn );
+
+/* Return the fastest bulk text encoding: encode7ascii_n or encode8ascii_n.
+ */
+encodefn_T simd36_encode( encodefn_T fn );
+
+/* As above, but for a given level rather than the CPU's.  level must not
+ * exceed simd36_level().  Used to compare implementations.
+ */
+unpackfn_T simd36_unpack_level( unpackfn_T fn, simd36_level_T level );
+packfn_T simd36_pack_level( packfn_T fn, simd36_level_T level );
+transcodefn_T simd36_transcode_level( packformat_T from, packformat_T to,
+                                      simd36_level_T level );
+textfn_T simd36_text_level( textfn_T fn, simd36_level_T level );
+encodefn_T simd36_encode_level( encodefn_T fn, simd36_level_T level );
+
+#endif
@@ -15,21 +15,31 @@
 
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "buf36.h"
 #include "magtape.h"
 #include "data36.h"
+#include "layout36.h"
+#include "perf36.h"
+#include "simd36.h"
 #include "version.h"
 
 #define MAXRECSIZE 0x00FFFFFF
-#define RECBUFSIZE (MAXRECSIZE * sizeof( uint8_t ))
 
 typedef enum {
     CORE_DUMP,
@@ -37,45 +47,143 @@ typedef enum {
     SIXBIT9,
     HIGH_DENSITY,
     INDUSTRY,
-    ANSI_ASCII
+    ANSI_ASCII,
+    AUTO_MODE                   /* -i auto: detected from the input */
 } tapemode_T;
 
 static tapemode_T tapemode( const char *name );
+static int find_mode( const char *name );
 static const char *modename( const tapemode_T mode );
 
-static int convert( const char *infile, const tapemode_T inmode,
+/* Conversion stages, timed with --stats or --profile */
+
+typedef enum {
+    ST_READ,
+    ST_UNPACK,
+    ST_PACK,
+    ST_TRANSCODE,
+    ST_WRITE,
+    ST_NSTAGES
+} stage_T;
+
+typedef struct {
+    uint64_t ns;
+    uint64_t frames;
+    uint64_t calls;
+    uint64_t events[PERF36_NEVENTS]; /* With --profile */
+} stagestat_T;
+
+/* Conversion buffers, kept for reuse by a series of conversions.
+ * They grow to fit the largest record converted.
+ */
+
+typedef struct {
+    buf36_T tape;               /* Output record */
+    buf36_T ten;                /* Words, if there's no direct conversion */
+} convbuf_T;
+
+/* A conversion in progress */
+
+typedef struct {
+    MAGTAPE *in, *out;
+    tapemode_T inmode, outmode;
+    unpackfn_T unpack;
+    packfn_T pack;
+    transcodefn_T xcode;        /* Direct conversion, if there is one */
+    inplacefn_T inplace;        /* Conversion within the read buffer, if used */
+    double infpw, outfpw;
+    convbuf_T *buf;
+    packformat_T infmt, outfmt;
+    int copy;                   /* Records are copied unchanged */
+    const char *method;
+    unsigned int threads;       /* Worker threads, for a parallel conversion */
+    const char *tag;            /* Prefix of diagnostics, if not NULL */
+    stagestat_T stage[ST_NSTAGES];
+    const mta_stats *instats;   /* Input counters as of the last record written */
+    size_t bufbytes;            /* Conversion buffers allocated */
+    perf36_T perf;              /* Counters, with --profile */
+    uint64_t stagestart;        /* Time and counts at stage_start */
+    uint64_t eventstart[PERF36_NEVENTS];
+} conv_T;
+
+static int convert( const char *infile, tapemode_T inmode,
                     const char *outfile, const tapemode_T outmode,
-                    const char *density, const char *reelsize);
+                    const char *density, const char *reelsize,
+                    unsigned int threads, convbuf_T *buf, const char *tag );
+static int detect_mode( const char *infile, tapemode_T *mode, const char *tag );
+static void diag( const char *tag, const char *fmt, ... )
+    __attribute__(( format( printf, 2, 3 ) ));
+static void diag_at( MAGTAPE *pos, const char *fmt, ... )
+    __attribute__(( format( printf, 2, 3 ) ));
+static int convert_serial( conv_T *cv );
+static int convert_pipeline( conv_T *cv );
+static int convert_partition( conv_T *cv );
+static int convert_copy( conv_T *cv );
+static int scan( const char *infile, const char *density, const char *reelsize );
+static unsigned int read_inplace( conv_T *cv, buf36_T *b, uint32_t *bytesread );
+static int end_read( MAGTAPE *in, unsigned int status );
+static void bad_record( conv_T *cv, MAGTAPE *pos, uint32_t bytesread );
+static int write_mark( conv_T *cv );
+static int write_record( conv_T *cv, uint8_t *buffer, size_t recsize, int haserr );
+static int grow_buffer( void *bufp, size_t *size, size_t need );
+static int batch( const char *listfile, char **pairs, int npairs,
+                  tapemode_T inmode, tapemode_T outmode,
+                  const char *density, const char *reelsize );
+static uint64_t stats_now( void );
+static void stats_stage( conv_T *cv, stage_T stage, uint64_t ns, uint64_t frames );
+static void stage_start( conv_T *cv );
+static void stage_end( conv_T *cv, stage_T stage, uint64_t frames );
+static void profile_report( conv_T *cv );
+static void stats_poll( conv_T *cv );
+static void stats_write( conv_T *cv, const char *state );
+static void stats_signal( int sig );
 
+static void select_kernels( void );
 static void usage( void );
 
+/* The packing functions are those generated from layout36.h */
+
 static struct tapemode {
     const char *const name;
     tapemode_T mode;
     const double fpw;
     packfn_T pack;
     unpackfn_T unpack;
+    packformat_T format;
     const char *const help;
 
 } tapemodes[] = {
-    { "core-dump",    CORE_DUMP,    5.0, pack_core_dump, unpack_core_dump,
-      "9-Track native format, 5 frames/36-bit word" },
-    { "sixbit-7",     SIXBIT7,      6.0, pack_sixbit_7, unpack_sixbit_7,
-      "7-Track sixbit format, 6 frames/36-bit word" },
-    { "sixbit-9",     SIXBIT9,      6.0, pack_sixbit_9, unpack_sixbit_9,
-      "9-Track sixbit format, 6 frames/36-bit word" },
-    { "sixbit",       SIXBIT9,      6.0, pack_sixbit_9, unpack_sixbit_9,
-      "9-Track sixbit format, 6 frames/36-bit word" },
-    { "high-density", HIGH_DENSITY, 4.5, pack_high_density, unpack_high_density,
-      "9-Track high-density, 9 frames/72-bit doubleword" },
-    { "industry",     INDUSTRY,     4.0, pack_industry, unpack_industry,
-      "9-Track industry-compatible format,  4 frames/32-bit byte" },
-    { "ansi-ascii",   ANSI_ASCII,   5.0, pack_ansi_ascii, unpack_ansi_ascii,
-      "9-Track ANSI-ASCII format.  5 frames of 7-bit ASCII/36-bit word" },
-    { NULL, 0, 0.0, NULL, NULL, NULL }
+    { "core-dump",    CORE_DUMP,    5.0, pack_gen_core_dump, unpack_gen_core_dump,
+      PK_CORE_DUMP,    "9-Track native format, 5 frames/36-bit word" },
+    { "sixbit-7",     SIXBIT7,      6.0, pack_gen_sixbit, unpack_gen_sixbit,
+      PK_SIXBIT,       "7-Track sixbit format, 6 frames/36-bit word" },
+    { "sixbit-9",     SIXBIT9,      6.0, pack_gen_sixbit, unpack_gen_sixbit,
+      PK_SIXBIT,       "9-Track sixbit format, 6 frames/36-bit word" },
+    { "sixbit",       SIXBIT9,      6.0, pack_gen_sixbit, unpack_gen_sixbit,
+      PK_SIXBIT,       "9-Track sixbit format, 6 frames/36-bit word" },
+    { "high-density", HIGH_DENSITY, 4.5, pack_gen_high_density, unpack_gen_high_density,
+      PK_HIGH_DENSITY, "9-Track high-density, 9 frames/72-bit doubleword" },
+    { "industry",     INDUSTRY,     4.0, pack_gen_industry, unpack_gen_industry,
+      PK_INDUSTRY,     "9-Track industry-compatible format,  4 frames/32-bit byte" },
+    { "ansi-ascii",   ANSI_ASCII,   5.0, pack_gen_ansi_ascii, unpack_gen_ansi_ascii,
+      PK_ANSI_ASCII,   "9-Track ANSI-ASCII format.  5 frames of 7-bit ASCII/36-bit word" },
+    { NULL, 0, 0.0, NULL, NULL, PK_NFORMATS, NULL }
 };
 
 static int verbose = 0;
+static unsigned int jobs = 1;
+static int scanonly = 0;
+static int batchmode = 0;
+static const char *manifest = NULL;
+static int repack = 0;
+static const char *statsfile = NULL;
+static int profile = 0;
+static int partition = 0;
+static const char *inmodestr = "r";  /* magtape_open modes: --io */
+static const char *outmodestr = "w";
+static int timing = 0;          /* Stages are timed */
+static uint64_t statsstart;
+static volatile sig_atomic_t statsrequest = 0;
 
 int main( int argc, char **argv) {
     char *infile = NULL,
@@ -102,11 +210,73 @@ int main( int argc, char **argv) {
             PRINT_VERSION( stderr, tape36 );
             exit(0);
         }
+        if( !strcmp( sws, "-scan" ) ) {
+            scanonly = 1;
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strcmp( sws, "-batch" ) || (!strncmp( sws, "-batch=", 7 ) && sws[7]) ) {
+            batchmode = 1;
+            if( sws[6] == '=' )
+                manifest = sws + 7;
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strcmp( sws, "-profile" ) ) {
+            profile = 1;
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strncmp( sws, "-hugepages=", 11 ) ) {
+            int policy = buf36_policy( sws + 11 );
+
+            if( policy < 0 ) {
+                fprintf( stderr, "Invalid huge page policy %s\n", sws + 11 );
+                exit(1);
+            }
+            (void) buf36_setpolicy( (buf36_huge_T)policy );
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strcmp( sws, "-partition" ) ) {
+            partition = 1;
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strncmp( sws, "-io=", 4 ) ) {
+            if( !strcmp( sws + 4, "uring" ) ) {
+                inmodestr = "ru";
+                outmodestr = "wu";
+            } else if( !strcmp( sws + 4, "direct" ) ) {
+                inmodestr = "rd";
+                outmodestr = "wd";
+            } else if( !strcmp( sws + 4, "stdio" ) ) {
+                inmodestr = "r";
+                outmodestr = "w";
+            } else {
+                fprintf( stderr, "Invalid I/O method %s\n", sws + 4 );
+                exit(1);
+            }
+            argc--;
+            argv++;
+            continue;
+        }
+        if( !strncmp( sws, "-stats=", 7 ) && sws[7] ) {
+            statsfile = sws + 7;
+            argc--;
+            argv++;
+            continue;
+        }
 
         while( *sws ) {
-            char *arg = NULL;
+            char *arg = NULL, *endp;
 
-            if( strchr( "dior", sws[0] ) ) { /* Switches with arguments */
+            if( strchr( "dijor", sws[0] ) ) { /* Switches with arguments */
                 if( sws[1] ) {
                     arg = strdup( sws + 1 );
                     sws[1] = '\0';
@@ -125,6 +295,13 @@ int main( int argc, char **argv) {
                 case 'i':
                     inmode = tapemode( arg );
                     break;
+                case 'j':
+                    jobs = (unsigned int) strtoul( arg, &endp, 10 );
+                    if( *endp || jobs == 0 || jobs > 1024 ) {
+                        fprintf( stderr, "Invalid thread count %s\n", arg );
+                        exit(1);
+                    }
+                    break;
                 case 'o':
                     outmode = tapemode( arg );
                     break;
@@ -144,6 +321,10 @@ int main( int argc, char **argv) {
                 verbose++;
                 break;
 
+            case 'n':
+                repack = 1;
+                break;
+
             case 'h':
                 usage();
                 exit(0);
@@ -158,6 +339,24 @@ int main( int argc, char **argv) {
         argv++;
     }
 
+    if( batchmode ) {
+        if( scanonly || statsfile || profile ) {
+            fprintf( stderr, "--scan, --stats and --profile are not available with --batch\n" );
+            exit(1);
+        }
+        if( manifest? argc != 0: (argc == 0 || (argc % 2) != 0) ) {
+            fprintf( stderr, "--batch needs a manifest or infile outfile pairs\n" );
+            exit(1);
+        }
+        select_kernels();
+        exit(batch( manifest, argv, argc, inmode, outmode, density, reelsize ) );
+    }
+
+    if( scanonly && argc > 1 ) {
+        fprintf( stderr, "--scan doesn't write an output file\n" );
+        exit(1);
+    }
+
     if( argc >= 1 ) {
         argc--;
         infile = argv++[0];
@@ -172,181 +371,2128 @@ int main( int argc, char **argv) {
         outfile = "-";
     }
 
-    exit(convert( infile, inmode, outfile, outmode, density, reelsize ) );
+    if( scanonly ) {
+        if( statsfile || profile ) {
+            fprintf( stderr, "--stats and --profile are not available with --scan\n" );
+            exit(1);
+        }
+        exit(scan( infile, density, reelsize ) );
+    }
+    timing = (statsfile || profile);
+    if( timing )
+        statsstart = stats_now();
+    if( profile && jobs > 1 ) {
+        fprintf( stderr, "--profile counts one thread: converting without -j\n" );
+        jobs = 1;
+    }
+
+    select_kernels();
+
+    exit(convert( infile, inmode, outfile, outmode, density, reelsize, jobs, NULL, NULL ) );
 }
 
-static int convert( const char *infile, const tapemode_T inmode,
+/* Convert a tape.  threads > 1 uses the pipeline, or with --partition,
+ * a partitioned conversion if the image allows.  buf, if not NULL,
+ * holds buffers from earlier conversions to reuse; otherwise they're
+ * freed when done.  tag, if not NULL, prefixes its diagnostics.
+ */
+
+static int convert( const char *infile, tapemode_T inmode,
                     const char *outfile, const tapemode_T outmode,
-                    const char *density, const char *reelsize) {
-    MAGTAPE *in, *out;
-    unsigned int status;
-    uint32_t bytesread, recsize;
-    packfn_T pack = NULL;
-    unpackfn_T unpack = NULL;
+                    const char *density, const char *reelsize,
+                    unsigned int threads, convbuf_T *buf, const char *tag ) {
+    conv_T cv;
+    convbuf_T local;
     struct tapemode *mp;
-    uint8_t *tapebuffer;
-    wd36_T *tenbuffer;
-    size_t tenbufsize = 0;
-    size_t maxwc = 0;
+    packformat_T infmt = PK_NFORMATS, outfmt = PK_NFORMATS;
+    static const mta_stats nocounts;
+    off_t outpos;
+    int rc, outfd;
 
-    int done = 0;
+    if( outmode == AUTO_MODE ) {
+        diag( tag, "auto is only valid as an input mode\n" );
+        return 1;
+    }
+    if( inmode == AUTO_MODE && detect_mode( infile, &inmode, tag ) != 0 )
+        return 1;
+
+    memset( &cv, 0, sizeof( cv ) );
+    if( buf == NULL ) {
+        memset( &local, 0, sizeof( local ) );
+        buf = &local;
+    }
+    cv.buf = buf;
+    cv.threads = threads;
+    cv.tag = tag;
+    cv.inmode = inmode;
+    cv.outmode = outmode;
 
     for( mp = tapemodes; mp->name; mp++ ) {
         if( mp->mode == inmode ) {
-            unpack = mp->unpack;
-            tenbufsize =  sizeof( wd36_T ) * (size_t)
-                ceil(((double)MAXRECSIZE / mp->fpw) );
-            maxwc = tenbufsize / sizeof( wd36_T );
+            cv.unpack = mp->unpack;
+            cv.infpw = mp->fpw;
+            infmt = mp->format;
+        }
+        if( mp->mode == outmode ) {
+            cv.pack = mp->pack;
+            cv.outfpw = mp->fpw;
+            outfmt = mp->format;
         }
-        if( mp->mode == outmode )
-            pack = mp->pack;
     }
-    if( !( pack && unpack ) )
+    if( !( cv.pack && cv.unpack ) )
         abort();
+    cv.xcode = simd36_transcode( infmt, outfmt );
+    cv.infmt = infmt;
+    cv.outfmt = outfmt;
+    cv.copy = (infmt == outfmt && !repack);
 
-    in = magtape_open( infile, "r" );
-    if( !in ) {
-        fprintf( stderr, "%s: %s\n", infile, strerror( errno ) );
+    cv.in = magtape_open( infile, inmodestr );
+    if( !cv.in ) {
+        diag( tag, "%s: %s\n", infile, strerror( errno ) );
         return 1;
     }
+    cv.in->tag = tag;
     if( verbose )
-        fprintf( stderr, "Reading %s in %s mode\n", infile, modename( inmode ) );
+        diag( tag, "Reading %s in %s mode\n", infile, modename( inmode ) );
+
+    /* An unmapped image is copied to a buffer anyway, so read records
+     * into the output buffer and convert them there.  A vector transcoder
+     * is faster than the buffer it saves.
+     */
 
-    out = magtape_open( outfile, "w" );
-    if( !out ) {
-        fprintf( stderr, "%s: %s\n", outfile, strerror( errno ) );
+    if( !cv.copy && !(cv.in->status & MTS_MAPPED) &&
+        cv.xcode == transcoder( infmt, outfmt ) )
+        cv.inplace = transcoder_inplace( infmt, outfmt );
+
+    cv.out = magtape_open( outfile, outmodestr );
+    if( !cv.out ) {
+        diag( tag, "%s: %s\n", outfile, strerror( errno ) );
+        magtape_close( &cv.in );
         return 1;
     }
+    cv.out->tag = tag;
     if( density || reelsize ) {
-        if( magtape_setsize( out, reelsize, density ) != 0 ) {
-            fprintf( stderr, "Invalid reel size or density\n" );
+        if( magtape_setsize( cv.out, reelsize, density ) != 0 ) {
+            diag( tag, "Invalid reel size or density\n" );
+            magtape_close( &cv.out );
+            magtape_close( &cv.in );
             return 1;
         }
-        magtape_setsize( in, reelsize, density );
+        magtape_setsize( cv.in, reelsize, density );
     }
 
     if( verbose )
-        fprintf( stderr, "Writing %s in %s mode\n", outfile, modename( outmode ) );
+        diag( tag, "Writing %s in %s mode\n", outfile, modename( outmode ) );
 
-    tapebuffer = malloc( RECBUFSIZE );
-    tenbuffer = malloc( tenbufsize );
-    if( !(tapebuffer && tenbuffer) ) {
-        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
-        return 1;
+    cv.instats = &cv.in->stats;
+    if( profile && !perf36_open( &cv.perf ) )
+        diag( tag, "Performance counters are not available: %s\n",
+                 strerror( cv.perf.error ) );
+    if( statsfile ) {
+        struct sigaction sa;
+
+        memset( &sa, 0, sizeof( sa ) );
+        sa.sa_handler = stats_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset( &sa.sa_mask );
+        if( sigaction( SIGUSR1, &sa, NULL ) != 0 )
+            diag( tag, "SIGUSR1: %s\n", strerror( errno ) );
+    }
+
+    if( cv.copy ) {
+        cv.method = "copy";
+        rc = convert_copy( &cv );
+    } else if( threads > 1 && partition && (cv.in->status & MTS_MAPPED) &&
+               !(density || reelsize) &&
+               magtape_reserve( cv.out, 0, &nocounts, 0, &outfd, &outpos ) == MTA_OK ) {
+        cv.method = "partition";
+        rc = convert_partition( &cv );
+    } else if( threads > 1 ) {
+        if( partition && verbose )
+            diag( tag, "Can't partition this conversion: using the pipeline\n" );
+        cv.method = "pipeline";
+        rc = convert_pipeline( &cv );
+    } else {
+        cv.method = "serial";
+        rc = convert_serial( &cv );
+    }
+
+    if( statsfile ) {
+        (void) magtape_flush( cv.out, 0 ); /* Account for buffered output */
+        stats_write( &cv, rc? "failed": "complete" );
+    }
+    if( profile ) {
+        profile_report( &cv );
+        perf36_close( &cv.perf );
     }
 
+    if( verbose && !rc ) {
+        diag( tag, "Completed\n" );
+        diag_at( cv.in, "Input:  at " );
+        diag_at( cv.out, "Output: at " );
+    }
+    /* Output first: it may still be copying from the input */
+
+    magtape_close( &cv.out );
+    magtape_close( &cv.in );
+
+    if( buf == &local ) {
+        buf36_free( &local.ten );
+        buf36_free( &local.tape );
+    }
+    return rc? 1: 0;
+}
+
+/* Write a diagnostic, as one write to stderr (magtape_report), so those
+ * of concurrent --batch jobs aren't spliced together; it starts with
+ * the job's tag.  diag_at follows the message with pos's position.
+ */
+
+static void diag( const char *tag, const char *fmt, ... ) {
+    va_list ap;
+
+    va_start( ap, fmt );
+    magtape_vreport( tag, NULL, fmt, ap );
+    va_end( ap );
+
+    return;
+}
+
+static void diag_at( MAGTAPE *pos, const char *fmt, ... ) {
+    va_list ap;
+
+    va_start( ap, fmt );
+    magtape_vreport( pos->tag, pos, fmt, ap );
+    va_end( ap );
+
+    return;
+}
+
+/* Convert one record at a time */
+
+static int convert_serial( conv_T *cv ) {
+    unsigned int status;
+    uint32_t bytesread;
+    size_t recsize;
+    const uint8_t *record;
+    size_t maxwc, outmax;
+    convbuf_T *buf = cv->buf;
+
+    int done = 0, rc = 0;
+
     while( !done ) {
         int haserr = 0;
 
-        status = magtape_read( in, tapebuffer, MAXRECSIZE, &bytesread );
+        /* Unpack directly from the input image when it's mapped */
+
+        stage_start( cv );
+        if( cv->inplace )
+            status = read_inplace( cv, &buf->tape, &bytesread );
+        else
+            status = magtape_read_view( cv->in, &record, &bytesread );
+        stage_end( cv, ST_READ, (status == MTA_OK || status == MTA_ERR)? bytesread: 0 );
         switch( status ) {
         case MTA_OK:
             break;
-        case MTA_EOM:
-            if( verbose ) {
-                fprintf( stderr, "End of medium at " );
-                magtape_pprintf( stderr, in, 1 );
-            }
-            done = 1;
-            continue;
         case MTA_TM:
         case MTA_EOF:
-            if( verbose ) {
-                fprintf( stderr, "Tape mark at " );
-                magtape_pprintf( stderr, in, 1 );
-            }
-            status = magtape_mark( out, MTA_EOF_MARK );
-            if( status != MTA_OK ) {
-                fprintf( stderr, "Error writing tape mark: %s at ", strerror( errno ) );
-                magtape_pprintf( stderr, out, 1 );
-                done = 1;
-            }
-            if( verbose && (out->status & MTS_EOT) ) {
-                out->status &= ~ MTS_EOT;
-                fprintf( stderr, "EOT marker at " );
-                magtape_pprintf( stderr, out, 1 );
-            }
+            done = rc = end_read( cv->in, status ) || write_mark( cv );
             continue;
         case MTA_ERR:
             haserr = 1;
             break;
-        case MTA_IOE:
-            fprintf( stderr, "Error reading tape file: %s at ", strerror( errno ) );
-            magtape_pprintf( stderr, in, 1 );
-            done = 1;
+        default:
+            done = end_read( cv->in, status );
+            rc = (status != MTA_EOM);
             continue;
-        case MTA_FMT:
-            fprintf( stderr, "Input tape file format error at " );
-            magtape_pprintf( stderr, in, 1 );
-            done = 1;
+        }
+
+        if( cv->inplace ) {
+            if( buf->tape.size > cv->bufbytes )
+                cv->bufbytes = buf->tape.size;
+            stage_start( cv );
+            recsize = cv->inplace( buf->tape.data, bytesread, buf->tape.size );
+            stage_end( cv, ST_TRANSCODE, bytesread );
+            if( recsize == (size_t)-1 ) {
+                bad_record( cv, cv->in, bytesread );
+                rc = 1;
+                break;
+            }
+            done = rc = write_record( cv, buf->tape.data, recsize, haserr );
             continue;
-        case MTA_BTL: /* Can't happen - maximum size was allocated... */
-        default:
-            abort();
         }
-        recsize = unpack(tapebuffer, bytesread, tenbuffer, maxwc );
+
+        /* Grow the buffers to fit this record.  The intermediate buffer
+         * is only needed without a direct conversion.
+         */
+
+        maxwc = (size_t)ceil( (double)bytesread / cv->infpw ) + 1;
+        outmax = (size_t)ceil( (double)maxwc * cv->outfpw ) + 9;
+        if( buf36_reserve( &buf->tape, outmax ) ||
+            (!cv->xcode && buf36_reserve( &buf->ten, maxwc * sizeof( wd36_T ) )) ) {
+            diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+            return 1;
+        }
+        if( buf->tape.size + buf->ten.size > cv->bufbytes )
+            cv->bufbytes = buf->tape.size + buf->ten.size;
+
+        stage_start( cv );
+        if( cv->xcode ) {
+            recsize = cv->xcode( record, bytesread, buf->tape.data, buf->tape.size );
+            stage_end( cv, ST_TRANSCODE, bytesread );
+        } else {
+            recsize = cv->unpack(record, bytesread, buf->ten.data, maxwc );
+            stage_end( cv, ST_UNPACK, bytesread );
+            if( recsize != (size_t)-1 ) {
+                stage_start( cv );
+                recsize = cv->pack( buf->ten.data, recsize, buf->tape.data, buf->tape.size );
+                stage_end( cv, ST_PACK, recsize );
+            }
+        }
         if( recsize == (size_t)-1 ) {
-            fprintf( stderr, "Record size %" PRIu32 " is invalid for %s input at ", bytesread, modename( inmode ) );
-            magtape_pprintf( stderr, in, 1 );
+            bad_record( cv, cv->in, bytesread );
+            rc = 1;
             break;
         }
-        recsize = pack( tenbuffer, recsize, tapebuffer, RECBUFSIZE );
-        if( haserr )
-            recsize = MTA_DATA_ERROR( recsize );
-        status = magtape_write( out, tapebuffer, recsize );
-        switch( status ) {
-        case MTA_OK:
-            break;
+        done = rc = write_record( cv, buf->tape.data, recsize, haserr );
+    }
 
-        case MTA_IOE:
-            fprintf( stderr, "Error writing tape file: %s at ", strerror( errno ) );
-            magtape_pprintf( stderr, out, 1 );
-            done = 1;
+    return rc;
+}
+
+/* Catalog a tape without reading its data.
+ * Prints each file's record count, size distribution, and any
+ * error-flagged and noise records, followed by totals for the tape.
+ */
+
+#define SCAN_BUCKETS 25         /* Powers of 2 up to MAXRECSIZE */
+
+typedef struct {
+    uint32_t records, errors, noise;
+    uint64_t bytes;
+    uint32_t minsize, maxsize;
+    uint32_t hist[SCAN_BUCKETS];
+} scanstats_T;
+
+static void scan_record( scanstats_T *st, uint32_t recsize ) {
+    unsigned int b;
+
+    if( st->records == 0 || recsize < st->minsize )
+        st->minsize = recsize;
+    if( recsize > st->maxsize )
+        st->maxsize = recsize;
+    st->records++;
+    st->bytes += recsize;
+
+    for( b = 0; b < SCAN_BUCKETS -1 && (recsize >> b) != 0; b++ )
+        ;
+    st->hist[b]++;
+
+    return;
+}
+
+static void scan_report( const char *what, const scanstats_T *st ) {
+    unsigned int b;
+
+    printf( "%s: %" PRIu32 " record%s, %" PRIu64 " bytes", what,
+            st->records, (st->records == 1? "": "s"), st->bytes );
+    if( st->records )
+        printf( ", sizes %" PRIu32 "-%" PRIu32, st->minsize, st->maxsize );
+    printf( "\n" );
+
+    for( b = 0; b < SCAN_BUCKETS; b++ ) {
+        if( st->hist[b] == 0 )
             continue;
+        printf( "    %8" PRIu32 "-%-8" PRIu32 " %10" PRIu32 "\n",
+                (b? (uint32_t)1 << (b-1): 0), ((uint32_t)1 << b) -1, st->hist[b] );
+    }
+    if( st->errors )
+        printf( "    %" PRIu32 " record%s with data errors\n", st->errors,
+                (st->errors == 1? "": "s") );
+    if( st->noise )
+        printf( "    %" PRIu32 " noise record%s\n", st->noise,
+                (st->noise == 1? "": "s") );
 
-        case MTA_EOT:
-            if( verbose ) {
-                fprintf( stderr, "EOT marker at " );
-                magtape_pprintf( stderr, out, 1 );
-            }
-            break;
+    return;
+}
+
+static int scan( const char *infile, const char *density, const char *reelsize ) {
+    MAGTAPE *in;
+    scanstats_T file, tape;
+    uint32_t filenum = 0, noise = 0;
+    int done = 0, rc = 0;
+
+    in = magtape_open( infile, inmodestr );
+    if( !in ) {
+        fprintf( stderr, "%s: %s\n", infile, strerror( errno ) );
+        return 1;
+    }
+    if( (density || reelsize) && magtape_setsize( in, reelsize, density ) != 0 ) {
+        fprintf( stderr, "Invalid reel size or density\n" );
+        magtape_close( &in );
+        return 1;
+    }
+
+    memset( &file, 0, sizeof( file ) );
+    memset( &tape, 0, sizeof( tape ) );
+
+    while( !done ) {
+        unsigned int status;
+        uint32_t recsize;
+        char name[32];
 
+        status = magtape_skip_record( in, &recsize );
+        switch( status ) {
+        case MTA_ERR:
+            printf( "Data error flag on record %" PRIu32 " (%" PRIu32 " bytes) of file %" PRIu32 "\n",
+                    in->blocknum, recsize, filenum );
+            file.errors++;
+            /* Fall through */
+        case MTA_OK:
+            scan_record( &file, recsize );
+            scan_record( &tape, recsize );
+            continue;
+        case MTA_TM:
+        case MTA_EOF:
+            break;
         case MTA_EOM:
+            done = 1;
+            break;
         default:
-            abort();
+            done = 1;
+            rc = 1;
+            (void) end_read( in, status );
+            break;
         }
+
+        file.noise = (uint32_t)(in->stats.noise - noise);
+        noise = (uint32_t)in->stats.noise;
+        if( done && !file.records && !file.noise )
+            break;
+
+        snprintf( name, sizeof( name ), "File %" PRIu32, filenum++ );
+        scan_report( name, &file );
+        if( status == MTA_EOF )
+            printf( "    (logical end of tape)\n" );
+        else if( done )
+            printf( "    (no closing tape mark)\n" );
+
+        tape.errors += file.errors;
+        memset( &file, 0, sizeof( file ) );
     }
+    tape.noise = (uint32_t)in->stats.noise;
 
+    printf( "\n%" PRIu32 " file%s\n", filenum, (filenum == 1? "": "s") );
+    scan_report( "Total", &tape );
     if( verbose ) {
-        fprintf( stderr, "Completed\n" );
-        fprintf( stderr, "Input:  at " );
-        magtape_pprintf( stderr, in, 1 );
-        fprintf( stderr, "Output: at " );
-        magtape_pprintf( stderr, out, 1 );
+        diag_at( in, "Completed at " );
     }
     magtape_close( &in );
-    magtape_close( &out );
 
-    free(tenbuffer);
-    free(tapebuffer);
+    return rc;
+}
 
-    return 0;
+/* The formats match: validate each record and copy it unchanged.
+ * The frames are not touched, so unused bits are not normalized.
+ */
+
+static int convert_copy( conv_T *cv ) {
+    unsigned int status;
+    uint32_t bytesread, records = 0, marks = 0, errors = 0;
+    const uint8_t *record;
+    size_t unit;
+    int done = 0, rc = 0;
+
+    if( verbose )
+        diag( cv->tag, "Formats match: copying records\n" );
+
+    unit = pack_unit( cv->infmt );
+
+    while( !done ) {
+        int haserr = 0;
+
+        stage_start( cv );
+        status = magtape_read_view( cv->in, &record, &bytesread );
+        stage_end( cv, ST_READ, (status == MTA_OK || status == MTA_ERR)? bytesread: 0 );
+        switch( status ) {
+        case MTA_OK:
+            break;
+        case MTA_TM:
+        case MTA_EOF:
+            done = rc = end_read( cv->in, status ) || write_mark( cv );
+            marks++;
+            continue;
+        case MTA_ERR:
+            haserr = 1;
+            errors++;
+            break;
+        default:
+            done = end_read( cv->in, status );
+            rc = (status != MTA_EOM);
+            continue;
+        }
+        if( bytesread % unit ) {
+            bad_record( cv, cv->in, bytesread );
+            rc = 1;
+            break;
+        }
+        done = rc = write_record( cv, NULL, bytesread, haserr );
+        records++;
+    }
+
+    if( verbose )
+        diag( cv->tag, "Copied %" PRIu32 " records (%" PRIu32 " with errors) and %"
+                 PRIu32 " tape marks\n", records, errors, marks );
+
+    return rc;
 }
 
-static tapemode_T tapemode( const char *name ) {
-    struct tapemode *p;
+/* Read a record into b for conversion in place.  b grows to hold the
+ * record and its converted form; a record that doesn't fit is read again.
+ * Returns the magtape_read status, or MTA_IOE if b can't grow.
+ */
 
-    if( name != NULL ) {
-        for( p = tapemodes; p->name; p++ ) {
-            if( !strcasecmp( name, p->name ) ) {
-                return p->mode;
-            }
+static unsigned int read_inplace( conv_T *cv, buf36_T *b, uint32_t *bytesread ) {
+    unsigned int status;
+
+    if( b->size == 0 && buf36_reserve( b, 1 ) != 0 )
+        return MTA_IOE;
+
+    while( (status = magtape_read( cv->in, b->data, b->size, bytesread )) == MTA_BTL ) {
+        if( buf36_reserve( b, *bytesread ) != 0 )
+            return MTA_IOE;
+    }
+    if( (status == MTA_OK || status == MTA_ERR) &&
+        buf36_extend( b, transcode_size( cv->infmt, cv->outfmt, *bytesread ), *bytesread ) != 0 )
+        return MTA_IOE;
+
+    return status;
+}
+
+/* Report the input status of a read that did not return data.
+ * Returns 1 if the conversion is done.  Only MTA_EOM ends it cleanly.
+ */
+
+static int end_read( MAGTAPE *in, unsigned int status ) {
+    switch( status ) {
+    case MTA_EOM:
+        if( verbose ) {
+            diag_at( in, "End of medium at " );
+        }
+        return 1;
+    case MTA_TM:
+    case MTA_EOF:
+        if( verbose ) {
+            diag_at( in, "Tape mark at " );
+        }
+        return 0;
+    case MTA_IOE:
+        diag_at( in, "Error reading tape file: %s at ", strerror( errno ) );
+        return 1;
+    case MTA_FMT:
+        diag_at( in, "Input tape file format error at " );
+        return 1;
+    case MTA_BTL: /* Can't happen - views have no size limit... */
+    default:
+        abort();
+    }
+}
+
+static void bad_record( conv_T *cv, MAGTAPE *pos, uint32_t bytesread ) {
+    diag_at( pos, "Record size %" PRIu32 " is invalid for %s input at ", bytesread, modename( cv->inmode ) );
+
+    return;
+}
+
+/* Write a tape mark.  Returns 1 if the conversion is done.
+ */
+
+static int write_mark( conv_T *cv ) {
+    unsigned int status;
+    int done = 0;
+
+    stage_start( cv );
+    if( cv->copy )
+        status = magtape_copy_last( cv->out, cv->in );
+    else
+        status = magtape_mark( cv->out, MTA_EOF_MARK );
+    stage_end( cv, ST_WRITE, 0 );
+    stats_poll( cv );
+    if( status != MTA_OK ) {
+        diag_at( cv->out, "Error writing tape mark: %s at ", strerror( errno ) );
+        done = 1;
+    }
+    if( verbose && (cv->out->status & MTS_EOT) ) {
+        cv->out->status &= ~ MTS_EOT;
+        diag_at( cv->out, "EOT marker at " );
+    }
+    return done;
+}
+
+/* Write a converted record.  Returns 1 if the conversion is done.
+ */
+
+static int write_record( conv_T *cv, uint8_t *buffer, size_t recsize, int haserr ) {
+    unsigned int status;
+
+    stage_start( cv );
+    if( cv->copy ) {
+        status = magtape_copy_last( cv->out, cv->in );
+    } else {
+        status = magtape_write( cv->out, buffer,
+                                haserr? MTA_DATA_ERROR( recsize ): recsize );
+    }
+    stage_end( cv, ST_WRITE, recsize );
+    stats_poll( cv );
+    switch( status ) {
+    case MTA_OK:
+        break;
+
+    case MTA_IOE:
+        diag_at( cv->out, "Error writing tape file: %s at ", strerror( errno ) );
+        return 1;
+
+    case MTA_EOT:
+        if( verbose ) {
+            diag_at( cv->out, "EOT marker at " );
         }
+        break;
+
+    case MTA_EOM:
+    default:
+        abort();
     }
+    return 0;
+}
+
+/* Pipelined conversion.
+ *
+ * The calling thread reads records, threads worker threads unpack and
+ * pack them, and a writer thread writes them in their original order.
+ * Tape marks travel through the pipeline like records, so their order
+ * is preserved too.  Work items come from a fixed pool, so the number
+ * of records in flight - and memory use - is bounded.  An item's
+ * buffers are kept when it is recycled, and only grow.
+ *
+ * Records are copied from the input unless it is mapped, in which case
+ * the mapping stays valid until the input is closed.
+ */
+
+typedef enum {
+    ITEM_RECORD,
+    ITEM_MARK,
+    ITEM_END
+} itemtype_T;
+
+typedef struct pipeitem {
+    struct pipeitem *next;
+    itemtype_T type;
+    uint64_t seq;
+    const uint8_t *data;        /* Input frames */
+    uint32_t insize;
+    int haserr;
+    size_t outsize;             /* (size_t)-1 if insize is invalid */
+    uint32_t filenum, blocknum; /* Input position, for messages */
+    double reelpos;
+    mta_stats instats;          /* Input counters, with --stats */
+    buf36_T in;                 /* Input frames, if the image isn't mapped */
+    wd36_T *tenbuf;
+    size_t tenbufsize;
+    uint8_t *outbuf;
+    size_t outbufsize;
+    uint8_t *out;               /* Output frames: outbuf, or in if converted in place */
+    uint64_t ns[ST_NSTAGES];    /* Time in each stage, with --stats */
+    size_t bufcounted;          /* Buffer sizes included in bufbytes */
+} pipeitem_T;
+
+typedef struct {
+    pipeitem_T *head, *tail;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} pipeq_T;
+
+typedef struct {
+    conv_T *cv;
+    pipeq_T freeq, workq, doneq;
+    pipeitem_T *items;
+    size_t nitems;
+    int stop;                   /* Writer has stopped; protected by freeq.lock */
+    int rc;                     /* Writer's result: 1 if it failed */
+    mta_stats instats;          /* Input counters for the writer's reports */
+    MAGTAPE where;              /* The input as the pipeline started, for positions */
+} pipeline_T;
+
+static void pipeq_init( pipeq_T *q ) {
+    q->head = q->tail = NULL;
+    q->closed = 0;
+    pthread_mutex_init( &q->lock, NULL );
+    pthread_cond_init( &q->ready, NULL );
+
+    return;
+}
+
+static void pipeq_destroy( pipeq_T *q ) {
+    pthread_mutex_destroy( &q->lock );
+    pthread_cond_destroy( &q->ready );
+
+    return;
+}
+
+static void pipeq_put( pipeq_T *q, pipeitem_T *item ) {
+    pthread_mutex_lock( &q->lock );
+    item->next = NULL;
+    if( q->tail )
+        q->tail->next = item;
+    else
+        q->head = item;
+    q->tail = item;
+    pthread_cond_signal( &q->ready );
+    pthread_mutex_unlock( &q->lock );
+
+    return;
+}
+
+/* Wait for an item.  Returns NULL once the queue is closed and empty.
+ */
+
+static pipeitem_T *pipeq_get( pipeq_T *q ) {
+    pipeitem_T *item;
+
+    pthread_mutex_lock( &q->lock );
+    while( q->head == NULL && !q->closed )
+        pthread_cond_wait( &q->ready, &q->lock );
+    item = q->head;
+    if( item ) {
+        q->head = item->next;
+        if( q->head == NULL )
+            q->tail = NULL;
+    }
+    pthread_mutex_unlock( &q->lock );
+
+    return item;
+}
+
+static void pipeq_close( pipeq_T *q ) {
+    pthread_mutex_lock( &q->lock );
+    q->closed = 1;
+    pthread_cond_broadcast( &q->ready );
+    pthread_mutex_unlock( &q->lock );
+
+    return;
+}
+
+/* Grow a buffer to at least need bytes, doubling its size so that a
+ * series of larger records causes few reallocations.
+ * Returns 1 if out of memory.
+ */
+
+static int grow_buffer( void *bufp, size_t *size, size_t need ) {
+    void *nbuf;
+    size_t nsize;
+
+    if( need <= *size )
+        return 0;
+    nsize = *size? *size: 4096;
+    while( nsize < need )
+        nsize *= 2;
+    nbuf = realloc( *(void **)bufp, nsize );
+    if( nbuf == NULL )
+        return 1;
+    *(void **)bufp = nbuf;
+    *size = nsize;
+    return 0;
+}
+
+static void *pipeline_worker( void *arg ) {
+    pipeline_T *pl = arg;
+    conv_T *cv = pl->cv;
+    pipeitem_T *item;
+
+    while( (item = pipeq_get( &pl->workq )) != NULL ) {
+        if( item->type == ITEM_RECORD && cv->inplace ) {
+            uint64_t t = stats_now();
+
+            item->outsize = cv->inplace( item->in.data, item->insize, item->in.size );
+            item->out = item->in.data;
+            item->ns[ST_TRANSCODE] = stats_now() - t;
+        } else if( item->type == ITEM_RECORD ) {
+            size_t wc, maxwc, outmax;
+            uint64_t t;
+
+            item->out = item->outbuf;
+            maxwc = (size_t)ceil( (double)item->insize / cv->infpw ) + 1;
+            outmax = (size_t)ceil( (double)maxwc * cv->outfpw ) + 9;
+            if( grow_buffer( &item->outbuf, &item->outbufsize, outmax ) ||
+                (!cv->xcode &&
+                 grow_buffer( &item->tenbuf, &item->tenbufsize, maxwc * sizeof( wd36_T ) )) ) {
+                diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+                exit( 1 );
+            }
+            t = stats_now();
+            if( cv->xcode ) {
+                item->outsize = cv->xcode( item->data, item->insize,
+                                           item->outbuf, item->outbufsize );
+                item->out = item->outbuf;
+                item->ns[ST_TRANSCODE] = stats_now() - t;
+                pipeq_put( &pl->doneq, item );
+                continue;
+            }
+            wc = cv->unpack( item->data, item->insize, item->tenbuf, maxwc );
+            item->ns[ST_UNPACK] = stats_now() - t;
+            if( wc == (size_t)-1 ) {
+                item->outsize = (size_t)-1;
+            } else {
+                t = stats_now();
+                item->outsize = cv->pack( item->tenbuf, wc, item->outbuf, item->outbufsize );
+                item->ns[ST_PACK] = stats_now() - t;
+            }
+        }
+        pipeq_put( &pl->doneq, item );
+    }
+    return NULL;
+}
+
+/* Account for an item's stages when it reaches the writer.
+ * Only the writer updates the stage statistics.
+ */
+
+static void item_stats( pipeline_T *pl, pipeitem_T *item ) {
+    conv_T *cv = pl->cv;
+    size_t size;
+
+    if( item->type == ITEM_END )
+        return;
+
+    stats_stage( cv, ST_READ, item->ns[ST_READ],
+                 (item->type == ITEM_RECORD)? item->insize: 0 );
+    if( item->type == ITEM_RECORD ) {
+        if( cv->xcode ) {
+            stats_stage( cv, ST_TRANSCODE, item->ns[ST_TRANSCODE], item->insize );
+        } else {
+            stats_stage( cv, ST_UNPACK, item->ns[ST_UNPACK], item->insize );
+            if( item->outsize != (size_t)-1 )
+                stats_stage( cv, ST_PACK, item->ns[ST_PACK], item->outsize );
+        }
+    }
+    pl->instats = item->instats;
+
+    size = item->in.size + item->tenbufsize + item->outbufsize;
+    cv->bufbytes += size - item->bufcounted;
+    item->bufcounted = size;
+
+    return;
+}
+
+/* The input at an item's position, for messages */
+
+static void item_where( pipeline_T *pl, pipeitem_T *item, MAGTAPE *pos ) {
+    *pos = pl->where;
+    pos->filenum = item->filenum;
+    pos->blocknum = item->blocknum;
+    pos->reelpos = item->reelpos;
+
+    return;
+}
+
+static void *pipeline_writer( void *arg ) {
+    pipeline_T *pl = arg;
+    conv_T *cv = pl->cv;
+    pipeitem_T **pending, *item;
+    uint64_t next = 0;
+    int done = 0, end = 0;
+
+    pending = calloc( pl->nitems, sizeof( *pending ) );
+    if( pending == NULL ) {
+        diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+
+    while( !end ) {
+        item = pipeq_get( &pl->doneq );
+        if( item == NULL )
+            break;
+        pending[item->seq % pl->nitems] = item;
+
+        while( !end && (item = pending[next % pl->nitems]) != NULL &&
+               item->seq == next ) {
+            pending[next % pl->nitems] = NULL;
+            next++;
+            if( timing )
+                item_stats( pl, item );
+
+            if( !done ) {
+                switch( item->type ) {
+                case ITEM_MARK:
+                    done = write_mark( cv );
+                    break;
+                case ITEM_RECORD:
+                    if( item->outsize == (size_t)-1 ) {
+                        MAGTAPE pos;
+
+                        item_where( pl, item, &pos );
+                        bad_record( cv, &pos, item->insize );
+                        done = 1;
+                        break;
+                    }
+                    done = write_record( cv, item->out, item->outsize, item->haserr );
+                    break;
+                case ITEM_END:
+                    break;
+                default:
+                    abort();
+                }
+            }
+            if( item->type == ITEM_END )
+                end = 1;
+
+            pthread_mutex_lock( &pl->freeq.lock );
+            if( done )
+                pl->stop = pl->rc = 1;
+            pthread_mutex_unlock( &pl->freeq.lock );
+            pipeq_put( &pl->freeq, item );
+        }
+    }
+    free( pending );
+
+    return NULL;
+}
+
+static int convert_pipeline( conv_T *cv ) {
+    pipeline_T pl;
+    pthread_t writer, *workers;
+    pipeitem_T *item;
+    unsigned int status, i;
+    uint32_t bytesread;
+    const uint8_t *record;
+    uint64_t seq = 0, t;
+    size_t unit = pack_unit( cv->infmt );
+    int done = 0, rc = 0;
+
+    memset( &pl, 0, sizeof( pl ) );
+    pl.cv = cv;
+    pl.where = *cv->in;
+    cv->instats = &pl.instats;
+    pl.nitems = 2 * (size_t)cv->threads + 4;
+    pl.items = calloc( pl.nitems, sizeof( *pl.items ) );
+    workers = calloc( cv->threads, sizeof( *workers ) );
+    if( pl.items == NULL || workers == NULL ) {
+        diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+        return 1;
+    }
+    pipeq_init( &pl.freeq );
+    pipeq_init( &pl.workq );
+    pipeq_init( &pl.doneq );
+    for( i = 0; i < pl.nitems; i++ )
+        pipeq_put( &pl.freeq, pl.items + i );
+
+    if( pthread_create( &writer, NULL, pipeline_writer, &pl ) ) {
+        diag( cv->tag, "Create writer thread: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    for( i = 0; i < cv->threads; i++ ) {
+        if( pthread_create( workers + i, NULL, pipeline_worker, &pl ) ) {
+            diag( cv->tag, "Create worker thread: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+    }
+
+    while( !done ) {
+        item = pipeq_get( &pl.freeq );
+        pthread_mutex_lock( &pl.freeq.lock );
+        done = pl.stop;
+        pthread_mutex_unlock( &pl.freeq.lock );
+        if( done ) {
+            pipeq_put( &pl.freeq, item );
+            break;
+        }
+
+        t = stats_now();
+        if( cv->inplace )
+            status = read_inplace( cv, &item->in, &bytesread );
+        else
+            status = magtape_read_view( cv->in, &record, &bytesread );
+        item->ns[ST_READ] = stats_now() - t;
+        switch( status ) {
+        case MTA_OK:
+        case MTA_ERR:
+            item->type = ITEM_RECORD;
+            item->haserr = (status == MTA_ERR);
+            item->insize = bytesread;
+            if( cv->inplace ) {
+                item->data = item->in.data;
+            } else if( cv->in->status & MTS_MAPPED ) {
+                item->data = record;
+            } else {
+                if( buf36_reserve( &item->in, bytesread ) ) {
+                    diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+                    exit( 1 );
+                }
+                memcpy( item->in.data, record, bytesread );
+                item->data = item->in.data;
+            }
+
+            /* The workers will reject this record, ending the conversion
+             * there, so don't read (or report noise) beyond it.
+             */
+
+            done = (bytesread % unit) != 0;
+            break;
+        case MTA_TM:
+        case MTA_EOF:
+            done = end_read( cv->in, status );
+            item->type = ITEM_MARK;
+            break;
+        default:
+            done = end_read( cv->in, status );
+            rc = (status != MTA_EOM);
+            pipeq_put( &pl.freeq, item );
+            continue;
+        }
+        item->seq = seq++;
+        item->filenum = cv->in->filenum;
+        item->blocknum = cv->in->blocknum;
+        item->reelpos = cv->in->reelpos;
+        if( timing )
+            item->instats = cv->in->stats;
+        pipeq_put( &pl.workq, item );
+    }
+
+    item = pipeq_get( &pl.freeq );
+    item->type = ITEM_END;
+    item->seq = seq++;
+    pipeq_put( &pl.workq, item );
+
+    pipeq_close( &pl.workq );
+    for( i = 0; i < cv->threads; i++ )
+        pthread_join( workers[i], NULL );
+    pipeq_close( &pl.doneq );
+    pthread_join( writer, NULL );
+    cv->instats = &cv->in->stats;
+
+    for( i = 0; i < pl.nitems; i++ ) {
+        buf36_free( &pl.items[i].in );
+        free( pl.items[i].tenbuf );
+        free( pl.items[i].outbuf );
+    }
+    free( pl.items );
+    free( workers );
+    pipeq_destroy( &pl.freeq );
+    pipeq_destroy( &pl.workq );
+    pipeq_destroy( &pl.doneq );
+
+    return rc || pl.rc;
+}
+
+/* Partitioned conversion.
+ *
+ * A mapped image is first scanned, reading only its length words, for a
+ * list of its records and tape marks.  A converted record's size follows
+ * from its input size, so the list also gives every item's offset in the
+ * output.  The list is divided into parts of about PART_SIZE input
+ * frames, which threads worker threads take in turn and convert entirely,
+ * reading the mapping and writing the result in place with pwrite.
+ * Nothing passes through a single reader or writer.
+ *
+ * The scan stops where a serial conversion would: at the end of the
+ * image, an error, or a record that's invalid for the input mode.
+ */
+
+#define PART_SIZE  (64 * 1024 * 1024) /* Input frames per part */
+#define PART_CHUNK (4 * 1024 * 1024)  /* Output frames per pwrite */
+
+typedef struct {
+    off_t    in;                /* Offset of the frames, or -1 for a tape mark */
+    uint32_t length;
+    int      haserr;
+} partrec_T;
+
+typedef struct {
+    size_t   first, end;        /* recs[first..end) */
+    off_t    out;               /* Output offset of recs[first] */
+} part_T;
+
+typedef struct {
+    conv_T  *cv;
+    partrec_T *recs;
+    part_T  *parts;
+    size_t  nparts;
+    size_t  next;               /* Next part to convert */
+    int     fd;                 /* Output */
+    int     error;              /* errno of the first failure */
+    pthread_mutex_t lock;
+} partition_T;
+
+/* Frames an item occupies in the output */
+
+static size_t part_outsize( conv_T *cv, const partrec_T *r ) {
+    size_t n;
+
+    if( r->in < 0 )
+        return 4;
+    n = transcode_size( cv->infmt, cv->outfmt, r->length );
+    return 8 + ((n + 1) & ~(size_t)1);
+}
+
+static int part_write( int fd, const uint8_t *data, size_t length, off_t offset ) {
+    while( length ) {
+        ssize_t n = pwrite( fd, data, length, offset );
+
+        if( n < 0 ) {
+            if( errno == EINTR )
+                continue;
+            return -1;
+        }
+        data += n;
+        length -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Convert one part, writing it at its output offset.
+ * Returns 0, or -1 with errno set.
+ */
+
+static int convert_part( partition_T *pt, const part_T *part,
+                         buf36_T *out, buf36_T *ten ) {
+    conv_T *cv = pt->cv;
+    const uint8_t *map = cv->in->map;
+    off_t pos = part->out, start = -1, end = 0;
+    size_t len = 0, i;
+
+    /* The scan advised random access; these frames are read in order */
+
+    for( i = part->first; i < part->end; i++ ) {
+        if( pt->recs[i].in >= 0 ) {
+            if( start < 0 )
+                start = pt->recs[i].in & ~(off_t)(sysconf( _SC_PAGESIZE ) - 1);
+            end = pt->recs[i].in + (off_t)pt->recs[i].length;
+        }
+    }
+    if( start >= 0 && end > start )
+        (void) madvise( (void *)(map + start), (size_t)(end - start), MADV_SEQUENTIAL );
+
+    for( i = part->first; i < part->end; i++ ) {
+        const partrec_T *r = pt->recs + i;
+        size_t need = part_outsize( cv, r ), recsize, outsize;
+        uint32_t word;
+        uint8_t *dst;
+
+        if( len && len + need > PART_CHUNK ) {
+            if( part_write( pt->fd, out->data, len, pos ) != 0 )
+                return -1;
+            pos += (off_t)len;
+            len = 0;
+        }
+        if( buf36_extend( out, len + need + 1, len ) != 0 )
+            return -1;
+        dst = (uint8_t *)out->data + len;
+        len += need;
+        if( r->in < 0 ) {
+            memset( dst, 0, 4 );
+            continue;
+        }
+
+        outsize = need - 8;
+        if( cv->xcode ) {
+            recsize = cv->xcode( map + r->in, r->length, dst + 4, outsize + 1 );
+        } else {
+            size_t maxwc = (size_t)ceil( (double)r->length / cv->infpw ) + 1;
+
+            if( buf36_reserve( ten, maxwc * sizeof( wd36_T ) ) != 0 )
+                return -1;
+            recsize = cv->unpack( map + r->in, r->length, ten->data, maxwc );
+            if( recsize != (size_t)-1 )
+                recsize = cv->pack( ten->data, recsize, dst + 4, outsize + 1 );
+        }
+        if( recsize == (size_t)-1 || ((recsize + 1) & ~(size_t)1) != outsize )
+            abort();            /* The scan checked the size */
+
+        word = (uint32_t)(r->haserr? MTA_DATA_ERROR( recsize ): recsize);
+        dst[0] = dst[outsize + 4] = word & 0xFF;
+        dst[1] = dst[outsize + 5] = (word >> 8) & 0xFF;
+        dst[2] = dst[outsize + 6] = (word >> 16) & 0xFF;
+        dst[3] = dst[outsize + 7] = (word >> 24) & 0xFF;
+        if( recsize & 1 )
+            dst[4 + recsize] = 0;
+    }
+    if( len && part_write( pt->fd, out->data, len, pos ) != 0 )
+        return -1;
+    return 0;
+}
+
+static void *partition_worker( void *arg ) {
+    partition_T *pt = arg;
+    buf36_T out = BUF36_INIT, ten = BUF36_INIT;
+
+    while( 1 ) {
+        part_T *part;
+
+        pthread_mutex_lock( &pt->lock );
+        if( pt->error || pt->next == pt->nparts ) {
+            pthread_mutex_unlock( &pt->lock );
+            break;
+        }
+        part = pt->parts + pt->next++;
+        pthread_mutex_unlock( &pt->lock );
+
+        if( convert_part( pt, part, &out, &ten ) != 0 ) {
+            pthread_mutex_lock( &pt->lock );
+            if( !pt->error )
+                pt->error = errno;
+            pthread_mutex_unlock( &pt->lock );
+        }
+    }
+    buf36_free( &ten );
+    buf36_free( &out );
+    return NULL;
+}
+
+static int convert_partition( conv_T *cv ) {
+    partition_T pt;
+    pthread_t *workers;
+    mta_stats counts;
+    size_t nrecs = 0, recbytes = 0, partbytes = 0, unit, i;
+    uint32_t recsize, blocknum = 0;
+    uint64_t inframes = 0, partframes = 0;
+    off_t total = 0, outpos;
+    unsigned int status, w;
+    int done = 0, rc = 0;
+
+    memset( &pt, 0, sizeof( pt ) );
+    memset( &counts, 0, sizeof( counts ) );
+    pt.cv = cv;
+    unit = pack_unit( cv->infmt );
+
+    /* Scan, dividing the records into parts as they are found.  Noise
+     * records are reported as a serial conversion would.
+     */
+
+    cv->in->status |= MTS_NOISY;
+    stage_start( cv );
+    while( !done ) {
+        partrec_T *r;
+
+        status = magtape_skip_record( cv->in, &recsize );
+        switch( status ) {
+        case MTA_OK:
+        case MTA_ERR:
+            if( recsize % unit ) {
+                bad_record( cv, cv->in, recsize );
+                done = rc = 1;
+                continue;
+            }
+            break;
+        case MTA_TM:
+        case MTA_EOF:
+            done = end_read( cv->in, status );
+            break;
+        default:
+            done = end_read( cv->in, status );
+            rc = (status != MTA_EOM);
+            continue;
+        }
+
+        if( grow_buffer( &pt.recs, &recbytes, (nrecs + 1) * sizeof( *pt.recs ) ) ||
+            grow_buffer( &pt.parts, &partbytes, (pt.nparts + 1) * sizeof( *pt.parts ) ) ) {
+            diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+        if( pt.nparts == 0 || partframes >= PART_SIZE ) {
+            if( pt.nparts )
+                pt.parts[pt.nparts - 1].end = nrecs;
+            pt.parts[pt.nparts].first = nrecs;
+            pt.parts[pt.nparts].out = total;
+            pt.nparts++;
+            partframes = 0;
+        }
+
+        r = pt.recs + nrecs++;
+        if( status == MTA_TM || status == MTA_EOF ) {
+            r->in = -1;
+            r->length = 0;
+            r->haserr = 0;
+            counts.marks++;
+            blocknum = 0;
+        } else {
+            size_t n = transcode_size( cv->infmt, cv->outfmt, recsize ), b;
+
+            r->in = cv->in->laststart + 4;
+            r->length = recsize;
+            r->haserr = (status == MTA_ERR);
+            counts.records++;
+            counts.errors += (uint64_t)r->haserr;
+            counts.frames += n;
+            for( b = 0; b < MTA_SIZE_BUCKETS -1 && (n >> b) != 0; b++ )
+                ;
+            counts.sizes[b]++;
+            blocknum++;
+            inframes += recsize;
+            partframes += recsize;
+        }
+        total += (off_t)part_outsize( cv, r );
+    }
+    if( pt.nparts )
+        pt.parts[pt.nparts - 1].end = nrecs;
+    stage_end( cv, ST_READ, 0 );
+    cv->in->status &= ~MTS_NOISY;
+
+    if( verbose )
+        diag( cv->tag, "Converting %zu records and tape marks in %zu parts\n",
+                 nrecs, pt.nparts );
+
+    status = magtape_reserve( cv->out, total, &counts, blocknum, &pt.fd, &outpos );
+    if( status != MTA_OK ) {
+        diag_at( cv->out, "Error writing tape file: %s at ", strerror( errno ) );
+        free( pt.recs );
+        free( pt.parts );
+        return 1;
+    }
+    for( i = 0; i < pt.nparts; i++ )
+        pt.parts[i].out += outpos;
+
+    workers = calloc( cv->threads, sizeof( *workers ) );
+    if( workers == NULL ) {
+        diag( cv->tag, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    pthread_mutex_init( &pt.lock, NULL );
+    stage_start( cv );
+    for( w = 0; w < cv->threads; w++ ) {
+        if( pthread_create( workers + w, NULL, partition_worker, &pt ) ) {
+            diag( cv->tag, "Create worker thread: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+    }
+    for( w = 0; w < cv->threads; w++ )
+        pthread_join( workers[w], NULL );
+    stage_end( cv, ST_TRANSCODE, inframes );
+    pthread_mutex_destroy( &pt.lock );
+
+    if( pt.error ) {
+        diag_at( cv->out, "Error writing tape file: %s at ", strerror( pt.error ) );
+        rc = 1;
+    }
+
+    free( workers );
+    free( pt.recs );
+    free( pt.parts );
+    return rc;
+}
+
+/* Batch conversion.
+ *
+ * Converts many tapes, each a job, on jobs worker threads; each job uses
+ * the serial conversion (or copy).  Jobs are dealt, largest input first,
+ * to a deque per worker.  A worker takes its own jobs from the front -
+ * largest first - and when it has none left, steals from the back of
+ * another's, so small tapes are picked up by idle workers rather than
+ * waiting behind large ones.  Each worker's buffers are reused for all
+ * its jobs.
+ *
+ * A line is written to stdout as each job ends:
+ *   job<TAB>exit status<TAB>seconds<TAB>infile<TAB>outfile
+ * A job's diagnostics are prefixed with "job n: ".
+ * The exit status is 0 if every job succeeded, otherwise 1.
+ */
+
+typedef struct {
+    unsigned int number;        /* Position in the manifest, from 1 */
+    char *infile, *outfile;
+    tapemode_T inmode, outmode;
+    off_t size;
+    int rc;
+} batchjob_T;
+
+typedef struct {
+    batchjob_T **jobs;
+    size_t head, tail;          /* Unclaimed jobs are jobs[head..tail) */
+    pthread_mutex_t lock;
+} jobdeque_T;
+
+typedef struct {
+    jobdeque_T *deques;
+    unsigned int nworkers;
+    const char *density, *reelsize;
+    pthread_mutex_t outlock;
+} batch_T;
+
+typedef struct {
+    batch_T *batch;
+    unsigned int id;
+} batchworker_T;
+
+static batchjob_T *next_job( batch_T *b, unsigned int id ) {
+    batchjob_T *job = NULL;
+    unsigned int i;
+
+    for( i = 0; i < b->nworkers && job == NULL; i++ ) {
+        jobdeque_T *dq = b->deques + (id + i) % b->nworkers;
+
+        pthread_mutex_lock( &dq->lock );
+        if( dq->head < dq->tail ) {
+            if( i == 0 )
+                job = dq->jobs[dq->head++];
+            else
+                job = dq->jobs[--dq->tail];
+        }
+        pthread_mutex_unlock( &dq->lock );
+    }
+    return job;
+}
+
+static void *batch_worker( void *arg ) {
+    batchworker_T *w = arg;
+    batch_T *b = w->batch;
+    batchjob_T *job;
+    convbuf_T buf;
+
+    memset( &buf, 0, sizeof( buf ) );
+
+    while( (job = next_job( b, w->id )) != NULL ) {
+        struct timespec start, end;
+        char tag[32];
+
+        snprintf( tag, sizeof( tag ), "job %u: ", job->number );
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        job->rc = convert( job->infile, job->inmode, job->outfile, job->outmode,
+                           b->density, b->reelsize, 1, &buf, tag );
+        clock_gettime( CLOCK_MONOTONIC, &end );
+
+        pthread_mutex_lock( &b->outlock );
+        printf( "%u\t%d\t%.3f\t%s\t%s\n", job->number, job->rc,
+                (double)(end.tv_sec - start.tv_sec) +
+                (double)(end.tv_nsec - start.tv_nsec) / 1e9,
+                job->infile, job->outfile );
+        fflush( stdout );
+        pthread_mutex_unlock( &b->outlock );
+    }
+    buf36_free( &buf.ten );
+    buf36_free( &buf.tape );
+
+    return NULL;
+}
+
+static int compare_jobsize( const void *a, const void *b ) {
+    const batchjob_T *ja = *(batchjob_T *const *)a, *jb = *(batchjob_T *const *)b;
+
+    if( ja->size != jb->size )
+        return (ja->size > jb->size)? -1: 1;
+    return (ja->number > jb->number) - (ja->number < jb->number);
+}
+
+/* Add a job to the list, from line lineno of listfile if it isn't NULL.
+ * Returns 1 if it's invalid.
+ */
+
+static int add_job( batchjob_T **list, size_t *njobs, size_t *listsize,
+                    const char *infile, const char *outfile,
+                    tapemode_T inmode, tapemode_T outmode,
+                    const char *listfile, unsigned int lineno ) {
+    batchjob_T *job;
+    struct stat st;
+    const char *why = NULL;
+
+    if( !strcmp( infile, "-" ) || !strcmp( outfile, "-" ) )
+        why = "batch jobs can't use stdin or stdout";
+    else if( outmode == AUTO_MODE )
+        why = "auto is only valid as an input mode";
+    if( why ) {
+        if( listfile )
+            fprintf( stderr, "%s line %u: %s\n", listfile, lineno, why );
+        else
+            fprintf( stderr, "%s %s: %s\n", infile, outfile, why );
+        return 1;
+    }
+    if( (*njobs + 1) * sizeof( **list ) > *listsize &&
+        grow_buffer( list, listsize, 2 * *listsize + 64 * sizeof( **list ) ) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    job = *list + *njobs;
+    memset( job, 0, sizeof( *job ) );
+    job->number = (unsigned int)++*njobs;
+    job->infile = strdup( infile );
+    job->outfile = strdup( outfile );
+    if( job->infile == NULL || job->outfile == NULL ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    job->inmode = inmode;
+    job->outmode = outmode;
+    if( stat( infile, &st ) == 0 )
+        job->size = st.st_size;
+
+    return 0;
+}
+
+static int batch( const char *listfile, char **pairs, int npairs,
+                  tapemode_T inmode, tapemode_T outmode,
+                  const char *density, const char *reelsize ) {
+    batch_T b;
+    batchjob_T *list = NULL, **order;
+    batchworker_T *workers;
+    pthread_t *threads;
+    size_t njobs = 0, listsize = 0, i;
+    unsigned int failed = 0, w;
+    int bad = 0;
+
+    if( listfile ) {
+        FILE *fp;
+        char line[4096];
+        unsigned int lineno = 0;
+
+        fp = strcmp( listfile, "-" )? fopen( listfile, "r" ): stdin;
+        if( fp == NULL ) {
+            fprintf( stderr, "%s: %s\n", listfile, strerror( errno ) );
+            return 1;
+        }
+
+        /* infile outfile [inmode [outmode]]; # starts a comment */
+
+        while( fgets( line, sizeof( line ), fp ) ) {
+            char *field[5], *p;
+            int n = 0, jin, jout;
+
+            lineno++;
+            if( (p = strchr( line, '#' )) != NULL )
+                *p = '\0';
+            for( p = strtok( line, " \t\r\n" ); p && n < 5; p = strtok( NULL, " \t\r\n" ) )
+                field[n++] = p;
+            if( n == 0 )
+                continue;
+            if( n < 2 || n > 4 ) {
+                fprintf( stderr, "%s line %u: expected infile outfile [inmode [outmode]]\n",
+                         listfile, lineno );
+                bad = 1;
+                continue;
+            }
+            jin = (n > 2)? find_mode( field[2] ): (int)inmode;
+            jout = (n > 3)? find_mode( field[3] ): (int)outmode;
+            if( jin < 0 || jout < 0 ) {
+                fprintf( stderr, "%s line %u: unknown tape format %s\n",
+                         listfile, lineno, (jin < 0)? field[2]: field[3] );
+                bad = 1;
+                continue;
+            }
+            bad |= add_job( &list, &njobs, &listsize, field[0], field[1],
+                            (tapemode_T)jin, (tapemode_T)jout, listfile, lineno );
+        }
+        if( ferror( fp ) ) {
+            fprintf( stderr, "%s: %s\n", listfile, strerror( errno ) );
+            bad = 1;
+        }
+        if( fp != stdin )
+            fclose( fp );
+    } else {
+        for( i = 0; i + 1 < (size_t)npairs; i += 2 )
+            bad |= add_job( &list, &njobs, &listsize, pairs[i], pairs[i+1],
+                            inmode, outmode, NULL, 0 );
+    }
+    if( bad || njobs == 0 ) {
+        free( list );
+        return bad;
+    }
+
+    memset( &b, 0, sizeof( b ) );
+    b.nworkers = (jobs > njobs)? (unsigned int)njobs: jobs;
+    b.density = density;
+    b.reelsize = reelsize;
+
+    order = malloc( njobs * sizeof( *order ) );
+    b.deques = calloc( b.nworkers, sizeof( *b.deques ) );
+    workers = calloc( b.nworkers, sizeof( *workers ) );
+    threads = calloc( b.nworkers, sizeof( *threads ) );
+    if( !(order && b.deques && workers && threads) ) {
+        fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+        exit( 1 );
+    }
+    for( i = 0; i < njobs; i++ )
+        order[i] = list + i;
+    qsort( order, njobs, sizeof( *order ), compare_jobsize );
+
+    /* Deal the sorted jobs round-robin: worker w gets those at w,
+     * w + nworkers, ..., in a contiguous slice of order.
+     */
+
+    {
+        batchjob_T **dealt;
+        size_t at = 0;
+
+        dealt = malloc( njobs * sizeof( *dealt ) );
+        if( dealt == NULL ) {
+            fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+        for( w = 0; w < b.nworkers; w++ ) {
+            jobdeque_T *dq = b.deques + w;
+
+            dq->jobs = order + at;
+            for( i = w; i < njobs; i += b.nworkers )
+                dealt[at++] = order[i];
+            dq->tail = (size_t)(order + at - dq->jobs);
+            pthread_mutex_init( &dq->lock, NULL );
+        }
+        memcpy( order, dealt, njobs * sizeof( *order ) );
+        free( dealt );
+    }
+
+    pthread_mutex_init( &b.outlock, NULL );
+    for( w = 0; w < b.nworkers; w++ ) {
+        workers[w].batch = &b;
+        workers[w].id = w;
+        if( pthread_create( threads + w, NULL, batch_worker, workers + w ) ) {
+            fprintf( stderr, "Create worker thread: %s\n", strerror( errno ) );
+            exit( 1 );
+        }
+    }
+    for( w = 0; w < b.nworkers; w++ )
+        pthread_join( threads[w], NULL );
+
+    for( i = 0; i < njobs; i++ ) {
+        if( list[i].rc )
+            failed++;
+        free( list[i].infile );
+        free( list[i].outfile );
+    }
+    if( verbose || failed )
+        fprintf( stderr, "%zu jobs, %u failed\n", njobs, failed );
+
+    for( w = 0; w < b.nworkers; w++ )
+        pthread_mutex_destroy( &b.deques[w].lock );
+    pthread_mutex_destroy( &b.outlock );
+    free( threads );
+    free( workers );
+    free( b.deques );
+    free( order );
+    free( list );
+
+    return failed != 0;
+}
+
+/* Statistics.
+ *
+ * With --stats, the time spent in each stage of the conversion and the
+ * frames it handled are accumulated, and written with the tapes' counters
+ * as a JSON object when the conversion ends, or when SIGUSR1 is received.
+ * The file is replaced, not appended to, so a reader never sees a partial
+ * report.  "-" writes to stderr.
+ */
+
+static const char *const stagenames[ST_NSTAGES] = {
+    "read", "unpack", "pack", "transcode", "write"
+};
+
+/* Monotonic time in ns, or 0 if stages aren't timed */
+
+static uint64_t stats_now( void ) {
+    struct timespec ts;
+
+    if( !timing )
+        return 0;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+static void stats_stage( conv_T *cv, stage_T stage, uint64_t ns, uint64_t frames ) {
+    if( !timing )
+        return;
+    cv->stage[stage].ns += ns;
+    cv->stage[stage].frames += frames;
+    cv->stage[stage].calls++;
+
+    return;
+}
+
+/* Time a stage run by the calling thread, and count its events if
+ * profiling.  The counters are read inside the clock readings.
+ */
+
+static void stage_start( conv_T *cv ) {
+    if( !timing )
+        return;
+    cv->stagestart = stats_now();
+    if( cv->perf.nopen )
+        (void) perf36_read( &cv->perf, cv->eventstart );
+
+    return;
+}
+
+static void stage_end( conv_T *cv, stage_T stage, uint64_t frames ) {
+    uint64_t events[PERF36_NEVENTS];
+    unsigned int i;
+
+    if( !timing )
+        return;
+    if( cv->perf.nopen && perf36_read( &cv->perf, events ) == 0 ) {
+        for( i = 0; i < PERF36_NEVENTS; i++ )
+            cv->stage[stage].events[i] += events[i] - cv->eventstart[i];
+    }
+    stats_stage( cv, stage, stats_now() - cv->stagestart, frames );
+
+    return;
+}
+
+static void stats_signal( int sig ) {
+    (void) sig;
+
+    statsrequest = 1;
+}
+
+/* Write a report if one was requested */
+
+static void stats_poll( conv_T *cv ) {
+    if( !statsrequest )
+        return;
+    statsrequest = 0;
+    stats_write( cv, "running" );
+
+    return;
+}
+
+static void json_string( FILE *fp, const char *str ) {
+    const unsigned char *p;
+
+    fputc( '"', fp );
+    for( p = (const unsigned char *)str; *p; p++ ) {
+        if( *p == '"' || *p == '\\' )
+            fprintf( fp, "\\%c", *p );
+        else if( *p < 0x20 )
+            fprintf( fp, "\\u%04x", *p );
+        else
+            fputc( *p, fp );
+    }
+    fputc( '"', fp );
+
+    return;
+}
+
+static void json_tape( FILE *fp, const char *what, MAGTAPE *mta, tapemode_T mode,
+                       const mta_stats *st ) {
+    unsigned int b;
+    int first = 1;
+
+    fprintf( fp, "  \"%s\": {\n    \"file\": ", what );
+    json_string( fp, mta->filename );
+    fprintf( fp, ",\n    \"mode\": \"%s\",\n", modename( mode ) );
+    fprintf( fp, "    \"records\": %" PRIu64 ",\n", st->records );
+    fprintf( fp, "    \"errors\": %" PRIu64 ",\n", st->errors );
+    fprintf( fp, "    \"noise\": %" PRIu64 ",\n", st->noise );
+    fprintf( fp, "    \"marks\": %" PRIu64 ",\n", st->marks );
+    fprintf( fp, "    \"frames\": %" PRIu64 ",\n", st->frames );
+    fprintf( fp, "    \"writes\": %" PRIu64 ",\n", st->writes );
+    fprintf( fp, "    \"written\": %" PRIu64 ",\n", st->written );
+    fprintf( fp, "    \"write_seconds\": %.6f,\n", (double)st->writens / 1e9 );
+    fprintf( fp, "    \"peak_buffer\": %zu,\n", st->peakbuf );
+    fprintf( fp, "    \"sizes\": [" );
+    for( b = 0; b < MTA_SIZE_BUCKETS; b++ ) {
+        if( st->sizes[b] == 0 )
+            continue;
+        fprintf( fp, "%s\n      { \"min\": %" PRIu32 ", \"max\": %" PRIu32
+                 ", \"records\": %" PRIu64 " }", (first? "": ","),
+                 (b? (uint32_t)1 << (b-1): 0), ((uint32_t)1 << b) -1, st->sizes[b] );
+        first = 0;
+    }
+    fprintf( fp, "%s]\n  }", (first? "": "\n    ") );
+
+    return;
+}
+
+static void stats_write( conv_T *cv, const char *state ) {
+    FILE *fp;
+    char *tmpname = NULL;
+    unsigned int i;
+
+    if( !strcmp( statsfile, "-" ) ) {
+        fp = stderr;
+    } else {
+        tmpname = malloc( strlen( statsfile ) + sizeof( ".tmp" ) );
+        if( tmpname == NULL ) {
+            fprintf( stderr, "Allocate buffer: %s\n", strerror( errno ) );
+            return;
+        }
+        sprintf( tmpname, "%s.tmp", statsfile );
+        fp = fopen( tmpname, "w" );
+        if( fp == NULL ) {
+            fprintf( stderr, "%s: %s\n", tmpname, strerror( errno ) );
+            free( tmpname );
+            return;
+        }
+    }
+
+    fprintf( fp, "{\n" );
+    fprintf( fp, "  \"state\": \"%s\",\n", state );
+    fprintf( fp, "  \"elapsed\": %.6f,\n", (double)(stats_now() - statsstart) / 1e9 );
+    fprintf( fp, "  \"method\": \"%s\",\n", cv->method );
+    fprintf( fp, "  \"inplace\": %s,\n", cv->inplace? "true": "false" );
+    fprintf( fp, "  \"threads\": %u,\n", (cv->copy? 1: cv->threads) );
+    fprintf( fp, "  \"vector\": \"%s\",\n", simd36_levelname( simd36_level() ) );
+    fprintf( fp, "  \"buffers\": %zu,\n", cv->bufbytes );
+    fprintf( fp, "  \"stages\": {\n" );
+    for( i = 0; i < ST_NSTAGES; i++ ) {
+        int e;
+
+        fprintf( fp, "    \"%s\": { \"seconds\": %.6f, \"frames\": %" PRIu64
+                 ", \"calls\": %" PRIu64, stagenames[i],
+                 (double)cv->stage[i].ns / 1e9, cv->stage[i].frames,
+                 cv->stage[i].calls );
+        for( e = 0; e < PERF36_NEVENTS; e++ ) {
+            if( cv->perf.nopen && cv->perf.fd[e] >= 0 )
+                fprintf( fp, ", \"%s\": %" PRIu64, perf36_name( (perf36_event_T)e ),
+                         cv->stage[i].events[e] );
+        }
+        fprintf( fp, " }%s\n", (i +1 < ST_NSTAGES? ",": "") );
+    }
+    fprintf( fp, "  },\n" );
+    json_tape( fp, "input", cv->in, cv->inmode, cv->instats );
+    fprintf( fp, ",\n" );
+    json_tape( fp, "output", cv->out, cv->outmode, &cv->out->stats );
+    fprintf( fp, "\n}\n" );
+
+    if( tmpname ) {
+        if( fclose( fp ) != 0 || rename( tmpname, statsfile ) != 0 ) {
+            fprintf( stderr, "%s: %s\n", statsfile, strerror( errno ) );
+            (void) remove( tmpname );
+        }
+        free( tmpname );
+    } else {
+        fflush( fp );
+    }
+    return;
+}
+
+/* Print the profile: each stage's time and events per frame.
+ * Events that couldn't be counted are shown as -.
+ */
+
+static void profile_field( conv_T *cv, perf36_event_T event, double value,
+                           int width, int prec ) {
+    if( cv->perf.nopen && cv->perf.fd[event] >= 0 )
+        fprintf( stderr, " %*.*f", width, prec, value );
+    else
+        fprintf( stderr, " %*s", width, "-" );
+
+    return;
+}
+
+static void profile_report( conv_T *cv ) {
+    unsigned int i;
+
+    fprintf( stderr, "Profile of %s to %s, %s conversion%s\n", modename( cv->inmode ),
+             modename( cv->outmode ), cv->method,
+             (cv->perf.nopen && cv->perf.useronly)? ", user mode only": "" );
+    fprintf( stderr, "  %-10s %8s %12s %10s %9s %9s %6s %9s %9s %8s\n", "stage", "calls",
+             "frames", "seconds", "ns/frame", "cyc/frame", "IPC", "cmiss/Kf",
+             "bmiss/Kf", "faults" );
+    if( cv->perf.nopen && cv->perf.nopen < PERF36_NEVENTS )
+        fprintf( stderr, "  (- : not counted, %s)\n", strerror( cv->perf.error ) );
+
+    for( i = 0; i < ST_NSTAGES; i++ ) {
+        const stagestat_T *st = cv->stage + i;
+        double frames = st->frames? (double)st->frames: 1.0;
+        const uint64_t *ev = st->events;
+
+        if( !st->calls )
+            continue;
+        fprintf( stderr, "  %-10s %8" PRIu64 " %12" PRIu64 " %10.6f %9.3f", stagenames[i],
+                 st->calls, st->frames, (double)st->ns / 1e9, (double)st->ns / frames );
+        profile_field( cv, PERF36_CYCLES, (double)ev[PERF36_CYCLES] / frames, 9, 3 );
+        if( cv->perf.nopen && cv->perf.fd[PERF36_CYCLES] >= 0 &&
+            ev[PERF36_CYCLES] != 0 )
+            profile_field( cv, PERF36_INSTRUCTIONS, (double)ev[PERF36_INSTRUCTIONS] /
+                           (double)ev[PERF36_CYCLES], 6, 2 );
+        else
+            fprintf( stderr, " %6s", "-" );
+        profile_field( cv, PERF36_CACHE_MISSES, 1000.0 * (double)ev[PERF36_CACHE_MISSES] / frames, 9, 3 );
+        profile_field( cv, PERF36_BRANCH_MISSES, 1000.0 * (double)ev[PERF36_BRANCH_MISSES] / frames, 9, 3 );
+        profile_field( cv, PERF36_PAGE_FAULTS, (double)ev[PERF36_PAGE_FAULTS], 8, 0 );
+        fprintf( stderr, "\n" );
+    }
+    return;
+}
+
+/* Input mode detection, for -i auto.
+ *
+ * The first DETECT_RECORDS data records are read from a separate open
+ * of the input, and each is scored for every candidate mode in the same
+ * pass.  A score is in bits of evidence for the mode, against frames
+ * that follow no mode in particular:
+ *  - A record that isn't a whole number of units can't be in the mode,
+ *    which is dropped.  One that is gains log2 of the unit size.
+ *  - Packing leaves some frame bits zero (layout36_putmask).  Each unit
+ *    where they are gains their number; each where they aren't loses
+ *    DETECT_DIRTY.  All-zero units are no evidence, and are skipped.
+ *  - A plausible BACKUP or DUMPER record header gains DETECT_HEADER.
+ *  - Each word with a left half of 0 or -1, but not all 0 or all 1s
+ *    (as counts, addresses and small numbers have), gains 1.
+ * At most DETECT_UNITS units of a record are examined.  The confidence
+ * is the probability of the best mode given the scores of the modes left.
+ * If no mode is left, or the best has no evidence for it (a score that
+ * isn't positive), nothing is chosen and -i must be given.
+ */
+
+#define DETECT_RECORDS 32
+#define DETECT_UNITS   1024
+#define DETECT_DIRTY   10.0
+#define DETECT_HEADER  64.0
+
+#define BACKUP_WORDS   544      /* 32 header words and a 512 word block */
+#define DUMPER_WORDS   518      /* 6 header words and a page */
+
+typedef struct {
+    struct tapemode *mp;
+    size_t frames;              /* Per unit */
+    unsigned int zerobits;      /* Bits packing leaves zero, per unit */
+    uint8_t zero[LAYOUT36_MAXFRAMES];
+    double score;
+    int dropped;                /* A record's length rules the mode out */
+} candidate_T;
+
+/* sixbit-7 and sixbit-9 are the same frames */
+
+static const tapemode_T detectmodes[] = {
+    CORE_DUMP, SIXBIT9, HIGH_DENSITY, INDUSTRY, ANSI_ASCII
+};
+#define NDETECT (sizeof( detectmodes ) / sizeof( detectmodes[0] ))
+
+/* TOPS-10 BACKUP: G$TYPE is T$LBL through T$CON, G$RTNM a reel number,
+ * and G$SIZ and G$LND are within the record.
+ */
+
+static int backup_header( const wd36_T *w, size_t wc, size_t recwc ) {
+    return recwc == BACKUP_WORDS && wc >= 7 &&
+        w[0].lh == 0 && w[0].rh >= 1 && w[0].rh <= 8 &&
+        w[2].lh == 0 && w[2].rh < 01000 &&
+        w[5].lh == 0 && w[5].rh <= 512 &&
+        w[6].lh == 0 && w[6].rh <= 512;
+}
+
+/* TOPS-20 DUMPER: the record type is data (0) or -1 through -7, the
+ * saveset and tape numbers are small, and the sequence number is positive.
+ */
+
+static int dumper_header( const wd36_T *w, size_t wc, size_t recwc ) {
+    return recwc == DUMPER_WORDS && wc >= 6 &&
+        (ISE36( &w[4] ) || (w[4].lh == BITS18 && w[4].rh >= BITS18 - 6)) &&
+        w[2].lh < 01000 && w[2].rh < 01000 &&
+        w[5].lh == 0 && w[5].rh != 0;
+}
+
+static void detect_record( candidate_T *cp, const uint8_t *rec, uint32_t len, wd36_T *words ) {
+    size_t units, u, i, wc, w;
+
+    if( cp->dropped )
+        return;
+    if( len % cp->frames ) {
+        cp->dropped = 1;
+        return;
+    }
+    cp->score += log2( (double)cp->frames );
+
+    units = len / cp->frames;
+    if( units > DETECT_UNITS )
+        units = DETECT_UNITS;
+
+    if( cp->zerobits ) {
+        for( u = 0; u < units; u++ ) {
+            const uint8_t *p = rec + u * cp->frames;
+            uint8_t any = 0, dirty = 0;
+
+            for( i = 0; i < cp->frames; i++ ) {
+                any |= p[i];
+                dirty |= p[i] & cp->zero[i];
+            }
+            if( any )
+                cp->score += dirty? -DETECT_DIRTY: (double)cp->zerobits;
+        }
+    }
+
+    wc = cp->mp->unpack( rec, units * cp->frames, words, 2 * DETECT_UNITS );
+    if( wc == (size_t)-1 )
+        return;
+    for( w = 0; w < wc; w++ ) {
+        if( (words[w].lh == 0 && words[w].rh != 0) ||
+            (words[w].lh == BITS18 && words[w].rh != BITS18) )
+            cp->score += 1.0;
+    }
+    if( backup_header( words, wc, (size_t)(len / cp->mp->fpw) ) ||
+        dumper_header( words, wc, (size_t)(len / cp->mp->fpw) ) )
+        cp->score += DETECT_HEADER;
+
+    return;
+}
+
+/* Detect the mode of infile, which must be a file that can be opened
+ * again for the conversion.  Returns 0, or 1 if it can't be read or
+ * no mode fits the sample.
+ */
+
+static int detect_mode( const char *infile, tapemode_T *mode, const char *tag ) {
+    candidate_T cand[NDETECT], *best, *next;
+    struct stat st;
+    MAGTAPE *in;
+    wd36_T *words;
+    unsigned int records = 0, status;
+    size_t c, i;
+    double sum;
+    int done = 0;
+
+    if( !strcmp( infile, "-" ) ||
+        (stat( infile, &st ) == 0 && S_ISFIFO( st.st_mode )) ) {
+        diag( tag, "%s: -i auto can't sample a pipe; specify the input mode\n", infile );
+        return 1;
+    }
+
+    for( c = 0; c < NDETECT; c++ ) {
+        uint8_t mask[LAYOUT36_MAXFRAMES];
+        struct tapemode *mp;
+
+        for( mp = tapemodes; mp->mode != detectmodes[c]; mp++ )
+            ;
+        cand[c].mp = mp;
+        cand[c].frames = layout36_putmask( mp->format, mask );
+        cand[c].zerobits = 0;
+        for( i = 0; i < cand[c].frames; i++ ) {
+            uint8_t z;
+
+            cand[c].zero[i] = (uint8_t)~mask[i];
+            for( z = cand[c].zero[i]; z; z &= (uint8_t)(z - 1) )
+                cand[c].zerobits++;
+        }
+        cand[c].score = 0.0;
+        cand[c].dropped = 0;
+    }
+
+    words = malloc( 2 * DETECT_UNITS * sizeof( *words ) );
+    if( words == NULL ) {
+        diag( tag, "Allocate buffer: %s\n", strerror( errno ) );
+        return 1;
+    }
+    in = magtape_open( infile, "r" );
+    if( !in ) {
+        diag( tag, "%s: %s\n", infile, strerror( errno ) );
+        free( words );
+        return 1;
+    }
+
+    while( !done && records < DETECT_RECORDS ) {
+        const uint8_t *rec;
+        uint32_t len;
+
+        status = magtape_read_view( in, &rec, &len );
+        switch( status ) {
+        case MTA_OK:
+            if( len == 0 )
+                break;
+            for( c = 0; c < NDETECT; c++ )
+                detect_record( &cand[c], rec, len, words );
+            records++;
+            break;
+        case MTA_TM:
+        case MTA_ERR:
+            break;
+        default:
+            done = 1;
+            break;
+        }
+    }
+    magtape_close( &in );
+    free( words );
+
+    if( records == 0 ) {
+        diag( tag, "%s: no records to sample, assuming %s mode\n",
+                 infile, modename( CORE_DUMP ) );
+        *mode = CORE_DUMP;
+        return 0;
+    }
+    if( verbose ) {
+        for( c = 0; c < NDETECT; c++ ) {
+            if( cand[c].dropped )
+                diag( tag, "    %-15s ruled out by a record length\n", cand[c].mp->name );
+            else
+                diag( tag, "    %-15s score %.1f\n", cand[c].mp->name, cand[c].score );
+        }
+    }
+
+    best = next = NULL;
+    for( c = 0; c < NDETECT; c++ ) {
+        if( cand[c].dropped )
+            continue;
+        if( !best || cand[c].score > best->score ) {
+            next = best;
+            best = &cand[c];
+        } else if( !next || cand[c].score > next->score ) {
+            next = &cand[c];
+        }
+    }
+    if( !best ) {
+        diag( tag, "%s: the record lengths fit no input mode; specify it with -i\n",
+                 infile );
+        return 1;
+    }
+    if( best->score <= 0.0 ) {
+        diag( tag, "%s: no input mode fits the records sampled (best %s, score %.1f); "
+                 "specify it with -i\n", infile, best->mp->name, best->score );
+        return 1;
+    }
+    sum = 0.0;
+    for( c = 0; c < NDETECT; c++ ) {
+        if( !cand[c].dropped )
+            sum += exp2( cand[c].score - best->score );
+    }
+
+    diag( tag, "%s: detected %s mode, confidence %.1f%% (%u record%s sampled; next %s)\n",
+             infile, best->mp->name, 100.0 / sum, records, (records == 1? "": "s"),
+             (next? next->mp->name: "none") );
+    *mode = best->mp->mode;
+
+    return 0;
+}
+
+/* Replace the scalar packing functions with the best this CPU can run.
+ */
+
+static void select_kernels( void ) {
+    struct tapemode *mp;
+
+    for( mp = tapemodes; mp->name; mp++ ) {
+        mp->pack = simd36_pack( mp->pack );
+        mp->unpack = simd36_unpack( mp->unpack );
+    }
+    if( verbose )
+        fprintf( stderr, "Vector support: %s\n", simd36_levelname( simd36_level() ) );
+
+    return;
+}
+
+/* Look up a mode by name.  Returns -1 if there's none.
+ */
+
+static int find_mode( const char *name ) {
+    struct tapemode *p;
+
+    if( !strcasecmp( name, "auto" ) )
+        return AUTO_MODE;
+    for( p = tapemodes; p->name; p++ ) {
+        if( !strcasecmp( name, p->name ) ) {
+            return p->mode;
+        }
+    }
+    return -1;
+}
+
+static tapemode_T tapemode( const char *name ) {
+    struct tapemode *p;
+    int mode;
+
+    if( name != NULL && (mode = find_mode( name )) >= 0 )
+        return (tapemode_T)mode;
     fprintf( stderr, "Valid tape formats are:\n" );
     for( p = tapemodes; p->name; p++ ) {
         fprintf( stderr, "    %-15s %s\n", p->name, p->help );
     }
+    fprintf( stderr, "    %-15s %s\n", "auto", "Input only: detected from the first records" );
     if( name )
         exit( 1 );
 
@@ -356,6 +2502,8 @@ static tapemode_T tapemode( const char *name ) {
 static const char *modename( const tapemode_T mode ) {
     struct tapemode *p;
 
+    if( mode == AUTO_MODE )
+        return "auto";
     for( p = tapemodes; p->name; p++ ) {
         if( p->mode == mode )
             return p->name;
@@ -365,16 +2513,34 @@ static const char *modename( const tapemode_T mode ) {
 
 static void usage( void ) {
 
-    fprintf( stderr, "tape36 [-i mode] [-o mode] [-d dens] [-r len] [-v] [-h] [infile [outfile]]\n" );
+    fprintf( stderr, "tape36 [-i mode] [-o mode] [-d dens] [-r len] [-j n] [-n] [-v] [-h] [--stats=file] [--profile]\n" );
+    fprintf( stderr, "       [--hugepages=policy] [--io=method] [--partition] [infile [outfile]]\n" );
+    fprintf( stderr, "tape36 --scan [-d dens] [-r len] [-v] [infile]\n" );
+    fprintf( stderr, "tape36 --batch[=manifest] [-i mode] [-o mode] [-d dens] [-r len] [-j n] [-n] [-v] [infile outfile]...\n" );
     fprintf( stderr, "\n" );
     fprintf( stderr, "Convert .tap from PDP-10 one data packing format to another\n" );
     fprintf( stderr, "\n" );
-    fprintf( stderr, "-i specify input file format\n" );
+    fprintf( stderr, "-i specify input file format, or auto to detect it from the first records\n" );
     fprintf( stderr, "-o specify output file format\n" );
     fprintf( stderr, "-d specify tape density (800,1600, 6250, etc)\n" );
     fprintf( stderr, "-r specify reel size (2400ft, 732m)\n" );
+    fprintf( stderr, "-j convert using n worker threads\n" );
+    fprintf( stderr, "-n repack records even if the formats match, rather than copying them\n" );
     fprintf( stderr, "-v provide processing details\n" );
     fprintf( stderr, "-h this usage\n" );
+    fprintf( stderr, "--scan list the files and records on a tape without converting it\n" );
+    fprintf( stderr, "--stats=file write timing and counters as JSON to file at exit and on SIGUSR1\n" );
+    fprintf( stderr, "--profile report CPU performance counters for each stage of the conversion\n" );
+    fprintf( stderr, "--hugepages=never|thp|always back large record buffers with huge pages:\n" );
+    fprintf( stderr, "        thp (the default) requests transparent huge pages, always uses reserved ones\n" );
+    fprintf( stderr, "--partition with -j, scan a mapped image's record lengths, then convert\n" );
+    fprintf( stderr, "        parts of it in parallel, each written directly to its place in the output\n" );
+    fprintf( stderr, "--io=stdio|uring|direct how regular image files are read and written:\n" );
+    fprintf( stderr, "        uring keeps several large transfers in flight with io_uring,\n" );
+    fprintf( stderr, "        direct also bypasses the page cache (O_DIRECT)\n" );
+    fprintf( stderr, "--batch convert each infile outfile pair, or those listed in manifest\n" );
+    fprintf( stderr, "        (infile outfile [inmode [outmode]] per line), on n threads.\n" );
+    fprintf( stderr, "        A line is written to stdout as each ends: job, exit status, seconds, files\n" );
     fprintf( stderr, "\n" );
     fprintf( stderr, "infile and outfile default to stdin and stdout\n" );
     fprintf( stderr, "input and output modes default to core-dump\n" );